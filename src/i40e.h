@@ -17,6 +17,7 @@
 #include <linux/slab.h>
 #include <linux/list.h>
 #include <linux/hash.h>
+#include <linux/jhash.h>
 #include <linux/string.h>
 #include <linux/in.h>
 #include <linux/ip.h>
@@ -211,6 +212,13 @@ enum i40e_state_t {
 	__I40E_VFS_RELEASING,
 	__I40E_VF_RESETS_DISABLED,	/* disable resets during i40e_remove */
 	__I40E_IN_REMOVE,
+	__I40E_PORT_STATE_LOST,	/* reset wider than a PF reset, see i40e_rebuild */
+	__I40E_NAPI_HIST,	/* collect the q_vector NAPI histograms */
+	/* PF holds a reference on the matching Tx feature static key */
+	__I40E_TX_KEY_ATR,
+	__I40E_TX_KEY_DCB,
+	__I40E_TX_KEY_PTP,
+	__I40E_TX_KEY_L2TAG2,
 	/* This must be last as it determines the size of the BITMAP */
 	__I40E_STATE_SIZE__,
 };
@@ -297,8 +305,19 @@ struct i40e_rx_flow_userdef {
 	bool outer_ip;
 };
 
+/* Context of a bulk sideband Flow Director programming run, see
+ * i40e_fdir_bulk_begin()
+ */
+struct i40e_fdir_bulk {
+	struct i40e_pf *pf;
+	struct i40e_ring *tx_ring;
+	u16 pending;	/* queued but not yet released to HW */
+};
+
 struct i40e_fdir_filter {
 	struct hlist_node fdir_node;
+	struct hlist_node fdir_loc_node;	/* pf->fdir_loc_hash by fd_id */
+	struct hlist_node fdir_key_node;	/* pf->fdir_key_hash by match */
 	/* filter input set */
 	u8 flow_type;
 	u8 ipl4_proto;
@@ -361,6 +380,8 @@ struct i40e_fdir_filter {
 
 struct i40e_cloud_filter {
 	struct hlist_node cloud_node;
+	struct hlist_node cloud_loc_node;	/* pf->cloud_loc_hash by id */
+	struct hlist_node cloud_cookie_node;	/* pf->cloud_cookie_hash */
 	unsigned long cookie;
 	/* cloud filter input set follows */
 	u8 outer_mac[ETH_ALEN];
@@ -553,6 +574,81 @@ struct i40e_channel {
 	struct i40e_vsi *parent_vsi;
 };
 
+/* Per-opcode AdminQ accounting, one slot per opcode seen */
+#define I40E_AQ_STATS_SLOTS	64
+#define I40E_AQ_LAT_BUCKETS	16	/* log2 of usecs, last is open ended */
+#define I40E_AQ_RC_TIMEOUT	(I40E_AQ_RC_EFBIG + 1)
+#define I40E_AQ_RC_BUCKETS	(I40E_AQ_RC_TIMEOUT + 1)
+
+struct i40e_aq_op_stats {
+	u16 opcode;
+	bool used;
+	u32 asq_count;		/* commands sent */
+	u32 arq_count;		/* events received */
+	u32 rc[I40E_AQ_RC_BUCKETS];	/* by retval, timeouts last */
+	u32 lat_hist[I40E_AQ_LAT_BUCKETS];
+	u32 lat_max_us;
+	u64 lat_total_us;
+};
+
+struct i40e_aq_stats {
+	spinlock_t lock;
+	u32 untracked;		/* updates dropped, all slots taken */
+	struct i40e_aq_op_stats op[I40E_AQ_STATS_SLOTS];
+};
+
+/* Phases of the rebuild after a reset, in the order i40e_rebuild() runs them */
+#define I40E_REBUILD_PHASE_LIST(PHASE)		\
+	PHASE(ADMINQ,	"adminq")		\
+	PHASE(HMC,	"hmc")			\
+	PHASE(DCB,	"dcb")			\
+	PHASE(SWITCH,	"switch")		\
+	PHASE(VSI,	"veb_vsi")		\
+	PHASE(CHANNELS,	"channels")		\
+	PHASE(MISC,	"misc")			\
+	PHASE(VSI_UP,	"vsi_up")		\
+	PHASE(LINK,	"link")			\
+	PHASE(PORT_CFG,	"port_cfg")		\
+	PHASE(VFS,	"vfs")
+
+#define I40E_REBUILD_PHASE_ENUM(phase, name)	I40E_REBUILD_##phase,
+enum i40e_rebuild_phase {
+	I40E_REBUILD_PHASE_LIST(I40E_REBUILD_PHASE_ENUM)
+	I40E_REBUILD_NUM_PHASES
+};
+
+#define I40E_REBUILD_PHASE_NAME_LEN	16
+
+struct i40e_rebuild_timing {
+	u32 count;		/* rebuilds run to completion */
+	bool port_reset;	/* the last one followed a port wide reset */
+	u64 total_us;		/* of the last rebuild */
+	u64 total_max_us;
+	u64 phase_us[I40E_REBUILD_NUM_PHASES];	/* of the last rebuild */
+	u64 phase_max_us[I40E_REBUILD_NUM_PHASES];
+};
+
+/* Hardware statistics are collected in groups.  A group is refreshed when
+ * somebody reads it and otherwise only as often as its narrowest counter
+ * needs to be read to not miss a wrap.
+ */
+enum i40e_stats_group {
+	I40E_STATS_PORT,	/* port eth counters and errors */
+	I40E_STATS_FC,		/* link and priority flow control */
+	I40E_STATS_SIZE,	/* packet size histograms */
+	I40E_STATS_FD,		/* flow director matches */
+	I40E_STATS_LPI,		/* EEE low power idle */
+	I40E_STATS_VSI,		/* VSI eth counters and ring totals */
+	I40E_STATS_VEB,		/* switch component counters */
+	I40E_STATS_NUM_GROUPS
+};
+
+#define I40E_STATS_PF_GROUPS	(BIT(I40E_STATS_PORT) | BIT(I40E_STATS_FC) | \
+				 BIT(I40E_STATS_SIZE) | BIT(I40E_STATS_FD) | \
+				 BIT(I40E_STATS_LPI))
+/* readers polling faster than this share one hardware read */
+#define I40E_STATS_READ_MAX_AGE	HZ
+
 #ifdef HAVE_PTP_1588_CLOCK
 struct i40e_ptp_pins_settings;
 #endif /* HAVE_PTP_1588_CLOCK */
@@ -584,13 +680,26 @@ struct i40e_pf {
 	u8 atr_sample_rate;
 	bool wol_en;
 
+	/* Sideband filters are kept on fdir_filter_list in no particular
+	 * order and indexed by location and by match criteria for lookups.
+	 */
 	struct hlist_head fdir_filter_list;
+#define I40E_FDIR_HASH_BITS	10
+	DECLARE_HASHTABLE(fdir_loc_hash, I40E_FDIR_HASH_BITS);
+	DECLARE_HASHTABLE(fdir_key_hash, I40E_FDIR_HASH_BITS);
 	u16 fdir_pf_active_filters;
 	unsigned long fd_flush_timestamp;
 	u32 fd_flush_cnt;
 	u32 fd_add_err;
 	u32 fd_atr_cnt;
 
+	/* Pre-mapped dummy packets for bulk sideband programming */
+	u8 *fdir_arena;
+	dma_addr_t fdir_arena_dma;
+	size_t fdir_arena_size;
+	u32 fd_sb_bulk_queued;
+	u32 fd_sb_bulk_done;
+
 	/* Book-keeping of side-band filter count per flow-type.
 	 * This is used to detect and handle input set changes for
 	 * respective flow-type.
@@ -622,6 +731,9 @@ struct i40e_pf {
 #endif /* HAVE_UDP_TUNNEL_NIC_INFO */
 
 	struct hlist_head cloud_filter_list;
+#define I40E_CLOUD_HASH_BITS	8
+	DECLARE_HASHTABLE(cloud_loc_hash, I40E_CLOUD_HASH_BITS);
+	DECLARE_HASHTABLE(cloud_cookie_hash, I40E_CLOUD_HASH_BITS);
 	u16 num_cloud_filters;
 
 	/* Array of count of outerip cloud filters */
@@ -637,6 +749,12 @@ struct i40e_pf {
 	unsigned long service_timer_previous;
 	struct timer_list service_timer;
 	struct work_struct service_task;
+	/* MAC/VLAN filter sync runs apart from the service task so a large
+	 * filter update does not hold up the other subtasks.
+	 */
+	struct work_struct filter_sync_task;
+	struct work_struct adminq_task;
+	void *filter_sync_buf;	/* AQ buffer reused across sync passes */
 
 	u32 hw_features;
 #define I40E_HW_RSS_AQ_CAPABLE			BIT(0)
@@ -702,6 +820,7 @@ struct i40e_pf {
 
 	struct i40e_client_instance *cinst;
 	bool stat_offsets_loaded;
+	unsigned long stats_refreshed[I40E_STATS_NUM_GROUPS];	/* jiffies */
 	struct i40e_hw_port_stats stats;
 	struct i40e_hw_port_stats stats_offsets;
 	u32 tx_timeout_count;
@@ -716,8 +835,13 @@ struct i40e_pf {
 	u16 empr_count; /* EMP reset count */
 	u16 pfr_count; /* PF reset count */
 	u16 sw_int_count; /* SW interrupt count */
+	struct i40e_rebuild_timing rebuild_timing;
 
 	struct mutex switch_mutex;
+	struct mutex vc_mutex;	/* serializes VF requests on shared resources */
+	struct workqueue_struct *vc_wq;	/* runs the per-VF virtchnl tasks */
+	unsigned long vf_stats_max_age;	/* jiffies a VF stats snapshot lives */
+	struct i40e_vf_reset_timing vf_reset_timing;
 	struct mutex tc_mutex; /* Used to protect the dcb config */
 	u16 lan_vsi;       /* our default LAN VSI */
 	u16 lan_veb;       /* initial relay, if exists */
@@ -747,6 +871,7 @@ struct i40e_pf {
 	int num_alloc_vfs;	/* actual number of VFs allocated */
 	u32 vf_aq_requests;
 	u32 arq_overflows;	/* Not fatal, possibly indicative of problems */
+	struct i40e_aq_stats aq_stats;
 	unsigned long last_printed_mdd_jiffies; /* MDD message rate limit */
 	/* DCBx/DCBNL capability for PF that indicates
 	 * whether DCBx is managed by firmware or host
@@ -918,6 +1043,21 @@ static inline u64 i40e_addr_to_hkey(const u8 *macaddr)
 	return key;
 }
 
+/**
+ * i40e_mac_vlan_hkey - Hash a MAC/VLAN pair for the VSI filter index
+ * @macaddr: the MAC Address
+ * @vlan: the VLAN id, or I40E_VLAN_ANY
+ *
+ * Unlike i40e_addr_to_hkey the VLAN is folded into the key, so the many VLAN
+ * filters sharing one MAC address do not all land in the same bucket.
+ **/
+static inline u32 i40e_mac_vlan_hkey(const u8 *macaddr, s16 vlan)
+{
+	u64 key = i40e_addr_to_hkey(macaddr);
+
+	return jhash_3words((u32)key, (u32)(key >> 32), (u16)vlan, 0);
+}
+
 enum i40e_filter_state {
 	I40E_FILTER_INVALID = 0,	/* Invalid state */
 	I40E_FILTER_NEW,		/* New, not sent to FW yet */
@@ -929,6 +1069,7 @@ enum i40e_filter_state {
 };
 struct i40e_mac_filter {
 	struct hlist_node hlist;
+	struct hlist_node vlan_hlist;	/* node in vsi->mac_vlan_hash */
 	u8 macaddr[ETH_ALEN];
 #define I40E_VLAN_ANY -1
 	s16 vlan;
@@ -969,6 +1110,7 @@ struct i40e_veb {
 	u8  bw_tc_max_quanta[I40E_MAX_TRAFFIC_CLASS];
 	struct kobject *kobj;
 	bool stat_offsets_loaded;
+	unsigned long stats_refreshed;	/* jiffies */
 	struct i40e_eth_stats stats;
 	struct i40e_eth_stats stats_offsets;
 	struct i40e_veb_tc_stats tc_stats;
@@ -985,6 +1127,8 @@ struct i40e_vsi {
 #endif
 	bool netdev_registered;
 	bool stat_offsets_loaded;
+	bool stats_wanted;		/* read since the last refresh */
+	unsigned long stats_refreshed;	/* jiffies */
 
 	u32 current_netdev_flags;
 	DECLARE_BITMAP(state, __I40E_VSI_STATE_SIZE__);
@@ -996,6 +1140,17 @@ struct i40e_vsi {
 	spinlock_t mac_filter_hash_lock;
 	/* Fixed size hash table with 2^8 buckets for MAC filters */
 	DECLARE_HASHTABLE(mac_filter_hash, 8);
+	/* Index of the same filters keyed by MAC and VLAN, grown on demand.
+	 * Both tables and the counters below are only modified under
+	 * mac_filter_hash_lock; the counters may be read without it.
+	 */
+	struct hlist_head *mac_vlan_hash;
+#define I40E_MAC_VLAN_HASH_MIN_BITS	4
+#define I40E_MAC_VLAN_HASH_MAX_BITS	12
+	u8 mac_vlan_hash_bits;
+	u32 mac_vlan_hash_grows;
+	u32 num_mac_filters;
+	u32 num_vlan_filters;
 	bool has_vlan_filter;
 
 	/* VSI stats */
@@ -1117,19 +1272,22 @@ extern struct ida i40e_client_ida;
 
 /* struct that defines an interrupt vector */
 struct i40e_q_vector {
+	/* hot: Rx ITR state and what every poll reads, first cache line */
+	struct i40e_ring_container rx;
 	struct i40e_vsi *vsi;
 
-	u16 v_idx;		/* index in the vsi->q_vector array. */
 	u16 reg_idx;		/* register index of the interrupt */
+	u16 v_idx;		/* index in the vsi->q_vector array. */
+	u8 itr_countdown;	/* when 0 should adjust adaptive ITR */
+	u8 num_ringpairs;	/* total number of ring pairs in vector */
+	bool arm_wb_state;
 
-	struct napi_struct napi;
-
-	struct i40e_ring_container rx;
+	/* hot: Tx ITR state, within the first two cache lines */
 	struct i40e_ring_container tx;
 
-	u8 itr_countdown;	/* when 0 should adjust adaptive ITR */
-	u8 num_ringpairs;	/* total number of ring pairs in vector */
+	struct napi_struct napi;
 
+	/* cold */
 #ifdef HAVE_IRQ_AFFINITY_NOTIFY
 	cpumask_t affinity_mask;
 	struct irq_affinity_notify affinity_notify;
@@ -1137,9 +1295,18 @@ struct i40e_q_vector {
 
 	struct rcu_head rcu;	/* to avoid race with update stats on free */
 	char name[I40E_INT_NAME_STR_LEN];
-	bool arm_wb_state;
+
+	struct i40e_napi_hist napi_hist;
 } ____cacheline_internodealigned_in_smp;
 
+I40E_CHECK_HOT_FIELD(i40e_q_vector, rx, 1);
+I40E_CHECK_HOT_FIELD(i40e_q_vector, vsi, 1);
+I40E_CHECK_HOT_FIELD(i40e_q_vector, reg_idx, 1);
+I40E_CHECK_HOT_FIELD(i40e_q_vector, itr_countdown, 1);
+I40E_CHECK_HOT_FIELD(i40e_q_vector, num_ringpairs, 1);
+I40E_CHECK_HOT_FIELD(i40e_q_vector, arm_wb_state, 1);
+I40E_CHECK_HOT_FIELD(i40e_q_vector, tx, 2);
+
 /* lan device */
 struct i40e_device {
 	struct list_head list;
@@ -1254,11 +1421,40 @@ static inline void i40e_write_fd_input_set(struct i40e_pf *pf,
 			  (u32)(val & 0xFFFFFFFFULL));
 }
 
+/**
+ * i40e_fdir_match_key - hash the criteria compared by i40e_match_fdir_filter
+ * @f: the Flow Director filter
+ *
+ * Filters which would be rejected as duplicates of each other always end up
+ * with the same key.
+ **/
+static inline u32 i40e_fdir_match_key(const struct i40e_fdir_filter *f)
+{
+	return jhash_3words((__force u32)f->dst_ip ^ (__force u32)f->src_ip,
+			    ((__force u32)f->dst_port << 16) |
+			    (__force u32)f->src_port,
+			    ((u32)f->flow_type << 24) |
+			    ((u32)f->ipl4_proto << 16) |
+			    (__force u32)f->vlan_tag,
+			    (__force u32)f->vlan_etype);
+}
+
+void i40e_fdir_filter_link(struct i40e_pf *pf, struct i40e_fdir_filter *f);
+void i40e_fdir_filter_unlink(struct i40e_pf *pf, struct i40e_fdir_filter *f);
+struct i40e_fdir_filter *i40e_find_fdir_filter_by_loc(struct i40e_pf *pf,
+						      u32 loc);
+void i40e_cloud_filter_link(struct i40e_pf *pf, struct i40e_cloud_filter *f);
+void i40e_cloud_filter_unlink(struct i40e_pf *pf,
+			      struct i40e_cloud_filter *f);
+struct i40e_cloud_filter *i40e_find_cloud_filter_by_loc(struct i40e_pf *pf,
+							u32 loc);
+
 /* needed by i40e_ethtool.c */
 int i40e_up(struct i40e_vsi *vsi);
 void i40e_down(struct i40e_vsi *vsi);
 extern char i40e_driver_name[];
 extern const char i40e_driver_version_str[];
+extern const char * const i40e_rebuild_phase_str[];
 void i40e_do_reset_safe(struct i40e_pf *pf, u32 reset_flags);
 void i40e_do_reset(struct i40e_pf *pf, u32 reset_flags, bool lock_acquired);
 int i40e_config_rss(struct i40e_vsi *vsi, u8 *seed, u8 *lut, u16 lut_size);
@@ -1287,6 +1483,8 @@ i40e_find_vsi_by_type(struct i40e_pf *pf, u16 type)
 	return NULL;
 }
 void i40e_update_stats(struct i40e_vsi *vsi);
+void i40e_update_stats_groups(struct i40e_vsi *vsi, unsigned long groups,
+			      unsigned long max_age);
 void i40e_update_veb_stats(struct i40e_veb *veb);
 void i40e_update_eth_stats(struct i40e_vsi *vsi);
 #ifdef HAVE_NDO_GET_STATS64
@@ -1299,6 +1497,11 @@ int i40e_fetch_switch_configuration(struct i40e_pf *pf,
 
 int i40e_add_del_fdir(struct i40e_vsi *vsi,
 		      struct i40e_fdir_filter *input, bool add);
+int i40e_fdir_bulk_begin(struct i40e_pf *pf, struct i40e_fdir_bulk *bulk);
+int i40e_fdir_bulk_add(struct i40e_fdir_bulk *bulk,
+		       struct i40e_fdir_filter *input, bool add);
+void i40e_fdir_bulk_commit(struct i40e_fdir_bulk *bulk);
+void i40e_fdir_arena_free(struct i40e_pf *pf);
 void i40e_fdir_check_and_reenable(struct i40e_pf *pf);
 u32 i40e_get_current_fd_count(struct i40e_pf *pf);
 u32 i40e_get_cur_guaranteed_fd_count(struct i40e_pf *pf);
@@ -1311,8 +1514,19 @@ struct i40e_mac_filter *i40e_find_filter(struct i40e_vsi *vsi,
 struct i40e_mac_filter *i40e_add_filter(struct i40e_vsi *vsi,
 					const u8 *macaddr, s16 vlan);
 void __i40e_del_filter(struct i40e_vsi *vsi, struct i40e_mac_filter *f);
+int i40e_mac_vlan_hash_alloc(struct i40e_vsi *vsi);
+void i40e_mac_vlan_hash_free(struct i40e_vsi *vsi);
+void i40e_mac_filter_link(struct i40e_vsi *vsi, struct i40e_mac_filter *f);
+void i40e_mac_filter_unlink(struct i40e_vsi *vsi, struct i40e_mac_filter *f);
+struct i40e_mac_filter *i40e_mac_filter_lookup(struct i40e_vsi *vsi,
+					       const u8 *macaddr, s16 vlan);
+void i40e_mac_filter_set_vlan(struct i40e_vsi *vsi, struct i40e_mac_filter *f,
+			      s16 vlan);
+void i40e_mac_vlan_hash_stats(struct i40e_vsi *vsi, u32 *used, u32 *max_chain);
 void i40e_del_filter(struct i40e_vsi *vsi, const u8 *macaddr, s16 vlan);
 int i40e_sync_vsi_filters(struct i40e_vsi *vsi);
+int i40e_sync_vsi_filters_buf(struct i40e_vsi *vsi, void *aq_buf);
+void i40e_filter_sync_schedule(struct i40e_pf *pf);
 struct i40e_vsi *i40e_vsi_setup(struct i40e_pf *pf, u8 type,
 				u16 uplink, u32 param1);
 int i40e_vsi_release(struct i40e_vsi *vsi);
@@ -1355,6 +1569,9 @@ int i40e_add_del_custom_cloud_filter(struct i40e_vsi *vsi,
 int i40e_get_cloud_filter_type(u8 flags, u16 *type);
 void i40e_vsi_reset_stats(struct i40e_vsi *vsi);
 void i40e_pf_reset_stats(struct i40e_pf *pf);
+void i40e_napi_hist_clear(struct i40e_pf *pf);
+void i40e_napi_hist_set(struct i40e_pf *pf, bool enable);
+void i40e_tx_keys_update(struct i40e_pf *pf, bool active);
 #ifdef CONFIG_DEBUG_FS
 void i40e_dbg_pf_init(struct i40e_pf *pf);
 void i40e_dbg_pf_exit(struct i40e_pf *pf);
@@ -1480,6 +1697,11 @@ void i40e_set_fec_in_flags(u8 fec_cfg, u64 *flags);
 #ifdef HAVE_XDP_SUPPORT
 int i40e_queue_pair_disable(struct i40e_vsi *vsi, int queue_pair);
 int i40e_queue_pair_enable(struct i40e_vsi *vsi, int queue_pair);
+int i40e_queue_pair_stop(struct i40e_vsi *vsi, int queue_pair);
+int i40e_queue_pair_start(struct i40e_vsi *vsi, int queue_pair);
+int i40e_reconfig_rss_queues_hitless(struct i40e_pf *pf, int queue_count);
+int i40e_vsi_restart_queue_pairs(struct i40e_vsi *vsi, u16 max_frame,
+				 u16 rx_buf_len);
 #endif
 
 static inline bool i40e_enabled_xdp_vsi(struct i40e_vsi *vsi)
@@ -352,6 +352,7 @@ static i40e_status i40e_init_asq(struct i40e_hw *hw)
 
 	hw->aq.asq.next_to_use = 0;
 	hw->aq.asq.next_to_clean = 0;
+	hw->aq.asq_async_pending = 0;
 
 	/* allocate the ring memory */
 	ret_code = i40e_alloc_adminq_asq_ring(hw);
@@ -442,6 +443,45 @@ init_adminq_exit:
 	return ret_code;
 }
 
+/**
+ *  i40e_flush_asq_async - complete outstanding asynchronous commands
+ *  @hw: pointer to the hardware structure
+ *
+ *  Called with the send queue stopped. Every asynchronous command that has
+ *  not been reaped yet completes with I40E_AQ_RC_EFLUSHED so its owner can
+ *  release whatever it attached to the command.
+ **/
+static void i40e_flush_asq_async(struct i40e_hw *hw)
+{
+	struct i40e_adminq_ring *asq = &(hw->aq.asq);
+	struct i40e_asq_cmd_details *details;
+	u16 ntc = asq->next_to_clean;
+	struct i40e_aq_desc desc_cb;
+
+	while (hw->aq.asq_async_pending && ntc != asq->next_to_use) {
+		details = I40E_ADMINQ_DETAILS(*asq, ntc);
+		if (details->async_cb) {
+			I40E_ADMINQ_ASYNC_CB cb_func =
+					(I40E_ADMINQ_ASYNC_CB)details->async_cb;
+			i40e_memcpy(&desc_cb, I40E_ADMINQ_DESC(*asq, ntc),
+				    sizeof(struct i40e_aq_desc),
+				    I40E_DMA_TO_NONDMA);
+			desc_cb.retval = CPU_TO_LE16(I40E_AQ_RC_EFLUSHED);
+			i40e_aq_stats_complete(hw, &desc_cb, false,
+					       details->submit_ts);
+			cb_func(hw, &desc_cb, details->cb_data);
+			hw->aq.asq_async_pending--;
+		}
+		i40e_memset(details, 0, sizeof(*details), I40E_NONDMA_MEM);
+		ntc++;
+		if (ntc == asq->count)
+			ntc = 0;
+	}
+
+	asq->next_to_clean = ntc;
+	hw->aq.asq_async_pending = 0;
+}
+
 /**
  *  i40e_shutdown_asq - shutdown the ASQ
  *  @hw: pointer to the hardware structure
@@ -466,6 +506,9 @@ static i40e_status i40e_shutdown_asq(struct i40e_hw *hw)
 	wr32(hw, hw->aq.asq.bal, 0);
 	wr32(hw, hw->aq.asq.bah, 0);
 
+	/* complete async commands firmware will never get to */
+	i40e_flush_asq_async(hw);
+
 	hw->aq.asq.count = 0; /* to indicate uninitialized queue */
 
 	/* free ring buffers */
@@ -768,6 +811,16 @@ static u16 i40e_clean_asq(struct i40e_hw *hw)
 				    I40E_DMA_TO_DMA);
 			cb_func(hw, &desc_cb);
 		}
+		if (details->async_cb) {
+			I40E_ADMINQ_ASYNC_CB cb_func =
+					(I40E_ADMINQ_ASYNC_CB)details->async_cb;
+			i40e_memcpy(&desc_cb, desc, sizeof(struct i40e_aq_desc),
+				    I40E_DMA_TO_NONDMA);
+			i40e_aq_stats_complete(hw, &desc_cb, false,
+					       details->submit_ts);
+			cb_func(hw, &desc_cb, details->cb_data);
+			hw->aq.asq_async_pending--;
+		}
 		i40e_memset(desc, 0, sizeof(*desc), I40E_DMA_MEM);
 		i40e_memset(details, 0, sizeof(*details), I40E_NONDMA_MEM);
 		ntc++;
@@ -824,6 +877,7 @@ i40e_asq_send_command_atomic_exec(struct i40e_hw *hw,
 	struct i40e_asq_cmd_details *details;
 	struct i40e_aq_desc *desc_on_ring;
 	bool cmd_completed = false;
+	u64  submit_ts = 0;
 	u16  retval = 0;
 	u32  val = 0;
 
@@ -934,8 +988,13 @@ i40e_asq_send_command_atomic_exec(struct i40e_hw *hw,
 	(hw->aq.asq.next_to_use)++;
 	if (hw->aq.asq.next_to_use == hw->aq.asq.count)
 		hw->aq.asq.next_to_use = 0;
-	if (!details->postpone)
+	if (details->async_cb)
+		hw->aq.asq_async_pending++;
+	if (!details->postpone) {
+		submit_ts = i40e_aq_stats_submit(hw, desc_on_ring);
+		details->submit_ts = submit_ts;
 		wr32(hw, hw->aq.asq.tail, hw->aq.asq.next_to_use);
+	}
 
 	/* if cmd_details are not defined or async flag is not set,
 	 * we need to wait for desc write back
@@ -957,8 +1016,10 @@ i40e_asq_send_command_atomic_exec(struct i40e_hw *hw,
 		} while (total_delay < hw->aq.asq_cmd_timeout);
 	}
 
-	/* if ready, copy the desc back to temp */
-	if (i40e_asq_done(hw)) {
+	/* if ready, copy the desc back to temp; async commands report their
+	 * result through the completion callback instead
+	 */
+	if (!details->async && i40e_asq_done(hw)) {
 		i40e_memcpy(desc, desc_on_ring, sizeof(struct i40e_aq_desc),
 			    I40E_DMA_TO_NONDMA);
 		if (buff != NULL)
@@ -993,6 +1054,9 @@ i40e_asq_send_command_atomic_exec(struct i40e_hw *hw,
 		i40e_memcpy(details->wb_desc, desc_on_ring,
 			    sizeof(struct i40e_aq_desc), I40E_DMA_TO_NONDMA);
 
+	if (!details->async && !details->postpone)
+		i40e_aq_stats_complete(hw, desc, !cmd_completed, submit_ts);
+
 	/* update the error if time out occurred */
 	if ((!cmd_completed) &&
 	    (!details->async && !details->postpone)) {
@@ -1102,6 +1166,87 @@ inline i40e_status i40e_asq_send_command_v2(struct i40e_hw *hw,
 					       cmd_details, true, aq_status);
 }
 
+/**
+ *  i40e_fill_async_cmd_details - make an AdminQ command asynchronous
+ *  @details: command details to fill, passed to any i40e_aq_* helper
+ *  @cb: called with the written back descriptor once the command completes
+ *  @cb_data: opaque pointer handed to @cb
+ *
+ *  A command sent with these details returns as soon as the tail is bumped,
+ *  so that several commands may be in flight at once. Firmware is asked to
+ *  raise the AdminQ interrupt cause on completion; completed commands are
+ *  reaped by i40e_asq_clean_async, or by the next synchronous send. @cb
+ *  runs with the send queue lock held and must not issue further AdminQ
+ *  commands. It also runs, with I40E_AQ_RC_EFLUSHED, for commands still
+ *  outstanding when the send queue is shut down, so @cb_data must stay
+ *  valid until @cb has run even if the submitter gave up waiting.
+ *
+ *  Sending returns I40E_ERR_ADMIN_QUEUE_FULL when no descriptor is free, in
+ *  which case the caller should wait for completions and retry.
+ **/
+void i40e_fill_async_cmd_details(struct i40e_asq_cmd_details *details,
+				 I40E_ADMINQ_ASYNC_CB cb, void *cb_data)
+{
+	i40e_memset(details, 0, sizeof(*details), I40E_NONDMA_MEM);
+	details->async = true;
+	details->async_cb = (void *)cb;
+	details->cb_data = cb_data;
+	details->flags_ena = I40E_AQ_FLAG_SI;
+}
+
+/**
+ *  i40e_asq_clean_async - reap completed asynchronous commands
+ *  @hw: pointer to the hw struct
+ *
+ *  Runs the completion callbacks of every command firmware has finished.
+ *  Meant to be called when the AdminQ interrupt cause fires.
+ *
+ *  Returns the number of asynchronous commands still outstanding.
+ **/
+u16 i40e_asq_clean_async(struct i40e_hw *hw)
+{
+	u16 pending;
+
+	i40e_acquire_spinlock(&hw->aq.asq_spinlock);
+	if (hw->aq.asq.count && hw->aq.asq_async_pending)
+		i40e_clean_asq(hw);
+	pending = hw->aq.asq_async_pending;
+	i40e_release_spinlock(&hw->aq.asq_spinlock);
+
+	return pending;
+}
+
+/**
+ *  i40e_asq_wait_async - wait for all asynchronous commands to complete
+ *  @hw: pointer to the hw struct
+ *  @timeout: how long to wait without any command completing, in usecs
+ *
+ *  Lets a caller queue a batch of asynchronous commands and then wait once
+ *  for the whole batch rather than once per command. Firmware works through
+ *  the send queue in order, so the timeout is restarted on each completion
+ *  instead of covering the whole batch.
+ **/
+i40e_status i40e_asq_wait_async(struct i40e_hw *hw, u32 timeout)
+{
+	u32 total_delay = 0;
+	u16 pending, last;
+
+	last = i40e_asq_clean_async(hw);
+	while (last) {
+		if (total_delay >= timeout)
+			return I40E_ERR_ADMIN_QUEUE_TIMEOUT;
+		usleep_range(40, 60);
+		total_delay += 50;
+
+		pending = i40e_asq_clean_async(hw);
+		if (pending < last)
+			total_delay = 0;
+		last = pending;
+	}
+
+	return I40E_SUCCESS;
+}
+
 /**
  *  i40e_fill_default_direct_cmd_desc - AQ descriptor helper function
  *  @desc:     pointer to the temp descriptor (non DMA mem)
@@ -1180,6 +1325,7 @@ i40e_status i40e_clean_arq_element(struct i40e_hw *hw,
 
 	i40e_memcpy(&e->desc, desc, sizeof(struct i40e_aq_desc),
 		    I40E_DMA_TO_NONDMA);
+	i40e_aq_stats_arq(hw, &e->desc);
 	datalen = LE16_TO_CPU(desc->datalen);
 	e->msg_len = min(datalen, e->buf_len);
 	if (e->msg_buf != NULL && (e->msg_len != 0))
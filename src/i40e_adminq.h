@@ -47,6 +47,9 @@ struct i40e_asq_cmd_details {
 	bool async;
 	bool postpone;
 	struct i40e_aq_desc *wb_desc;
+	void *async_cb; /* cast from type I40E_ADMINQ_ASYNC_CB */
+	void *cb_data;
+	u64 submit_ts;	/* set when the command is handed to firmware */
 };
 
 #define I40E_ADMINQ_DETAILS(R, i)   \
@@ -75,6 +78,8 @@ struct i40e_adminq_info {
 	u16 api_maj_ver;                /* api major version */
 	u16 api_min_ver;                /* api minor version */
 
+	u16 asq_async_pending;          /* async commands not yet cleaned */
+
 	struct i40e_spinlock asq_spinlock; /* Send queue spinlock */
 	struct i40e_spinlock arq_spinlock; /* Receive queue spinlock */
 
@@ -90,6 +90,8 @@ static int i40e_dcbnl_ieee_getpfc(struct net_device *dev,
 	i40e_get_pfc_delay(hw, &pfc->delay);
 
 	/* Get Requests/Indications */
+	i40e_update_stats_groups(pf->vsi[pf->lan_vsi], BIT(I40E_STATS_FC),
+				 I40E_STATS_READ_MAX_AGE);
 	for (i = 0; i < I40E_MAX_TRAFFIC_CLASS; i++) {
 		pfc->requests[i] = pf->stats.priority_xoff_tx[i];
 		pfc->indications[i] = pf->stats.priority_xoff_rx[i];
@@ -361,6 +363,7 @@ static u8 i40e_dcbnl_setstate(struct net_device *netdev, u8 state)
 		} else {
 			pf->flags &= ~I40E_FLAG_DCB_ENABLED;
 		}
+		i40e_tx_keys_update(pf, true);
 	} else {
 		/* Cannot directly manipulate FW LLDP Agent */
 		ret = I40E_DCBNL_STATUS_ERROR;
@@ -110,20 +110,155 @@ static const char *i40e_filter_state_string[] = {
 static void i40e_dbg_dump_vsi_filters(struct i40e_pf *pf, struct i40e_vsi *vsi)
 {
 	struct i40e_mac_filter *f;
+	u32 used, max_chain;
 	int bkt;
 
+	spin_lock_bh(&vsi->mac_filter_hash_lock);
 	hash_for_each(vsi->mac_filter_hash, bkt, f, hlist) {
 		dev_info(&pf->pdev->dev,
 			 "    mac_filter_hash: %pM vid=%d, state %s\n",
 			 f->macaddr, f->vlan,
 			 i40e_filter_state_string[f->state]);
 	}
+	i40e_mac_vlan_hash_stats(vsi, &used, &max_chain);
+	dev_info(&pf->pdev->dev,
+		 "    filters %u, vlan_filters %u, mac_vlan_hash buckets %lu used %u max_chain %u grows %u\n",
+		 vsi->num_mac_filters, vsi->num_vlan_filters,
+		 BIT(vsi->mac_vlan_hash_bits), used, max_chain,
+		 vsi->mac_vlan_hash_grows);
+	spin_unlock_bh(&vsi->mac_filter_hash_lock);
 	dev_info(&pf->pdev->dev, "    active_filters %u, promisc_threshold %u, overflow promisc %s\n",
 		 vsi->active_filters, vsi->promisc_threshold,
 		 (test_bit(__I40E_VSI_OVERFLOW_PROMISC, vsi->state) ?
 		  "ON" : "OFF"));
 }
 
+/**
+ * i40e_dbg_dump_aq_stats - dump per-opcode AdminQ statistics
+ * @pf: the i40e_pf created in command write
+ */
+static void i40e_dbg_dump_aq_stats(struct i40e_pf *pf)
+{
+	struct i40e_aq_stats *stats = &pf->aq_stats;
+	struct i40e_aq_op_stats op;
+	int i, j;
+
+	dev_info(&pf->pdev->dev, "aq stats: untracked %u\n",
+		 READ_ONCE(stats->untracked));
+	for (i = 0; i < I40E_AQ_STATS_SLOTS; i++) {
+		u32 done = 0;
+
+		spin_lock_bh(&stats->lock);
+		op = stats->op[i];
+		spin_unlock_bh(&stats->lock);
+		if (!op.used)
+			continue;
+
+		for (j = 0; j < I40E_AQ_LAT_BUCKETS; j++)
+			done += op.lat_hist[j];
+		dev_info(&pf->pdev->dev,
+			 "opcode 0x%04x: sent %u events %u avg %llu us max %u us\n",
+			 op.opcode, op.asq_count, op.arq_count,
+			 done ? div_u64(op.lat_total_us, done) : 0,
+			 op.lat_max_us);
+		for (j = 0; j < I40E_AQ_RC_BUCKETS; j++) {
+			if (!op.rc[j])
+				continue;
+			if (j == I40E_AQ_RC_TIMEOUT)
+				dev_info(&pf->pdev->dev,
+					 "    timeout/other: %u\n", op.rc[j]);
+			else
+				dev_info(&pf->pdev->dev,
+					 "    %s: %u\n",
+					 i40e_aq_str(&pf->hw, j), op.rc[j]);
+		}
+		for (j = 0; j < I40E_AQ_LAT_BUCKETS; j++) {
+			if (!op.lat_hist[j])
+				continue;
+			if (j == I40E_AQ_LAT_BUCKETS - 1)
+				dev_info(&pf->pdev->dev,
+					 "    >= %u us: %u\n",
+					 1U << (j - 1), op.lat_hist[j]);
+			else
+				dev_info(&pf->pdev->dev,
+					 "    < %u us: %u\n",
+					 1U << j, op.lat_hist[j]);
+		}
+	}
+}
+
+/**
+ * i40e_dbg_dump_rebuild_stats - dump the phase timing of the PF rebuilds
+ * @pf: the i40e_pf created in command write
+ */
+static void i40e_dbg_dump_rebuild_stats(struct i40e_pf *pf)
+{
+	struct i40e_rebuild_timing *timing = &pf->rebuild_timing;
+	int i;
+
+	dev_info(&pf->pdev->dev,
+		 "rebuild stats: count %u, last after %s reset, total %llu us max %llu us\n",
+		 timing->count, timing->port_reset ? "port" : "pf",
+		 timing->total_us, timing->total_max_us);
+	for (i = 0; i < I40E_REBUILD_NUM_PHASES; i++)
+		dev_info(&pf->pdev->dev, "    %s: %llu us max %llu us\n",
+			 i40e_rebuild_phase_str[i], timing->phase_us[i],
+			 timing->phase_max_us[i]);
+}
+
+/**
+ * i40e_dbg_dump_napi_hist_line - dump one NAPI histogram on a single line
+ * @pf: the i40e_pf created in command write
+ * @name: name of the histogram
+ * @hist: the I40E_NAPI_HIST_BUCKETS counters
+ */
+static void i40e_dbg_dump_napi_hist_line(struct i40e_pf *pf, const char *name,
+					 const u32 *hist)
+{
+	char buf[I40E_NAPI_HIST_BUCKETS * 11 + 1];
+	int i, len = 0;
+
+	for (i = 0; i < I40E_NAPI_HIST_BUCKETS; i++)
+		len += scnprintf(buf + len, sizeof(buf) - len, " %u", hist[i]);
+	dev_info(&pf->pdev->dev, "    %s:%s\n", name, buf);
+}
+
+/**
+ * i40e_dbg_dump_napi_stats - dump the NAPI histograms of a VSI's vectors
+ * @pf: the i40e_pf created in command write
+ * @vsi: the VSI whose vectors to dump
+ */
+static void i40e_dbg_dump_napi_stats(struct i40e_pf *pf, struct i40e_vsi *vsi)
+{
+	struct i40e_napi_hist hist;
+	int v;
+
+	dev_info(&pf->pdev->dev,
+		 "napi stats: vsi seid %d, collection %s\n", vsi->seid,
+		 test_bit(__I40E_NAPI_HIST, pf->state) ? "on" : "off");
+	dev_info(&pf->pdev->dev,
+		 "    log2 buckets: 0, < 2, < 4, ... < %u, >= %u\n",
+		 1U << (I40E_NAPI_HIST_BUCKETS - 2),
+		 1U << (I40E_NAPI_HIST_BUCKETS - 2));
+	if (!vsi->q_vectors)
+		return;
+
+	for (v = 0; v < vsi->num_q_vectors; v++) {
+		if (!vsi->q_vectors[v])
+			continue;
+
+		hist = vsi->q_vectors[v]->napi_hist;
+		dev_info(&pf->pdev->dev,
+			 "  q_vector %d (%s): budget exhausted %llu\n",
+			 v, vsi->q_vectors[v]->name, hist.budget_exhausted);
+		i40e_dbg_dump_napi_hist_line(pf, "rx pkts/poll", hist.work);
+		i40e_dbg_dump_napi_hist_line(pf, "polls/irq", hist.polls);
+		i40e_dbg_dump_napi_hist_line(pf, "irq to poll us",
+					     hist.irq_lat);
+		i40e_dbg_dump_napi_hist_line(pf, "poll us", hist.poll_time);
+	}
+}
+
 /**
  * i40e_dbg_dump_all_vsi_filters - dump mac/vlan filters for all VSI on a PF
  * @pf: the i40e_pf created in command write
@@ -1335,6 +1470,22 @@ static ssize_t i40e_dbg_command_write(struct file *filp,
 			dev_info(&pf->pdev->dev,
 				 "pf tx sluggish count: %d\n",
 				 pf->tx_sluggish_count);
+		} else if (strncmp(&cmd_buf[5], "aq stats", 8) == 0) {
+			i40e_dbg_dump_aq_stats(pf);
+		} else if (strncmp(&cmd_buf[5], "rebuild stats", 13) == 0) {
+			i40e_dbg_dump_rebuild_stats(pf);
+		} else if (strncmp(&cmd_buf[5], "napi stats", 10) == 0) {
+			cnt = sscanf(&cmd_buf[15], "%i", &vsi_seid);
+			if (cnt != 1)
+				vsi = pf->vsi[pf->lan_vsi];
+			else
+				vsi = i40e_dbg_find_vsi(pf, vsi_seid);
+			if (!vsi) {
+				dev_info(&pf->pdev->dev,
+					 "dump napi stats: vsi not found\n");
+				goto command_write_done;
+			}
+			i40e_dbg_dump_napi_stats(pf, vsi);
 		} else if (strncmp(&cmd_buf[5], "port", 4) == 0) {
 			struct i40e_aqc_query_port_ets_config_resp *bw_data;
 			struct i40e_dcbx_config *cfg =
@@ -1467,6 +1618,9 @@ static ssize_t i40e_dbg_command_write(struct file *filp,
 			dev_info(&pf->pdev->dev, "dump capabilities\n");
 			dev_info(&pf->pdev->dev, "dump resources\n");
 			dev_info(&pf->pdev->dev, "dump reset stats\n");
+			dev_info(&pf->pdev->dev, "dump aq stats\n");
+			dev_info(&pf->pdev->dev, "dump rebuild stats\n");
+			dev_info(&pf->pdev->dev, "dump napi stats [seid]\n");
 			dev_info(&pf->pdev->dev, "dump port\n");
 			dev_info(&pf->pdev->dev, "dump VF [vf_id]\n");
 			dev_info(&pf->pdev->dev,
@@ -1492,6 +1646,12 @@ static ssize_t i40e_dbg_command_write(struct file *filp,
 			dev_info(&pf->pdev->dev, "msg_enable = 0x%08x\n",
 				 pf->msg_enable);
 		}
+	} else if (strncmp(cmd_buf, "napi stats on", 13) == 0) {
+		i40e_napi_hist_set(pf, true);
+		dev_info(&pf->pdev->dev, "napi stats collection on\n");
+	} else if (strncmp(cmd_buf, "napi stats off", 14) == 0) {
+		i40e_napi_hist_set(pf, false);
+		dev_info(&pf->pdev->dev, "napi stats collection off\n");
 	} else if (strncmp(cmd_buf, "defport on", 10) == 0) {
 		dev_info(&pf->pdev->dev, "debugfs: forcing PFR with defport enabled\n");
 		pf->cur_promisc = true;
@@ -1531,8 +1691,17 @@ static ssize_t i40e_dbg_command_write(struct file *filp,
 			} else {
 				dev_info(&pf->pdev->dev, "clear port stats not allowed on this port partition\n");
 			}
+		} else if (strncmp(&cmd_buf[12], "aq", 2) == 0) {
+			spin_lock_bh(&pf->aq_stats.lock);
+			memset(pf->aq_stats.op, 0, sizeof(pf->aq_stats.op));
+			pf->aq_stats.untracked = 0;
+			spin_unlock_bh(&pf->aq_stats.lock);
+			dev_info(&pf->pdev->dev, "aq stats cleared\n");
+		} else if (strncmp(&cmd_buf[12], "napi", 4) == 0) {
+			i40e_napi_hist_clear(pf);
+			dev_info(&pf->pdev->dev, "napi stats cleared\n");
 		} else {
-			dev_info(&pf->pdev->dev, "clear_stats vsi [seid] or clear_stats port\n");
+			dev_info(&pf->pdev->dev, "clear_stats vsi [seid], clear_stats port, clear_stats aq or clear_stats napi\n");
 		}
 	} else if (strncmp(cmd_buf, "send aq_cmd", 11) == 0) {
 		struct i40e_aq_desc *desc;
@@ -1708,6 +1877,7 @@ static ssize_t i40e_dbg_command_write(struct file *filp,
 			goto command_write_done;
 		}
 		pf->flags &= ~I40E_FLAG_DCB_ENABLED;
+		i40e_tx_keys_update(pf, true);
 	} else if (strncmp(cmd_buf, "dcb on", 6) == 0) {
 		if (i40e_is_tc_mqprio_enabled(pf)) {
 			dev_info(&pf->pdev->dev,
@@ -1715,6 +1885,7 @@ static ssize_t i40e_dbg_command_write(struct file *filp,
 			goto command_write_done;
 		}
 		pf->flags |= I40E_FLAG_DCB_ENABLED;
+		i40e_tx_keys_update(pf, true);
 	} else if (strncmp(cmd_buf, "lldp", 4) == 0) {
 		if (strncmp(&cmd_buf[5], "stop", 4) == 0) {
 			int ret;
@@ -2185,12 +2356,19 @@ static ssize_t i40e_dbg_command_write(struct file *filp,
 		dev_info(&pf->pdev->dev, "  dump desc rx <vsi_seid> <ring_id> [<desc_n>]\n");
 		dev_info(&pf->pdev->dev, "  dump desc aq\n");
 		dev_info(&pf->pdev->dev, "  dump reset stats\n");
+		dev_info(&pf->pdev->dev, "  dump aq stats\n");
+		dev_info(&pf->pdev->dev, "  dump rebuild stats\n");
+		dev_info(&pf->pdev->dev, "  dump napi stats [seid]\n");
 		dev_info(&pf->pdev->dev, "  dump debug fwdata <cluster_id> <table_id> <index>\n");
 		dev_info(&pf->pdev->dev, "  msg_enable [level]\n");
 		dev_info(&pf->pdev->dev, "  read <reg>\n");
 		dev_info(&pf->pdev->dev, "  write <reg> <value>\n");
 		dev_info(&pf->pdev->dev, "  clear_stats vsi [seid]\n");
 		dev_info(&pf->pdev->dev, "  clear_stats port\n");
+		dev_info(&pf->pdev->dev, "  clear_stats aq\n");
+		dev_info(&pf->pdev->dev, "  clear_stats napi\n");
+		dev_info(&pf->pdev->dev, "  napi stats on\n");
+		dev_info(&pf->pdev->dev, "  napi stats off\n");
 		dev_info(&pf->pdev->dev, "  defport on\n");
 		dev_info(&pf->pdev->dev, "  defport off\n");
 		dev_info(&pf->pdev->dev, "  send aq_cmd <flags> <opcode> <datalen> <retval> <cookie_h> <cookie_l> <param0> <param1> <param2> <param3>\n");
@@ -2462,6 +2640,7 @@ void i40e_dbg_pf_exit(struct i40e_pf *pf)
 {
 	debugfs_remove_recursive(pf->i40e_dbg_pf);
 	pf->i40e_dbg_pf = NULL;
+	i40e_napi_hist_set(pf, false);
 }
 
 /**
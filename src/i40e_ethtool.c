@@ -3,6 +3,7 @@
 
 /* ethtool support for i40e */
 
+#include <linux/sort.h>
 #include "i40e.h"
 #include "i40e_diag.h"
 #include "i40e_txrx_common.h"
@@ -148,6 +149,8 @@ static const struct i40e_stats i40e_gstrings_stats[] = {
 	I40E_PF_STAT("port.tx_hwtstamp_skipped", tx_hwtstamp_skipped),
 #endif /* HAVE_PTP_1588_CLOCK */
 	I40E_PF_STAT("port.fdir_flush_cnt", fd_flush_cnt),
+	I40E_PF_STAT("port.fdir_sb_bulk_queued", fd_sb_bulk_queued),
+	I40E_PF_STAT("port.fdir_sb_bulk_done", fd_sb_bulk_done),
 	I40E_PF_STAT("port.fdir_atr_match", stats.fd_atr_match),
 	I40E_PF_STAT("port.fdir_atr_tunnel_match", stats.fd_atr_tunnel_match),
 	I40E_PF_STAT("port.fdir_atr_status", stats.fd_atr_status),
@@ -2426,6 +2429,72 @@ static bool i40e_active_tx_ring_index(struct i40e_vsi *vsi, u16 index)
 	return index < vsi->num_queue_pairs;
 }
 
+/**
+ * i40e_swap_ring_stats - carry the statistics over to a resized ring
+ * @ring: the ring in use
+ * @new_ring: the resized clone of @ring
+ * @rx: the rings are Rx rings
+ *
+ * The resized rings are cloned from the running ones some time before they
+ * are swapped in, so the statistics gathered since then are taken along.
+ **/
+static void i40e_swap_ring_stats(struct i40e_ring *ring,
+				 struct i40e_ring *new_ring, bool rx)
+{
+	new_ring->stats = ring->stats;
+	if (rx)
+		new_ring->rx_stats = ring->rx_stats;
+	else
+		new_ring->tx_stats = ring->tx_stats;
+#ifdef HAVE_XDP_SUPPORT
+	new_ring->xdp_stats = ring->xdp_stats;
+#endif
+}
+
+/**
+ * i40e_swap_queue_pair_rings - put the resized rings of a queue pair in place
+ * @vsi: the VSI being configured
+ * @qp: the queue pair, not running
+ * @tx_rings: resized Tx and XDP Tx rings, NULL if the Tx size is unchanged
+ * @rx_rings: resized Rx rings, NULL if the Rx size is unchanged
+ **/
+static void i40e_swap_queue_pair_rings(struct i40e_vsi *vsi, int qp,
+				       struct i40e_ring *tx_rings,
+				       struct i40e_ring *rx_rings)
+{
+	int xdp_qp = qp + vsi->alloc_queue_pairs;
+
+	if (tx_rings) {
+		i40e_swap_ring_stats(vsi->tx_rings[qp], &tx_rings[qp], false);
+		i40e_free_tx_resources(vsi->tx_rings[qp]);
+		*vsi->tx_rings[qp] = tx_rings[qp];
+
+		if (i40e_enabled_xdp_vsi(vsi)) {
+			i40e_swap_ring_stats(vsi->tx_rings[xdp_qp],
+					     &tx_rings[xdp_qp], false);
+			i40e_free_tx_resources(vsi->tx_rings[xdp_qp]);
+			*vsi->tx_rings[xdp_qp] = tx_rings[xdp_qp];
+		}
+	}
+
+	if (rx_rings) {
+		i40e_swap_ring_stats(vsi->rx_rings[qp], &rx_rings[qp], true);
+		i40e_free_rx_resources(vsi->rx_rings[qp]);
+		/* get the real tail offset */
+		rx_rings[qp].tail = vsi->rx_rings[qp]->tail;
+		/* this is to fake out the allocation routine
+		 * into thinking it has to realloc everything
+		 * but the recycling logic will let us re-use
+		 * the buffers allocated above
+		 */
+		rx_rings[qp].next_to_use = 0;
+		rx_rings[qp].next_to_clean = 0;
+		rx_rings[qp].next_to_alloc = 0;
+		/* do a struct copy */
+		*vsi->rx_rings[qp] = rx_rings[qp];
+	}
+}
+
 #ifdef HAVE_ETHTOOL_EXTENDED_RINGPARAMS
 static int
 i40e_set_ringparam(struct net_device *netdev,
@@ -2444,6 +2513,7 @@ static int i40e_set_ringparam(struct net_device *netdev,
 	struct i40e_pf *pf = vsi->back;
 	u32 new_rx_count, new_tx_count;
 	u16 tx_alloc_queue_pairs;
+	bool hitless = false;
 	int timeout = 50;
 	int i, err = 0;
 
@@ -2600,45 +2670,41 @@ rx_unwind:
 		}
 	}
 
-	/* Bring interface down, copy in the new ring info,
-	 * then restore the interface
+#ifdef HAVE_XDP_SUPPORT
+	/* With MSI-X the queue pairs can be restarted one at a time with the
+	 * new rings while the others keep passing traffic. Should restarting
+	 * a queue pair fail, the rest of the rings are swapped in with the
+	 * whole interface down.
 	 */
-	i40e_down(vsi);
+	hitless = !!(pf->flags & I40E_FLAG_MSIX_ENABLED);
+#endif
+	if (!hitless)
+		i40e_down(vsi);
 
-	if (tx_rings) {
-		for (i = 0; i < tx_alloc_queue_pairs; i++) {
-			if (i40e_active_tx_ring_index(vsi, i)) {
-				i40e_free_tx_resources(vsi->tx_rings[i]);
-				*vsi->tx_rings[i] = tx_rings[i];
-			}
+	for (i = 0; i < vsi->num_queue_pairs; i++) {
+#ifdef HAVE_XDP_SUPPORT
+		if (hitless && i40e_queue_pair_stop(vsi, i)) {
+			hitless = false;
+			i40e_down(vsi);
 		}
-		kfree(tx_rings);
-		tx_rings = NULL;
-	}
-
-	if (rx_rings) {
-		for (i = 0; i < vsi->num_queue_pairs; i++) {
-			i40e_free_rx_resources(vsi->rx_rings[i]);
-			/* get the real tail offset */
-			rx_rings[i].tail = vsi->rx_rings[i]->tail;
-			/* this is to fake out the allocation routine
-			 * into thinking it has to realloc everything
-			 * but the recycling logic will let us re-use
-			 * the buffers allocated above
-			 */
-			rx_rings[i].next_to_use = 0;
-			rx_rings[i].next_to_clean = 0;
-			rx_rings[i].next_to_alloc = 0;
-			/* do a struct copy */
-			*vsi->rx_rings[i] = rx_rings[i];
+#endif
+		i40e_swap_queue_pair_rings(vsi, i, tx_rings, rx_rings);
+#ifdef HAVE_XDP_SUPPORT
+		if (hitless && i40e_queue_pair_start(vsi, i)) {
+			hitless = false;
+			i40e_down(vsi);
 		}
-		kfree(rx_rings);
-		rx_rings = NULL;
+#endif
 	}
+	kfree(tx_rings);
+	tx_rings = NULL;
+	kfree(rx_rings);
+	rx_rings = NULL;
 
 	vsi->num_tx_desc = new_tx_count;
 	vsi->num_rx_desc = new_rx_count;
-	i40e_up(vsi);
+	if (!hitless)
+		i40e_up(vsi);
 
 free_tx:
 	/* error cleanup if the Rx allocations failed after getting Tx */
@@ -2816,7 +2882,9 @@ static void i40e_get_ethtool_stats(struct net_device *netdev,
 	bool veb_stats;
 	u64 *p = data;
 
-	i40e_update_stats(vsi);
+	i40e_update_stats_groups(vsi, I40E_STATS_PF_GROUPS |
+				 BIT(I40E_STATS_VSI) | BIT(I40E_STATS_VEB),
+				 I40E_STATS_READ_MAX_AGE);
 
 	i40e_add_ethtool_stats(&data, i40e_get_vsi_stats_struct(vsi),
 			       i40e_gstrings_net_stats);
@@ -2840,10 +2908,8 @@ static void i40e_get_ethtool_stats(struct net_device *netdev,
 		     (pf->lan_veb < I40E_MAX_VEB) &&
 		     (pf->flags & I40E_FLAG_VEB_STATS_ENABLED));
 
-	if (veb_stats) {
+	if (veb_stats)
 		veb = pf->veb[pf->lan_veb];
-		i40e_update_veb_stats(veb);
-	}
 
 	/* If veb stats aren't enabled, pass NULL instead of the veb so that
 	 * we initialize stats to zero and update the data pointer
@@ -2921,7 +2987,7 @@ check_vf:
 			i40e_add_ethtool_stats(&data, NULL,
 					       i40e_gstrings_eth_stats_extra);
 		} else {
-			i40e_update_eth_stats(vsi);
+			i40e_vf_get_eth_stats(&pf->vf[vf_idx], NULL);
 			i40e_add_ethtool_stats(&data, vsi,
 					       i40e_gstrings_eth_stats_extra);
 		}
@@ -2936,6 +3002,147 @@ check_data_pointer:
 		  "ethtool stats count mismatch!");
 }
 
+#if defined(HAVE_ETHTOOL_PAUSE_STATS) || defined(HAVE_ETHTOOL_ETH_MAC_STATS) || \
+	defined(HAVE_ETHTOOL_RMON_STATS)
+/**
+ * i40e_std_stats_pf - Get the PF whose port stats a netdev may report
+ * @netdev: network interface device structure
+ *
+ * Only the main VSI of the first partition reports the port counters, as
+ * in i40e_get_ethtool_stats(). Returns NULL for every other netdev.
+ **/
+static struct i40e_pf *i40e_std_stats_pf(struct net_device *netdev)
+{
+	struct i40e_netdev_priv *np = netdev_priv(netdev);
+	struct i40e_vsi *vsi = np->vsi;
+	struct i40e_pf *pf = vsi->back;
+
+	if (vsi != pf->vsi[pf->lan_vsi] || pf->hw.partition_id != 1)
+		return NULL;
+
+	return pf;
+}
+
+#endif /* HAVE_ETHTOOL_{PAUSE,ETH_MAC,RMON}_STATS */
+#ifdef HAVE_ETHTOOL_PAUSE_STATS
+/**
+ * i40e_get_pause_stats - Get the standard link flow control counters
+ * @netdev: network interface device structure
+ * @pause_stats: buffer to return the counters in
+ **/
+static void i40e_get_pause_stats(struct net_device *netdev,
+				 struct ethtool_pause_stats *pause_stats)
+{
+	struct i40e_pf *pf = i40e_std_stats_pf(netdev);
+
+	if (!pf)
+		return;
+
+	i40e_update_stats_groups(pf->vsi[pf->lan_vsi], BIT(I40E_STATS_FC),
+				 I40E_STATS_READ_MAX_AGE);
+	pause_stats->tx_pause_frames = pf->stats.link_xon_tx +
+				       pf->stats.link_xoff_tx;
+	pause_stats->rx_pause_frames = pf->stats.link_xon_rx +
+				       pf->stats.link_xoff_rx;
+}
+
+#endif /* HAVE_ETHTOOL_PAUSE_STATS */
+#ifdef HAVE_ETHTOOL_ETH_MAC_STATS
+/**
+ * i40e_get_eth_mac_stats - Get the standard IEEE 802.3 MAC counters
+ * @netdev: network interface device structure
+ * @mac_stats: buffer to return the counters in
+ **/
+static void i40e_get_eth_mac_stats(struct net_device *netdev,
+				   struct ethtool_eth_mac_stats *mac_stats)
+{
+	struct i40e_pf *pf = i40e_std_stats_pf(netdev);
+	struct i40e_hw_port_stats *stats;
+
+	if (!pf)
+		return;
+
+	i40e_update_stats_groups(pf->vsi[pf->lan_vsi], BIT(I40E_STATS_PORT),
+				 I40E_STATS_READ_MAX_AGE);
+	stats = &pf->stats;
+
+	mac_stats->FramesTransmittedOK = stats->eth.tx_unicast +
+					 stats->eth.tx_multicast +
+					 stats->eth.tx_broadcast;
+	mac_stats->FramesReceivedOK = stats->eth.rx_unicast +
+				      stats->eth.rx_multicast +
+				      stats->eth.rx_broadcast;
+	mac_stats->FrameCheckSequenceErrors = stats->crc_errors;
+	mac_stats->OctetsTransmittedOK = stats->eth.tx_bytes;
+	mac_stats->OctetsReceivedOK = stats->eth.rx_bytes;
+	mac_stats->MulticastFramesXmittedOK = stats->eth.tx_multicast;
+	mac_stats->BroadcastFramesXmittedOK = stats->eth.tx_broadcast;
+	mac_stats->MulticastFramesReceivedOK = stats->eth.rx_multicast;
+	mac_stats->BroadcastFramesReceivedOK = stats->eth.rx_broadcast;
+	mac_stats->InRangeLengthErrors = stats->rx_length_errors;
+	mac_stats->FrameTooLongErrors = stats->rx_oversize;
+}
+
+#endif /* HAVE_ETHTOOL_ETH_MAC_STATS */
+#ifdef HAVE_ETHTOOL_RMON_STATS
+/* in the order of the PRC and PTC size histogram registers */
+static const struct ethtool_rmon_hist_range i40e_rmon_ranges[] = {
+	{    0,    64 },
+	{   65,   127 },
+	{  128,   255 },
+	{  256,   511 },
+	{  512,  1023 },
+	{ 1024,  1522 },
+	{ 1523,  9522 },
+	{}
+};
+
+/**
+ * i40e_get_rmon_stats - Get the standard RMON counters
+ * @netdev: network interface device structure
+ * @rmon_stats: buffer to return the counters in
+ * @ranges: returns the packet size ranges of the histograms
+ **/
+static void i40e_get_rmon_stats(struct net_device *netdev,
+				struct ethtool_rmon_stats *rmon_stats,
+				const struct ethtool_rmon_hist_range **ranges)
+{
+	struct i40e_pf *pf = i40e_std_stats_pf(netdev);
+	struct i40e_hw_port_stats *stats;
+
+	if (!pf)
+		return;
+
+	i40e_update_stats_groups(pf->vsi[pf->lan_vsi], BIT(I40E_STATS_PORT) |
+				 BIT(I40E_STATS_SIZE), I40E_STATS_READ_MAX_AGE);
+	stats = &pf->stats;
+
+	rmon_stats->undersize_pkts = stats->rx_undersize;
+	rmon_stats->oversize_pkts = stats->rx_oversize;
+	rmon_stats->fragments = stats->rx_fragments;
+	rmon_stats->jabbers = stats->rx_jabber;
+
+	rmon_stats->hist[0] = stats->rx_size_64;
+	rmon_stats->hist[1] = stats->rx_size_127;
+	rmon_stats->hist[2] = stats->rx_size_255;
+	rmon_stats->hist[3] = stats->rx_size_511;
+	rmon_stats->hist[4] = stats->rx_size_1023;
+	rmon_stats->hist[5] = stats->rx_size_1522;
+	rmon_stats->hist[6] = stats->rx_size_big;
+
+	rmon_stats->hist_tx[0] = stats->tx_size_64;
+	rmon_stats->hist_tx[1] = stats->tx_size_127;
+	rmon_stats->hist_tx[2] = stats->tx_size_255;
+	rmon_stats->hist_tx[3] = stats->tx_size_511;
+	rmon_stats->hist_tx[4] = stats->tx_size_1023;
+	rmon_stats->hist_tx[5] = stats->tx_size_1522;
+	rmon_stats->hist_tx[6] = stats->tx_size_big;
+
+	*ranges = i40e_rmon_ranges;
+}
+
+#endif /* HAVE_ETHTOOL_RMON_STATS */
+
 #ifndef I40E_PF_EXTRA_STATS_OFF
 /**
  * i40e_update_vfid_in_stats - print VF num to stats names
@@ -4095,6 +4302,18 @@ static void i40e_fill_rx_flow_user_data(struct ethtool_rx_flow_spec *fsp,
 	*((__force __be64 *)fsp->m_ext.data) = cpu_to_be64(mask);
 }
 
+/**
+ * i40e_cmp_rule_loc - compare two rule locations for sort()
+ * @a: first location
+ * @b: second location
+ **/
+static int i40e_cmp_rule_loc(const void *a, const void *b)
+{
+	u32 loc_a = *(const u32 *)a, loc_b = *(const u32 *)b;
+
+	return (loc_a > loc_b) - (loc_a < loc_b);
+}
+
 /**
  * i40e_get_rx_filter_ids - Populates the rule count of a command
  * @pf: Pointer to the physical function struct
@@ -4137,6 +4356,8 @@ static int i40e_get_rx_filter_ids(struct i40e_pf *pf,
 		cnt++;
 	}
 
+	/* the filter lists are not kept in location order */
+	sort(rule_locs, cnt, sizeof(*rule_locs), i40e_cmp_rule_loc, NULL);
 	cmd->rule_cnt = cnt;
 
 	return 0;
@@ -4158,18 +4379,12 @@ static int i40e_get_ethtool_fdir_entry(struct i40e_pf *pf,
 	struct ethtool_rx_flow_spec *fsp =
 			(struct ethtool_rx_flow_spec *)&cmd->fs;
 	struct i40e_rx_flow_userdef userdef = {0};
-	struct i40e_fdir_filter *rule = NULL;
-	struct hlist_node *node2;
+	struct i40e_fdir_filter *rule;
 	u64 input_set;
 	u16 index;
 
-	hlist_for_each_entry_safe(rule, node2,
-				  &pf->fdir_filter_list, fdir_node) {
-		if (fsp->location <= rule->fd_id)
-			break;
-	}
-
-	if (!rule || fsp->location != rule->fd_id)
+	rule = i40e_find_fdir_filter_by_loc(pf, fsp->location);
+	if (!rule)
 		return -EINVAL;
 
 	fsp->flow_type = rule->flow_type;
@@ -4339,21 +4554,10 @@ static int i40e_get_cloud_filter_entry(struct i40e_pf *pf,
 	struct ethtool_rx_flow_spec *fsp =
 			(struct ethtool_rx_flow_spec *)&cmd->fs;
 	static const u8 mac_broadcast[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-	struct i40e_cloud_filter *rule, *filter = NULL;
 	struct i40e_rx_flow_userdef userdef = {0};
-	struct hlist_node *node2;
-
-	hlist_for_each_entry_safe(rule, node2,
-				  &pf->cloud_filter_list, cloud_node) {
-		/* filter found */
-		if (rule->id == fsp->location)
-			filter = rule;
+	struct i40e_cloud_filter *filter;
 
-		/* bail out if we've passed the likely location in the list */
-		if (rule->id >= fsp->location)
-			break;
-
-	}
+	filter = i40e_find_cloud_filter_by_loc(pf, fsp->location);
 	if (!filter) {
 		dev_info(&pf->pdev->dev, "No cloud filter with loc %d\n",
 			fsp->location);
@@ -4898,11 +5102,10 @@ static int i40e_add_cloud_filter_ethtool(struct i40e_vsi *vsi,
 					 struct ethtool_rxnfc *cmd,
 					 struct i40e_rx_flow_userdef *userdef)
 {
-	struct i40e_cloud_filter *rule, *parent, *filter = NULL;
+	struct i40e_cloud_filter *rule, *filter = NULL;
 	struct ethtool_rx_flow_spec *fsp;
 	u16 dest_seid = 0, q_index = 0;
 	struct i40e_pf *pf = vsi->back;
-	struct hlist_node *node2;
 	u32 ring, vf;
 	u8 flags = 0;
 	int ret;
@@ -4961,40 +5164,19 @@ static int i40e_add_cloud_filter_ethtool(struct i40e_vsi *vsi,
 	if (ret)
 		return -EINVAL;
 
-	/* if filter exists with same id, delete the old one */
-	parent = NULL;
-	hlist_for_each_entry_safe(rule, node2,
-				  &pf->cloud_filter_list, cloud_node) {
-		/* filter exists with the id */
-		if (rule->id == fsp->location)
-			filter = rule;
-
-		/* Abort now if we're trying to add an outer IP filter and it
-		 * already exists in the device. We must detect this condition
-		 * here since we can't rely on the firmware return code to tell
-		 * us this later.
-		 */
-		if (userdef->outer_ip && fsp->h_u.usr_ip4_spec.ip4dst ==
-		    rule->dst_ipv4)
-			return -EEXIST;
-
-		/* bail out if we've passed the likely location in the list */
-		if (rule->id >= fsp->location)
-			break;
-
-		/* track where we left off */
-		parent = rule;
-	}
-
-	/* Continue searching for duplicates if we're dealing with outer IP
-	 * filters and haven't reached the end of the list yet.
+	/* Abort now if we're trying to add an outer IP filter and it
+	 * already exists in the device. We must detect this condition
+	 * here since we can't rely on the firmware return code to tell
+	 * us this later.
 	 */
-	if (rule && userdef->outer_ip)
-		hlist_for_each_entry_continue(rule, cloud_node)
+	if (userdef->outer_ip)
+		hlist_for_each_entry(rule, &pf->cloud_filter_list, cloud_node)
 			if (fsp->h_u.usr_ip4_spec.ip4dst == rule->dst_ipv4)
 				return -EEXIST;
 
-	if (filter && (filter->id == fsp->location)) {
+	/* if filter exists with same id, delete the old one */
+	filter = i40e_find_cloud_filter_by_loc(pf, fsp->location);
+	if (filter) {
 		/* found it in the cloud list, so remove it */
 		if (filter->flags & I40E_CLOUD_FIELD_OIP1 ||
 		    filter->flags & I40E_CLOUD_FIELD_OIP2)
@@ -5004,7 +5186,7 @@ static int i40e_add_cloud_filter_ethtool(struct i40e_vsi *vsi,
 			ret = i40e_add_del_cloud_filter_ex(pf, filter, false);
 		if (ret && pf->hw.aq.asq_last_status != I40E_AQ_RC_ENOENT)
 			return ret;
-		hlist_del(&filter->cloud_node);
+		i40e_cloud_filter_unlink(pf, filter);
 		kfree(filter);
 		pf->num_cloud_filters--;
 	} else {
@@ -5082,12 +5264,7 @@ static int i40e_add_cloud_filter_ethtool(struct i40e_vsi *vsi,
 		return ret;
 	}
 
-	/* add filter to the ordered list */
-	INIT_HLIST_NODE(&filter->cloud_node);
-	if (parent)
-		hlist_add_behind(&filter->cloud_node, &parent->cloud_node);
-	else
-		hlist_add_head(&filter->cloud_node, &pf->cloud_filter_list);
+	i40e_cloud_filter_link(pf, filter);
 	pf->num_cloud_filters++;
 
 	return 0;
@@ -5104,22 +5281,12 @@ static int i40e_add_cloud_filter_ethtool(struct i40e_vsi *vsi,
 static int i40e_del_cloud_filter_ethtool(struct i40e_pf *pf,
 					 struct ethtool_rxnfc *cmd)
 {
-	struct i40e_cloud_filter *rule, *filter = NULL;
-	struct ethtool_rx_flow_spec *fsp;
-	struct hlist_node *node2;
 	struct i40e_vsi *vsi = pf->vsi[pf->lan_vsi];
+	struct i40e_cloud_filter *filter;
+	struct ethtool_rx_flow_spec *fsp;
 
 	fsp = (struct ethtool_rx_flow_spec *)&cmd->fs;
-	hlist_for_each_entry_safe(rule, node2,
-				  &pf->cloud_filter_list, cloud_node) {
-		/* filter found */
-		if (rule->id == fsp->location)
-			filter = rule;
-
-		/* bail out if we've passed the likely location in the list */
-		if (rule->id >= fsp->location)
-			break;
-	}
+	filter = i40e_find_cloud_filter_by_loc(pf, fsp->location);
 	if (!filter)
 		return -ENOENT;
 
@@ -5129,7 +5296,7 @@ static int i40e_del_cloud_filter_ethtool(struct i40e_pf *pf,
 		(void)i40e_add_del_custom_cloud_filter(vsi, filter, false);
 	else
 		(void)i40e_add_del_cloud_filter_ex(pf, filter, false);
-	hlist_del(&filter->cloud_node);
+	i40e_cloud_filter_unlink(pf, filter);
 	kfree(filter);
 	pf->num_cloud_filters--;
 
@@ -5150,29 +5317,18 @@ static int i40e_update_ethtool_fdir_entry(struct i40e_vsi *vsi,
 					  struct i40e_fdir_filter *input,
 					  u16 sw_idx)
 {
-	struct i40e_fdir_filter *rule, *parent;
 	struct i40e_pf *pf = vsi->back;
-	struct hlist_node *node2;
+	struct i40e_fdir_filter *rule;
 	int err = -ENOENT;
 
-	parent = NULL;
-	rule = NULL;
-
-	hlist_for_each_entry_safe(rule, node2,
-				  &pf->fdir_filter_list, fdir_node) {
-		/* rule id found, or passed its spot in the list */
-		if (rule->fd_id >= sw_idx)
-			break;
-		parent = rule;
-	}
-
 	/* is there is an old rule occupying our target filter slot? */
-	if (rule && (rule->fd_id == sw_idx)) {
+	rule = i40e_find_fdir_filter_by_loc(pf, sw_idx);
+	if (rule) {
 		/* Remove this rule, since we're either deleting it, or
 		 * replacing it.
 		 */
 		err = i40e_add_del_fdir(vsi, rule, false);
-		hlist_del(&rule->fdir_node);
+		i40e_fdir_filter_unlink(pf, rule);
 		pf->fdir_pf_active_filters--;
 
 		kfree(rule);
@@ -5185,13 +5341,7 @@ static int i40e_update_ethtool_fdir_entry(struct i40e_vsi *vsi,
 		return err;
 
 	/* Otherwise, install the new rule as requested */
-	INIT_HLIST_NODE(&input->fdir_node);
-
-	/* add filter to the ordered list */
-	if (parent)
-		hlist_add_behind(&input->fdir_node, &parent->fdir_node);
-	else
-		hlist_add_head(&input->fdir_node, &pf->fdir_filter_list);
+	i40e_fdir_filter_link(pf, input);
 
 	/* update counts */
 	pf->fdir_pf_active_filters++;
@@ -6174,11 +6324,10 @@ static int i40e_disallow_matching_filters(struct i40e_vsi *vsi,
 {
 	struct i40e_pf *pf = vsi->back;
 	struct i40e_fdir_filter *rule;
-	struct hlist_node *node2;
 
-	/* Loop through every filter, and check that it doesn't match */
-	hlist_for_each_entry_safe(rule, node2,
-				  &pf->fdir_filter_list, fdir_node) {
+	/* Only filters with the same match key can possibly match */
+	hash_for_each_possible(pf->fdir_key_hash, rule, fdir_key_node,
+			       i40e_fdir_match_key(input)) {
 		/* Don't check the filters match if they share the same fd_id,
 		 * since the new filter is actually just updating the target
 		 * of the old filter.
@@ -6214,6 +6363,7 @@ static int i40e_add_fdir_ethtool(struct i40e_vsi *vsi,
 	struct i40e_rx_flow_userdef userdef;
 	struct ethtool_rx_flow_spec *fsp;
 	struct i40e_fdir_filter *input;
+	struct i40e_fdir_bulk bulk;
 	u16 dest_vsi = 0, q_index = 0;
 	struct i40e_pf *pf;
 	int ret = -EINVAL;
@@ -6355,7 +6505,17 @@ static int i40e_add_fdir_ethtool(struct i40e_vsi *vsi,
 	i40e_update_ethtool_fdir_entry(vsi, input, fsp->location);
 
 	(void)i40e_del_cloud_filter_ethtool(pf, cmd);
-	ret = i40e_add_del_fdir(vsi, input, true);
+
+	/* Use the pre-mapped arena when it is available so a burst of rules
+	 * does not wait on the FDIR ring once per rule.
+	 */
+	ret = -EAGAIN;
+	if (!i40e_fdir_bulk_begin(pf, &bulk)) {
+		ret = i40e_fdir_bulk_add(&bulk, input, true);
+		i40e_fdir_bulk_commit(&bulk);
+	}
+	if (ret == -EAGAIN)
+		ret = i40e_add_del_fdir(vsi, input, true);
 
 	if (ret)
 		goto remove_sw_rule;
@@ -6363,7 +6523,7 @@ static int i40e_add_fdir_ethtool(struct i40e_vsi *vsi,
 	return 0;
 
 remove_sw_rule:
-	hlist_del(&input->fdir_node);
+	i40e_fdir_filter_unlink(pf, input);
 	pf->fdir_pf_active_filters--;
 free_filter_memory:
 	kfree(input);
@@ -7157,6 +7317,8 @@ static int i40e_get_eee(struct net_device *netdev, struct ethtool_eee *edata)
 
 	edata->advertised = phy_cfg.eee_capability ? SUPPORTED_Autoneg : 0U;
 	edata->eee_enabled = !!edata->advertised;
+	i40e_update_stats_groups(pf->vsi[pf->lan_vsi], BIT(I40E_STATS_LPI),
+				 I40E_STATS_READ_MAX_AGE);
 	edata->tx_lpi_enabled = pf->stats.tx_lpi_status;
 
 	edata->eee_active = pf->stats.tx_lpi_status && pf->stats.rx_lpi_status;
@@ -7205,6 +7367,9 @@ static int i40e_set_eee(struct net_device *netdev, struct ethtool_eee *edata)
 	struct i40e_hw *hw = &pf->hw;
 	__le16 eee_capability;
 
+	/* the tx-lpi check below compares against the current LPI status */
+	i40e_update_stats_groups(pf->vsi[pf->lan_vsi], BIT(I40E_STATS_LPI), 0);
+
 	/* Deny parameters we don't support */
 	if (i40e_is_eee_param_supported(netdev, edata))
 		return -EOPNOTSUPP;
@@ -7334,6 +7499,15 @@ static const struct ethtool_ops i40e_ethtool_ops = {
 	.set_priv_flags		= i40e_set_priv_flags,
 #endif /* HAVE_ETHTOOL_GET_SSET_COUNT */
 	.get_ethtool_stats	= i40e_get_ethtool_stats,
+#ifdef HAVE_ETHTOOL_PAUSE_STATS
+	.get_pause_stats	= i40e_get_pause_stats,
+#endif /* HAVE_ETHTOOL_PAUSE_STATS */
+#ifdef HAVE_ETHTOOL_ETH_MAC_STATS
+	.get_eth_mac_stats	= i40e_get_eth_mac_stats,
+#endif /* HAVE_ETHTOOL_ETH_MAC_STATS */
+#ifdef HAVE_ETHTOOL_RMON_STATS
+	.get_rmon_stats		= i40e_get_rmon_stats,
+#endif /* HAVE_ETHTOOL_RMON_STATS */
 #ifdef HAVE_ETHTOOL_GET_PERM_ADDR
 	.get_perm_addr		= ethtool_op_get_perm_addr,
 #endif
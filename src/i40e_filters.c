@@ -28,7 +28,7 @@ void __i40e_del_filter(struct i40e_vsi *vsi, struct i40e_mac_filter *f)
 	 * admin queue command will unnecessarily fire.
 	 */
 	if (f->state == I40E_FILTER_FAILED || f->state == I40E_FILTER_NEW) {
-		hash_del(&f->hlist);
+		i40e_mac_filter_unlink(vsi, f);
 		kfree(f);
 	} else {
 		f->state = I40E_FILTER_REMOVE;
@@ -38,3 +38,223 @@ void __i40e_del_filter(struct i40e_vsi *vsi, struct i40e_mac_filter *f)
 	set_bit(__I40E_MACVLAN_SYNC_PENDING, vsi->back->state);
 }
 
+
+/**
+ * i40e_is_vlan_filter - Check whether a filter counts as a VLAN filter
+ * @f: the filter to check
+ **/
+static bool i40e_is_vlan_filter(struct i40e_mac_filter *f)
+{
+	return f->vlan >= 0 && f->vlan <= I40E_MAX_VLANID;
+}
+
+/**
+ * i40e_mac_vlan_bucket - Find the index bucket for a MAC/VLAN pair
+ * @vsi: the VSI owning the index
+ * @macaddr: the MAC address
+ * @vlan: the VLAN id
+ **/
+static struct hlist_head *i40e_mac_vlan_bucket(struct i40e_vsi *vsi,
+					       const u8 *macaddr, s16 vlan)
+{
+	u32 mask = BIT(vsi->mac_vlan_hash_bits) - 1;
+
+	return &vsi->mac_vlan_hash[i40e_mac_vlan_hkey(macaddr, vlan) & mask];
+}
+
+/**
+ * i40e_mac_vlan_hash_alloc - Allocate the MAC/VLAN filter index of a VSI
+ * @vsi: the VSI being set up
+ *
+ * Returns 0 on success, -ENOMEM otherwise.
+ **/
+int i40e_mac_vlan_hash_alloc(struct i40e_vsi *vsi)
+{
+	vsi->mac_vlan_hash = kcalloc(BIT(I40E_MAC_VLAN_HASH_MIN_BITS),
+				     sizeof(*vsi->mac_vlan_hash), GFP_KERNEL);
+	if (!vsi->mac_vlan_hash)
+		return -ENOMEM;
+
+	vsi->mac_vlan_hash_bits = I40E_MAC_VLAN_HASH_MIN_BITS;
+	vsi->mac_vlan_hash_grows = 0;
+	vsi->num_mac_filters = 0;
+	vsi->num_vlan_filters = 0;
+
+	return 0;
+}
+
+/**
+ * i40e_mac_vlan_hash_free - Release the MAC/VLAN filter index of a VSI
+ * @vsi: the VSI being released
+ **/
+void i40e_mac_vlan_hash_free(struct i40e_vsi *vsi)
+{
+	kfree(vsi->mac_vlan_hash);
+	vsi->mac_vlan_hash = NULL;
+}
+
+/**
+ * i40e_mac_vlan_hash_grow - Rehash the MAC/VLAN index into more buckets
+ * @vsi: the VSI owning the index
+ *
+ * Called with the mac_filter_hash_lock held once the average chain length
+ * exceeds two. If the larger table cannot be allocated the old one is kept,
+ * which only costs longer chains.
+ **/
+static void i40e_mac_vlan_hash_grow(struct i40e_vsi *vsi)
+{
+	u8 bits = min_t(u8, vsi->mac_vlan_hash_bits + 2,
+			I40E_MAC_VLAN_HASH_MAX_BITS);
+	struct hlist_head *old = vsi->mac_vlan_hash;
+	u32 old_size = BIT(vsi->mac_vlan_hash_bits);
+	struct i40e_mac_filter *f;
+	struct hlist_node *h;
+	u32 i;
+
+	vsi->mac_vlan_hash = kcalloc(BIT(bits), sizeof(*vsi->mac_vlan_hash),
+				     GFP_ATOMIC);
+	if (!vsi->mac_vlan_hash) {
+		vsi->mac_vlan_hash = old;
+		return;
+	}
+	vsi->mac_vlan_hash_bits = bits;
+
+	for (i = 0; i < old_size; i++) {
+		hlist_for_each_entry_safe(f, h, &old[i], vlan_hlist) {
+			hlist_del(&f->vlan_hlist);
+			hlist_add_head(&f->vlan_hlist,
+				       i40e_mac_vlan_bucket(vsi, f->macaddr,
+							    f->vlan));
+		}
+	}
+
+	kfree(old);
+	vsi->mac_vlan_hash_grows++;
+}
+
+/**
+ * i40e_mac_filter_link - Insert a filter into both VSI filter tables
+ * @vsi: the VSI owning the filter
+ * @f: the filter, not currently in either table
+ *
+ * NOTE: This function is expected to be called with mac_filter_hash_lock
+ * being held.
+ **/
+void i40e_mac_filter_link(struct i40e_vsi *vsi, struct i40e_mac_filter *f)
+{
+	hash_add(vsi->mac_filter_hash, &f->hlist,
+		 i40e_addr_to_hkey(f->macaddr));
+	hlist_add_head(&f->vlan_hlist,
+		       i40e_mac_vlan_bucket(vsi, f->macaddr, f->vlan));
+
+	WRITE_ONCE(vsi->num_mac_filters, vsi->num_mac_filters + 1);
+	if (i40e_is_vlan_filter(f))
+		WRITE_ONCE(vsi->num_vlan_filters, vsi->num_vlan_filters + 1);
+
+	if (vsi->num_mac_filters > 2 * BIT(vsi->mac_vlan_hash_bits) &&
+	    vsi->mac_vlan_hash_bits < I40E_MAC_VLAN_HASH_MAX_BITS)
+		i40e_mac_vlan_hash_grow(vsi);
+}
+
+/**
+ * i40e_mac_filter_unlink - Remove a filter from both VSI filter tables
+ * @vsi: the VSI owning the filter
+ * @f: the filter
+ *
+ * The filter's hlist node is free for reuse (e.g. on a temporary delete
+ * list) afterwards. Filters which were never linked are left alone.
+ *
+ * NOTE: This function is expected to be called with mac_filter_hash_lock
+ * being held.
+ **/
+void i40e_mac_filter_unlink(struct i40e_vsi *vsi, struct i40e_mac_filter *f)
+{
+	hash_del(&f->hlist);
+	if (hlist_unhashed(&f->vlan_hlist))
+		return;
+
+	hlist_del_init(&f->vlan_hlist);
+	WRITE_ONCE(vsi->num_mac_filters, vsi->num_mac_filters - 1);
+	if (i40e_is_vlan_filter(f))
+		WRITE_ONCE(vsi->num_vlan_filters, vsi->num_vlan_filters - 1);
+}
+
+/**
+ * i40e_mac_filter_set_vlan - Change the VLAN of a filter in place
+ * @vsi: the VSI owning the filter
+ * @f: the filter
+ * @vlan: the new VLAN id
+ *
+ * Keeps the MAC/VLAN index and VLAN filter count in step with the change.
+ *
+ * NOTE: This function is expected to be called with mac_filter_hash_lock
+ * being held.
+ **/
+void i40e_mac_filter_set_vlan(struct i40e_vsi *vsi, struct i40e_mac_filter *f,
+			      s16 vlan)
+{
+	if (f->vlan == vlan)
+		return;
+
+	if (hlist_unhashed(&f->vlan_hlist)) {
+		f->vlan = vlan;
+		return;
+	}
+
+	hlist_del(&f->vlan_hlist);
+	if (i40e_is_vlan_filter(f))
+		WRITE_ONCE(vsi->num_vlan_filters, vsi->num_vlan_filters - 1);
+	f->vlan = vlan;
+	if (i40e_is_vlan_filter(f))
+		WRITE_ONCE(vsi->num_vlan_filters, vsi->num_vlan_filters + 1);
+	hlist_add_head(&f->vlan_hlist,
+		       i40e_mac_vlan_bucket(vsi, f->macaddr, f->vlan));
+}
+
+/**
+ * i40e_mac_filter_lookup - Find a MAC/VLAN filter through the index
+ * @vsi: the VSI to be searched
+ * @macaddr: the MAC address
+ * @vlan: the vlan
+ *
+ * NOTE: This function is expected to be called with mac_filter_hash_lock
+ * being held.
+ **/
+struct i40e_mac_filter *i40e_mac_filter_lookup(struct i40e_vsi *vsi,
+					       const u8 *macaddr, s16 vlan)
+{
+	struct i40e_mac_filter *f;
+
+	hlist_for_each_entry(f, i40e_mac_vlan_bucket(vsi, macaddr, vlan),
+			     vlan_hlist) {
+		if (f->vlan == vlan && ether_addr_equal(macaddr, f->macaddr))
+			return f;
+	}
+	return NULL;
+}
+
+/**
+ * i40e_mac_vlan_hash_stats - Report occupancy of the MAC/VLAN index
+ * @vsi: the VSI to inspect
+ * @used: returns the number of non-empty buckets
+ * @max_chain: returns the length of the longest chain
+ *
+ * NOTE: This function is expected to be called with mac_filter_hash_lock
+ * being held.
+ **/
+void i40e_mac_vlan_hash_stats(struct i40e_vsi *vsi, u32 *used, u32 *max_chain)
+{
+	struct i40e_mac_filter *f;
+	u32 i, len;
+
+	*used = 0;
+	*max_chain = 0;
+	for (i = 0; i < BIT(vsi->mac_vlan_hash_bits); i++) {
+		len = 0;
+		hlist_for_each_entry(f, &vsi->mac_vlan_hash[i], vlan_hlist)
+			len++;
+		if (len)
+			(*used)++;
+		*max_chain = max(*max_chain, len);
+	}
+}
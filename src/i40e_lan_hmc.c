@@ -661,257 +661,97 @@ i40e_status i40e_shutdown_lan_hmc(struct i40e_hw *hw)
 	return ret_code;
 }
 
-#define I40E_HMC_STORE(_struct, _ele)		\
-	offsetof(struct _struct, _ele),		\
-	sizeof_field(struct _struct, _ele)
-
-struct i40e_context_ele {
-	u16 offset;
-	u16 size_of;
-	u16 width;
-	u16 lsb;
-};
+/* The queue contexts are described by lists of fields, which expand to
+ * straight line code packing each field with constant masks and shifts.
+ */
 
 /* LAN Tx Queue Context */
-static struct i40e_context_ele i40e_hmc_txq_ce_info[] = {
-					     /* Field      Width    LSB */
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, head),           13,      0 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, new_context),     1,     30 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, base),           57,     32 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, fc_ena),          1,     89 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, timesync_ena),    1,     90 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, fd_ena),          1,     91 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, alt_vlan_ena),    1,     92 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, cpuid),           8,     96 },
-/* line 1 */
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, thead_wb),       13,  0 + 128 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, head_wb_ena),     1, 32 + 128 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, qlen),           13, 33 + 128 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, tphrdesc_ena),    1, 46 + 128 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, tphrpacket_ena),  1, 47 + 128 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, tphwdesc_ena),    1, 48 + 128 },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, head_wb_addr),   64, 64 + 128 },
-/* line 7 */
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, crc),            32,  0 + (7 * 128) },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, rdylist),        10, 84 + (7 * 128) },
-	{I40E_HMC_STORE(i40e_hmc_obj_txq, rdylist_act),     1, 94 + (7 * 128) },
-	{ 0 }
-};
+#define I40E_HMC_TXQ_CTX(FIELD)					\
+	/*  Field            Width    LSB */				\
+	FIELD(head,            13,      0)				\
+	FIELD(new_context,      1,     30)				\
+	FIELD(base,            57,     32)				\
+	FIELD(fc_ena,           1,     89)				\
+	FIELD(timesync_ena,     1,     90)				\
+	FIELD(fd_ena,           1,     91)				\
+	FIELD(alt_vlan_ena,     1,     92)				\
+	FIELD(cpuid,            8,     96)				\
+	/* line 1 */							\
+	FIELD(thead_wb,        13,  0 + 128)				\
+	FIELD(head_wb_ena,      1, 32 + 128)				\
+	FIELD(qlen,            13, 33 + 128)				\
+	FIELD(tphrdesc_ena,     1, 46 + 128)				\
+	FIELD(tphrpacket_ena,   1, 47 + 128)				\
+	FIELD(tphwdesc_ena,     1, 48 + 128)				\
+	FIELD(head_wb_addr,    64, 64 + 128)				\
+	/* line 7 */							\
+	FIELD(crc,             32,  0 + (7 * 128))			\
+	FIELD(rdylist,         10, 84 + (7 * 128))			\
+	FIELD(rdylist_act,      1, 94 + (7 * 128))
 
 /* LAN Rx Queue Context */
-static struct i40e_context_ele i40e_hmc_rxq_ce_info[] = {
-					 /* Field      Width    LSB */
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, head),        13,	0   },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, cpuid),        8,	13  },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, base),        57,	32  },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, qlen),        13,	89  },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, dbuff),        7,	102 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, hbuff),        5,	109 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, dtype),        2,	114 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, dsize),        1,	116 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, crcstrip),     1,	117 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, fc_ena),       1,	118 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, l2tsel),       1,	119 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, hsplit_0),     4,	120 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, hsplit_1),     2,	124 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, showiv),       1,	127 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, rxmax),       14,	174 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, tphrdesc_ena), 1,	193 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, tphwdesc_ena), 1,	194 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, tphdata_ena),  1,	195 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, tphhead_ena),  1,	196 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, lrxqthresh),   3,	198 },
-	{ I40E_HMC_STORE(i40e_hmc_obj_rxq, prefena),      1,	201 },
-	{ 0 }
-};
-
-/**
- * i40e_write_byte - replace HMC context byte
- * @hmc_bits: pointer to the HMC memory
- * @ce_info: a description of the struct to be read from
- * @src: the struct to be read from
- **/
-static void i40e_write_byte(u8 *hmc_bits,
-			    struct i40e_context_ele *ce_info,
-			    u8 *src)
-{
-	u8 src_byte, dest_byte, mask;
-	u8 *from, *dest;
-	u16 shift_width;
-
-	/* copy from the next struct field */
-	from = src + ce_info->offset;
-
-	/* prepare the bits and mask */
-	shift_width = ce_info->lsb % 8;
-	mask = (u8)(BIT(ce_info->width) - 1);
-
-	src_byte = *from;
-	src_byte &= mask;
-
-	/* shift to correct alignment */
-	mask <<= shift_width;
-	src_byte <<= shift_width;
-
-	/* get the current bits from the target bit string */
-	dest = hmc_bits + (ce_info->lsb / 8);
-
-	i40e_memcpy(&dest_byte, dest, sizeof(dest_byte), I40E_DMA_TO_NONDMA);
-
-	dest_byte &= ~mask;	/* get the bits not changing */
-	dest_byte |= src_byte;	/* add in the new bits */
-
-	/* put it all back */
-	i40e_memcpy(dest, &dest_byte, sizeof(dest_byte), I40E_NONDMA_TO_DMA);
-}
-
-/**
- * i40e_write_word - replace HMC context word
- * @hmc_bits: pointer to the HMC memory
- * @ce_info: a description of the struct to be read from
- * @src: the struct to be read from
- **/
-static void i40e_write_word(u8 *hmc_bits,
-			    struct i40e_context_ele *ce_info,
-			    u8 *src)
-{
-	u16 src_word, mask;
-	u8 *from, *dest;
-	u16 shift_width;
-	__le16 dest_word;
-
-	/* copy from the next struct field */
-	from = src + ce_info->offset;
-
-	/* prepare the bits and mask */
-	shift_width = ce_info->lsb % 8;
-	mask = BIT(ce_info->width) - 1;
-
-	/* don't swizzle the bits until after the mask because the mask bits
-	 * will be in a different bit position on big endian machines
-	 */
-	src_word = *(u16 *)from;
-	src_word &= mask;
-
-	/* shift to correct alignment */
-	mask <<= shift_width;
-	src_word <<= shift_width;
-
-	/* get the current bits from the target bit string */
-	dest = hmc_bits + (ce_info->lsb / 8);
-
-	i40e_memcpy(&dest_word, dest, sizeof(dest_word), I40E_DMA_TO_NONDMA);
-
-	dest_word &= ~(CPU_TO_LE16(mask));	/* get the bits not changing */
-	dest_word |= CPU_TO_LE16(src_word);	/* add in the new bits */
-
-	/* put it all back */
-	i40e_memcpy(dest, &dest_word, sizeof(dest_word), I40E_NONDMA_TO_DMA);
-}
+#define I40E_HMC_RXQ_CTX(FIELD)					\
+	/*  Field            Width    LSB */				\
+	FIELD(head,            13,      0)				\
+	FIELD(cpuid,            8,     13)				\
+	FIELD(base,            57,     32)				\
+	FIELD(qlen,            13,     89)				\
+	FIELD(dbuff,            7,    102)				\
+	FIELD(hbuff,            5,    109)				\
+	FIELD(dtype,            2,    114)				\
+	FIELD(dsize,            1,    116)				\
+	FIELD(crcstrip,         1,    117)				\
+	FIELD(fc_ena,           1,    118)				\
+	FIELD(l2tsel,           1,    119)				\
+	FIELD(hsplit_0,         4,    120)				\
+	FIELD(hsplit_1,         2,    124)				\
+	FIELD(showiv,           1,    127)				\
+	FIELD(rxmax,           14,    174)				\
+	FIELD(tphrdesc_ena,     1,    193)				\
+	FIELD(tphwdesc_ena,     1,    194)				\
+	FIELD(tphdata_ena,      1,    195)				\
+	FIELD(tphhead_ena,      1,    196)				\
+	FIELD(lrxqthresh,       3,    198)				\
+	FIELD(prefena,          1,    201)
+
+/* largest queue context, in qwords */
+#define I40E_HMC_CTX_MAX_QWORDS	(I40E_HMC_OBJ_SIZE_TXQ / sizeof(u64))
 
 /**
- * i40e_write_dword - replace HMC context dword
- * @hmc_bits: pointer to the HMC memory
- * @ce_info: a description of the struct to be read from
- * @src: the struct to be read from
+ * i40e_pack_hmc_field - add one field to a queue context in CPU order
+ * @ctx: the context qwords being assembled
+ * @mask: the context bits written so far
+ * @val: the field value
+ * @width: width of the field in bits
+ * @lsb: position of the field in the context
+ *
+ * Bit n of the context lives in bit (n % 64) of qword (n / 64). With
+ * @width and @lsb constant this reduces to a mask, a shift and an or.
  **/
-static void i40e_write_dword(u8 *hmc_bits,
-			     struct i40e_context_ele *ce_info,
-			     u8 *src)
+static __always_inline void i40e_pack_hmc_field(u64 *ctx, u64 *mask, u64 val,
+						const u16 width, const u16 lsb)
 {
-	u32 src_dword, mask;
-	u8 *from, *dest;
-	u16 shift_width;
-	__le32 dest_dword;
-
-	/* copy from the next struct field */
-	from = src + ce_info->offset;
-
-	/* prepare the bits and mask */
-	shift_width = ce_info->lsb % 8;
-
-	/* if the field width is exactly 32 on an x86 machine, then the shift
-	 * operation will not work because the SHL instructions count is masked
-	 * to 5 bits so the shift will do nothing
+	/* a shift by 64 would do nothing on x86, so 64 bit wide fields
+	 * need their own mask
 	 */
-	if (ce_info->width < 32)
-		mask = BIT(ce_info->width) - 1;
-	else
-		mask = ~(u32)0;
-
-	/* don't swizzle the bits until after the mask because the mask bits
-	 * will be in a different bit position on big endian machines
-	 */
-	src_dword = *(u32 *)from;
-	src_dword &= mask;
-
-	/* shift to correct alignment */
-	mask <<= shift_width;
-	src_dword <<= shift_width;
-
-	/* get the current bits from the target bit string */
-	dest = hmc_bits + (ce_info->lsb / 8);
-
-	i40e_memcpy(&dest_dword, dest, sizeof(dest_dword), I40E_DMA_TO_NONDMA);
-
-	dest_dword &= ~(CPU_TO_LE32(mask));	/* get the bits not changing */
-	dest_dword |= CPU_TO_LE32(src_dword);	/* add in the new bits */
-
-	/* put it all back */
-	i40e_memcpy(dest, &dest_dword, sizeof(dest_dword), I40E_NONDMA_TO_DMA);
+	u64 field = width < 64 ? BIT_ULL(width) - 1 : ~(u64)0;
+	u16 shift = lsb % 64;
+	u16 q = lsb / 64;
+
+	val &= field;
+	ctx[q] |= val << shift;
+	mask[q] |= field << shift;
+
+	/* the field straddles two qwords, shift is never 0 here */
+	if (shift + width > 64) {
+		ctx[q + 1] |= val >> (64 - shift);
+		mask[q + 1] |= field >> (64 - shift);
+	}
 }
 
-/**
- * i40e_write_qword - replace HMC context qword
- * @hmc_bits: pointer to the HMC memory
- * @ce_info: a description of the struct to be read from
- * @src: the struct to be read from
- **/
-static void i40e_write_qword(u8 *hmc_bits,
-			     struct i40e_context_ele *ce_info,
-			     u8 *src)
-{
-	u64 src_qword, mask;
-	u8 *from, *dest;
-	u16 shift_width;
-	__le64 dest_qword;
-
-	/* copy from the next struct field */
-	from = src + ce_info->offset;
-
-	/* prepare the bits and mask */
-	shift_width = ce_info->lsb % 8;
-
-	/* if the field width is exactly 64 on an x86 machine, then the shift
-	 * operation will not work because the SHL instructions count is masked
-	 * to 6 bits so the shift will do nothing
-	 */
-	if (ce_info->width < 64)
-		mask = BIT_ULL(ce_info->width) - 1;
-	else
-		mask = ~(u64)0;
-
-	/* don't swizzle the bits until after the mask because the mask bits
-	 * will be in a different bit position on big endian machines
-	 */
-	src_qword = *(u64 *)from;
-	src_qword &= mask;
-
-	/* shift to correct alignment */
-	mask <<= shift_width;
-	src_qword <<= shift_width;
-
-	/* get the current bits from the target bit string */
-	dest = hmc_bits + (ce_info->lsb / 8);
-
-	i40e_memcpy(&dest_qword, dest, sizeof(dest_qword), I40E_DMA_TO_NONDMA);
-
-	dest_qword &= ~(CPU_TO_LE64(mask));	/* get the bits not changing */
-	dest_qword |= CPU_TO_LE64(src_qword);	/* add in the new bits */
-
-	/* put it all back */
-	i40e_memcpy(dest, &dest_qword, sizeof(dest_qword), I40E_NONDMA_TO_DMA);
-}
+/* expects ctx, mask and the driver struct s in scope */
+#define I40E_HMC_PACK_FIELD(_ele, _width, _lsb)			\
+	i40e_pack_hmc_field(ctx, mask, s->_ele, _width, _lsb);
 
 /**
  * i40e_clear_hmc_context - zero out the HMC context bits
@@ -931,40 +771,34 @@ static i40e_status i40e_clear_hmc_context(struct i40e_hw *hw,
 }
 
 /**
- * i40e_set_hmc_context - replace HMC context bits
+ * i40e_write_hmc_context - merge an assembled context into HMC memory
  * @context_bytes: pointer to the context bit array
- * @ce_info:  a description of the struct to be filled
- * @dest:     the struct to be filled
+ * @ctx: the context qwords in CPU order
+ * @mask: the context bits to be replaced
+ *
+ * Every qword holding context fields is updated with one read and one
+ * write, leaving the bits outside @mask untouched.
  **/
-static i40e_status i40e_set_hmc_context(u8 *context_bytes,
-					struct i40e_context_ele *ce_info,
-					u8 *dest)
+static __always_inline void i40e_write_hmc_context(u8 *context_bytes,
+						   const u64 *ctx,
+						   const u64 *mask)
 {
-	int f;
+	__le64 hmc_qword;
+	int q;
 
-	for (f = 0; ce_info[f].width != 0; f++) {
+	for (q = 0; q < I40E_HMC_CTX_MAX_QWORDS; q++) {
+		u8 *to = context_bytes + q * sizeof(hmc_qword);
 
-		/* we have to deal with each element of the HMC using the
-		 * correct size so that we are correct regardless of the
-		 * endianness of the machine
-		 */
-		switch (ce_info[f].size_of) {
-		case 1:
-			i40e_write_byte(context_bytes, &ce_info[f], dest);
-			break;
-		case 2:
-			i40e_write_word(context_bytes, &ce_info[f], dest);
-			break;
-		case 4:
-			i40e_write_dword(context_bytes, &ce_info[f], dest);
-			break;
-		case 8:
-			i40e_write_qword(context_bytes, &ce_info[f], dest);
-			break;
-		}
-	}
+		if (!mask[q])
+			continue;
 
-	return I40E_SUCCESS;
+		i40e_memcpy(&hmc_qword, to, sizeof(hmc_qword),
+			    I40E_DMA_TO_NONDMA);
+		hmc_qword &= ~CPU_TO_LE64(mask[q]);
+		hmc_qword |= CPU_TO_LE64(ctx[q]);
+		i40e_memcpy(to, &hmc_qword, sizeof(hmc_qword),
+			    I40E_NONDMA_TO_DMA);
+	}
 }
 
 /**
@@ -1066,6 +900,8 @@ i40e_status i40e_set_lan_tx_queue_context(struct i40e_hw *hw,
 						    u16 queue,
 						    struct i40e_hmc_obj_txq *s)
 {
+	u64 mask[I40E_HMC_CTX_MAX_QWORDS] = { 0 };
+	u64 ctx[I40E_HMC_CTX_MAX_QWORDS] = { 0 };
 	i40e_status err;
 	u8 *context_bytes;
 
@@ -1073,8 +909,10 @@ i40e_status i40e_set_lan_tx_queue_context(struct i40e_hw *hw,
 	if (err < 0)
 		return err;
 
-	return i40e_set_hmc_context(context_bytes,
-				    i40e_hmc_txq_ce_info, (u8 *)s);
+	I40E_HMC_TXQ_CTX(I40E_HMC_PACK_FIELD)
+	i40e_write_hmc_context(context_bytes, ctx, mask);
+
+	return I40E_SUCCESS;
 }
 
 /**
@@ -1105,6 +943,8 @@ i40e_status i40e_set_lan_rx_queue_context(struct i40e_hw *hw,
 						    u16 queue,
 						    struct i40e_hmc_obj_rxq *s)
 {
+	u64 mask[I40E_HMC_CTX_MAX_QWORDS] = { 0 };
+	u64 ctx[I40E_HMC_CTX_MAX_QWORDS] = { 0 };
 	i40e_status err;
 	u8 *context_bytes;
 
@@ -1112,6 +952,8 @@ i40e_status i40e_set_lan_rx_queue_context(struct i40e_hw *hw,
 	if (err < 0)
 		return err;
 
-	return i40e_set_hmc_context(context_bytes,
-				    i40e_hmc_rxq_ce_info, (u8 *)s);
+	I40E_HMC_RXQ_CTX(I40E_HMC_PACK_FIELD)
+	i40e_write_hmc_context(context_bytes, ctx, mask);
+
+	return I40E_SUCCESS;
 }
@@ -4,6 +4,9 @@
 #ifdef HAVE_XDP_SUPPORT
 #include <linux/bpf.h>
 #endif
+#ifdef HAVE_NETDEV_STAT_OPS
+#include <net/netdev_queues.h>
+#endif
 /* Local includes */
 #include "i40e.h"
 #include "i40e_helper.h"
@@ -52,8 +55,15 @@ static const char i40e_driver_string[] =
 const char i40e_driver_version_str[] = DRV_VERSION;
 static const char i40e_copyright[] = "Copyright (C) 2013-2023 Intel Corporation";
 
+#define I40E_REBUILD_PHASE_NAME(phase, name)	[I40E_REBUILD_##phase] = name,
+const char * const i40e_rebuild_phase_str[] = {
+	I40E_REBUILD_PHASE_LIST(I40E_REBUILD_PHASE_NAME)
+};
+
 /* a bit of forward declarations */
 static void i40e_vsi_reinit_locked(struct i40e_vsi *vsi);
+static void i40e_vsi_calc_rx_buf_len(struct i40e_vsi *vsi, u16 *max_frame,
+				     u16 *rx_buf_len);
 static void i40e_handle_reset_warning(struct i40e_pf *pf, bool lock_acquired);
 static int i40e_add_vsi(struct i40e_vsi *vsi);
 static int i40e_add_veb(struct i40e_veb *veb, struct i40e_vsi *vsi);
@@ -119,7 +129,6 @@ static const struct pci_device_id i40e_pci_tbl[] = {
 };
 MODULE_DEVICE_TABLE(pci, i40e_pci_tbl);
 
-#define I40E_MAX_VF_COUNT 128
 #define OPTION_UNSET    -1
 #define I40E_PARAM_INIT { [0 ... I40E_MAX_NIC] = OPTION_UNSET}
 #define I40E_MAX_NIC 64
@@ -147,6 +156,10 @@ MODULE_PARM_DESC(debug, "Debug level (0=none,...,16=all)");
 static int l4mode = L4_MODE_DISABLED;
 module_param(l4mode, int, 0000);
 MODULE_PARM_DESC(l4mode, "L4 cloud filter mode: 0=UDP,1=TCP,2=Both,-1=Disabled(default)");
+static int vf_stats_age = I40E_VF_STATS_MAX_AGE_MS;
+module_param(vf_stats_age, int, 0000);
+MODULE_PARM_DESC(vf_stats_age, "Max age in ms of the VF statistics served to readers: 0=always read HW, default "
+		 __stringify(I40E_VF_STATS_MAX_AGE_MS));
 
 
 MODULE_AUTHOR("Intel Corporation, <e1000-devel@lists.sourceforge.net>");
@@ -155,6 +168,7 @@ MODULE_LICENSE("GPL");
 MODULE_VERSION(DRV_VERSION);
 
 static struct workqueue_struct *i40e_wq;
+static struct workqueue_struct *i40e_aq_wq;
 
 bool i40e_is_l4mode_enabled(void)
 {
@@ -333,6 +347,21 @@ void i40e_service_event_schedule(struct i40e_pf *pf)
 		queue_work(i40e_wq, &pf->service_task);
 }
 
+/**
+ * i40e_adminq_event_schedule - Schedule the AdminQ task to wake up
+ * @pf: board private structure
+ *
+ * ARQ events are drained from their own high priority work item so that
+ * VF mailbox and link events do not wait behind the service task.
+ **/
+static void i40e_adminq_event_schedule(struct i40e_pf *pf)
+{
+	if ((!test_bit(__I40E_DOWN, pf->state) &&
+	     !test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state)) ||
+	      test_bit(__I40E_RECOVERY_MODE, pf->state))
+		queue_work(i40e_aq_wq, &pf->adminq_task);
+}
+
 /**
  * i40e_tx_timeout - Respond to a Tx Hang
  * @netdev: network interface device structure
@@ -554,7 +583,10 @@ static struct rtnl_link_stats64 *i40e_get_netdev_stats_struct(
 	}
 	rcu_read_unlock();
 
-	/* following stats updated by i40e_watchdog_subtask() */
+	/* following stats updated by i40e_watchdog_subtask(), ask it to
+	 * keep them fresh while somebody is reading them
+	 */
+	WRITE_ONCE(vsi->stats_wanted, true);
 	stats->multicast	= vsi_stats->multicast;
 	stats->tx_errors	= vsi_stats->tx_errors;
 	stats->tx_dropped	= vsi_stats->tx_dropped;
@@ -574,9 +606,122 @@ static struct net_device_stats *i40e_get_netdev_stats_struct(
 	struct i40e_netdev_priv *np = netdev_priv(netdev);
 	struct i40e_vsi *vsi = np->vsi;
 
+	WRITE_ONCE(vsi->stats_wanted, true);
 	return i40e_get_vsi_stats_struct(vsi);
 }
 #endif /* HAVE_NDO_GET_STATS64 */
+
+#ifdef HAVE_NETDEV_STAT_OPS
+/**
+ * i40e_get_ring_stats - Read the packet and byte counters of a ring
+ * @ring: the ring to read
+ * @packets: returns the packet count
+ * @bytes: returns the byte count
+ **/
+static void i40e_get_ring_stats(struct i40e_ring *ring, u64 *packets,
+				u64 *bytes)
+{
+	unsigned int start;
+
+	do {
+		start = u64_stats_fetch_begin(&ring->syncp);
+		*packets = ring->stats.packets;
+		*bytes = ring->stats.bytes;
+	} while (u64_stats_fetch_retry(&ring->syncp, start));
+}
+
+/**
+ * i40e_get_queue_stats_rx - Get the statistics of one Rx queue
+ * @netdev: network interface device structure
+ * @idx: index of the Rx queue
+ * @stats: data structure to store the statistics in
+ **/
+static void i40e_get_queue_stats_rx(struct net_device *netdev, int idx,
+				    struct netdev_queue_stats_rx *stats)
+{
+	struct i40e_netdev_priv *np = netdev_priv(netdev);
+	struct i40e_vsi *vsi = np->vsi;
+	struct i40e_ring *rx_ring;
+
+	rcu_read_lock();
+	rx_ring = vsi->rx_rings ? READ_ONCE(vsi->rx_rings[idx]) : NULL;
+	if (rx_ring) {
+		i40e_get_ring_stats(rx_ring, &stats->packets, &stats->bytes);
+		stats->alloc_fail = rx_ring->rx_stats.alloc_page_failed +
+				    rx_ring->rx_stats.alloc_buff_failed;
+	}
+	rcu_read_unlock();
+}
+
+/**
+ * i40e_get_queue_stats_tx - Get the statistics of one Tx queue
+ * @netdev: network interface device structure
+ * @idx: index of the Tx queue
+ * @stats: data structure to store the statistics in
+ **/
+static void i40e_get_queue_stats_tx(struct net_device *netdev, int idx,
+				    struct netdev_queue_stats_tx *stats)
+{
+	struct i40e_netdev_priv *np = netdev_priv(netdev);
+	struct i40e_vsi *vsi = np->vsi;
+	struct i40e_ring *tx_ring;
+
+	rcu_read_lock();
+	tx_ring = vsi->tx_rings ? READ_ONCE(vsi->tx_rings[idx]) : NULL;
+	if (tx_ring)
+		i40e_get_ring_stats(tx_ring, &stats->packets, &stats->bytes);
+	rcu_read_unlock();
+}
+
+/**
+ * i40e_get_base_stats - Get the statistics not owned by any netdev queue
+ * @netdev: network interface device structure
+ * @rx: data structure to store the Rx statistics in
+ * @tx: data structure to store the Tx statistics in
+ *
+ * Frames sent by XDP_TX and XDP_REDIRECT go out on the XDP Tx rings, which
+ * have no netdev queue of their own, so they are accounted here to keep
+ * the per queue numbers adding up to the ndo_get_stats64 totals.
+ **/
+static void i40e_get_base_stats(struct net_device *netdev,
+				struct netdev_queue_stats_rx *rx,
+				struct netdev_queue_stats_tx *tx)
+{
+	struct i40e_netdev_priv *np = netdev_priv(netdev);
+	struct i40e_vsi *vsi = np->vsi;
+	struct i40e_ring *xdp_ring;
+	u64 bytes, packets;
+	int i;
+
+	rx->packets = 0;
+	rx->bytes = 0;
+	rx->alloc_fail = 0;
+
+	tx->packets = 0;
+	tx->bytes = 0;
+
+	if (!i40e_enabled_xdp_vsi(vsi) || !vsi->xdp_rings)
+		return;
+
+	rcu_read_lock();
+	for (i = 0; i < vsi->num_queue_pairs; i++) {
+		xdp_ring = READ_ONCE(vsi->xdp_rings[i]);
+		if (!xdp_ring)
+			continue;
+
+		i40e_get_ring_stats(xdp_ring, &packets, &bytes);
+		tx->packets += packets;
+		tx->bytes += bytes;
+	}
+	rcu_read_unlock();
+}
+
+static const struct netdev_stat_ops i40e_stat_ops = {
+	.get_queue_stats_rx	= i40e_get_queue_stats_rx,
+	.get_queue_stats_tx	= i40e_get_queue_stats_tx,
+	.get_base_stats		= i40e_get_base_stats,
+};
+#endif /* HAVE_NETDEV_STAT_OPS */
 /**
  * i40e_vsi_reset_stats - Resets all stats of the given vsi
  * @vsi: the VSI to have its stats reset
@@ -708,6 +853,43 @@ static void i40e_stat_update64(struct i40e_hw *hw, u32 hireg, u32 loreg,
 	*stat = new_data - *offset;
 }
 
+/**
+ * i40e_stat_offset48 - turn a raw 48 bit counter value into a stat
+ * @new_data: the value read from the chip
+ * @offset_loaded: has the initial offset been loaded yet
+ * @offset: ptr to current offset value
+ * @stat: ptr to the stat
+ **/
+static void i40e_stat_offset48(u64 new_data, bool offset_loaded,
+			       u64 *offset, u64 *stat)
+{
+	if (!offset_loaded)
+		*offset = new_data;
+	if (likely(new_data >= *offset))
+		*stat = new_data - *offset;
+	else
+		*stat = (new_data + BIT_ULL(48)) - *offset;
+	*stat &= 0xFFFFFFFFFFFFULL;
+}
+
+/**
+ * i40e_stat_offset32 - turn a raw 32 bit counter value into a stat
+ * @new_data: the value read from the chip
+ * @offset_loaded: has the initial offset been loaded yet
+ * @offset: ptr to current offset value
+ * @stat: ptr to the stat
+ **/
+static void i40e_stat_offset32(u32 new_data, bool offset_loaded,
+			       u64 *offset, u64 *stat)
+{
+	if (!offset_loaded)
+		*offset = new_data;
+	if (likely(new_data >= *offset))
+		*stat = (u32)(new_data - *offset);
+	else
+		*stat = (u32)((new_data + BIT_ULL(32)) - *offset);
+}
+
 /**
  * i40e_stat_update48 - read and update a 48 bit stat from the chip
  * @hw: ptr to the hardware info
@@ -734,13 +916,7 @@ static void i40e_stat_update48(struct i40e_hw *hw, u32 hireg, u32 loreg,
 	} else {
 		new_data = rd64(hw, loreg);
 	}
-	if (!offset_loaded)
-		*offset = new_data;
-	if (likely(new_data >= *offset))
-		*stat = new_data - *offset;
-	else
-		*stat = (new_data + BIT_ULL(48)) - *offset;
-	*stat &= 0xFFFFFFFFFFFFULL;
+	i40e_stat_offset48(new_data, offset_loaded, offset, stat);
 }
 
 /**
@@ -754,15 +930,76 @@ static void i40e_stat_update48(struct i40e_hw *hw, u32 hireg, u32 loreg,
 static void i40e_stat_update32(struct i40e_hw *hw, u32 reg,
 			       bool offset_loaded, u64 *offset, u64 *stat)
 {
-	u32 new_data;
+	i40e_stat_offset32(rd32(hw, reg), offset_loaded, offset, stat);
+}
 
-	new_data = rd32(hw, reg);
-	if (!offset_loaded)
-		*offset = new_data;
-	if (likely(new_data >= *offset))
-		*stat = (u32)(new_data - *offset);
-	else
-		*stat = (u32)((new_data + BIT_ULL(32)) - *offset);
+#define I40E_STAT_BATCH_MAX	8
+
+/**
+ * i40e_stat_update48_batch - read and update a run of 48 bit stats
+ * @hw: ptr to the hardware info
+ * @loreg: the low 32 bit reg of the first stat
+ * @stride: distance between the low regs of consecutive stats
+ * @count: number of stats in the run, at most I40E_STAT_BATCH_MAX
+ * @offset_loaded: has the initial offset been loaded yet
+ * @offset: ptr to the first of @count consecutive offset values
+ * @stat: ptr to the first of @count consecutive stats
+ *
+ * All registers of the run are read back to back before any of the offset
+ * arithmetic is done, so a rarely read group costs one burst of MMIO.  The
+ * high reg of each stat sits right above its low reg.
+ **/
+static void i40e_stat_update48_batch(struct i40e_hw *hw, u32 loreg, u32 stride,
+				     unsigned int count, bool offset_loaded,
+				     u64 *offset, u64 *stat)
+{
+	u64 new_data[I40E_STAT_BATCH_MAX];
+	unsigned int i;
+	u32 reg;
+
+	if (WARN_ON_ONCE(count > I40E_STAT_BATCH_MAX))
+		count = I40E_STAT_BATCH_MAX;
+
+	for (i = 0, reg = loreg; i < count; i++, reg += stride) {
+		if (hw->device_id == I40E_DEV_ID_QEMU) {
+			new_data[i] = rd32(hw, reg);
+			new_data[i] |= ((u64)(rd32(hw, reg + 4) & 0xFFFF)) << 32;
+		} else {
+			new_data[i] = rd64(hw, reg);
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		i40e_stat_offset48(new_data[i], offset_loaded,
+				   &offset[i], &stat[i]);
+}
+
+/**
+ * i40e_stat_update32_batch - read and update a run of 32 bit stats
+ * @hw: ptr to the hardware info
+ * @reg: the hw reg of the first stat
+ * @stride: distance between the regs of consecutive stats
+ * @count: number of stats in the run, at most I40E_STAT_BATCH_MAX
+ * @offset_loaded: has the initial offset been loaded yet
+ * @offset: ptr to the first of @count consecutive offset values
+ * @stat: ptr to the first of @count consecutive stats
+ **/
+static void i40e_stat_update32_batch(struct i40e_hw *hw, u32 reg, u32 stride,
+				     unsigned int count, bool offset_loaded,
+				     u64 *offset, u64 *stat)
+{
+	u32 new_data[I40E_STAT_BATCH_MAX];
+	unsigned int i;
+
+	if (WARN_ON_ONCE(count > I40E_STAT_BATCH_MAX))
+		count = I40E_STAT_BATCH_MAX;
+
+	for (i = 0; i < count; i++, reg += stride)
+		new_data[i] = rd32(hw, reg);
+
+	for (i = 0; i < count; i++)
+		i40e_stat_offset32(new_data[i], offset_loaded,
+				   &offset[i], &stat[i]);
 }
 
 /**
@@ -947,6 +1184,7 @@ void i40e_update_veb_stats(struct i40e_veb *veb)
 				   &veb_es->tc_tx_bytes[i]);
 	}
 	veb->stat_offsets_loaded = true;
+	veb->stats_refreshed = jiffies;
 }
 
 /**
@@ -989,6 +1227,9 @@ static void i40e_update_vsi_stats(struct i40e_vsi *vsi)
 	    test_bit(__I40E_CONFIG_BUSY, pf->state))
 		return;
 
+	vsi->stats_refreshed = jiffies;
+	WRITE_ONCE(vsi->stats_wanted, false);
+
 	ns = i40e_get_vsi_stats_struct(vsi);
 	ons = &vsi->net_stats_offsets;
 	es = &vsi->eth_stats;
@@ -1083,17 +1324,15 @@ static void i40e_update_vsi_stats(struct i40e_vsi *vsi)
 }
 
 /**
- * i40e_update_pf_stats - Update the PF statistics counters.
+ * i40e_update_pf_port_stats - Update the port counters and error stats
  * @pf: the PF to be updated
  **/
-static void i40e_update_pf_stats(struct i40e_pf *pf)
+static void i40e_update_pf_port_stats(struct i40e_pf *pf)
 {
 	struct i40e_hw_port_stats *osd = &pf->stats_offsets;
 	struct i40e_hw_port_stats *nsd = &pf->stats;
 	struct i40e_hw *hw = &pf->hw;
 
-	int i;
-
 	i40e_stat_update48(hw, I40E_GLPRT_GORCH(hw->port),
 			   I40E_GLPRT_GORCL(hw->port),
 			   pf->stat_offsets_loaded,
@@ -1164,6 +1403,31 @@ static void i40e_update_pf_stats(struct i40e_pf *pf)
 			   &osd->rx_length_errors,
 			   &nsd->rx_length_errors);
 
+	i40e_stat_update32(hw, I40E_GLPRT_RUC(hw->port),
+			   pf->stat_offsets_loaded,
+			   &osd->rx_undersize, &nsd->rx_undersize);
+	i40e_stat_update32(hw, I40E_GLPRT_RFC(hw->port),
+			   pf->stat_offsets_loaded,
+			   &osd->rx_fragments, &nsd->rx_fragments);
+	i40e_stat_update32(hw, I40E_GLPRT_ROC(hw->port),
+			   pf->stat_offsets_loaded,
+			   &osd->rx_oversize, &nsd->rx_oversize);
+	i40e_stat_update32(hw, I40E_GLPRT_RJC(hw->port),
+			   pf->stat_offsets_loaded,
+			   &osd->rx_jabber, &nsd->rx_jabber);
+}
+
+/**
+ * i40e_update_pf_fc_stats - Update the link and priority flow control stats
+ * @pf: the PF to be updated
+ **/
+static void i40e_update_pf_fc_stats(struct i40e_pf *pf)
+{
+	struct i40e_hw_port_stats *osd = &pf->stats_offsets;
+	struct i40e_hw_port_stats *nsd = &pf->stats;
+	struct i40e_hw *hw = &pf->hw;
+	u32 stride;
+
 	i40e_stat_update32(hw, I40E_GLPRT_LXONRXC(hw->port),
 			   pf->stat_offsets_loaded,
 			   &osd->link_xon_rx, &nsd->link_xon_rx);
@@ -1177,102 +1441,72 @@ static void i40e_update_pf_stats(struct i40e_pf *pf)
 			   pf->stat_offsets_loaded,
 			   &osd->link_xoff_tx, &nsd->link_xoff_tx);
 
-	for (i = 0; i < 8; i++) {
-		i40e_stat_update32(hw, I40E_GLPRT_PXOFFRXC(hw->port, i),
-				   pf->stat_offsets_loaded,
-				   &osd->priority_xoff_rx[i],
-				   &nsd->priority_xoff_rx[i]);
-		i40e_stat_update32(hw, I40E_GLPRT_PXONRXC(hw->port, i),
-				   pf->stat_offsets_loaded,
-				   &osd->priority_xon_rx[i],
-				   &nsd->priority_xon_rx[i]);
-		i40e_stat_update32(hw, I40E_GLPRT_PXONTXC(hw->port, i),
-				   pf->stat_offsets_loaded,
-				   &osd->priority_xon_tx[i],
-				   &nsd->priority_xon_tx[i]);
-		i40e_stat_update32(hw, I40E_GLPRT_PXOFFTXC(hw->port, i),
-				   pf->stat_offsets_loaded,
-				   &osd->priority_xoff_tx[i],
-				   &nsd->priority_xoff_tx[i]);
-		i40e_stat_update32(hw,
-				   I40E_GLPRT_RXON2OFFCNT(hw->port, i),
-				   pf->stat_offsets_loaded,
-				   &osd->priority_xon_2_xoff[i],
-				   &nsd->priority_xon_2_xoff[i]);
-	}
-
-	i40e_stat_update48(hw, I40E_GLPRT_PRC64H(hw->port),
-			   I40E_GLPRT_PRC64L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_size_64, &nsd->rx_size_64);
-	i40e_stat_update48(hw, I40E_GLPRT_PRC127H(hw->port),
-			   I40E_GLPRT_PRC127L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_size_127, &nsd->rx_size_127);
-	i40e_stat_update48(hw, I40E_GLPRT_PRC255H(hw->port),
-			   I40E_GLPRT_PRC255L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_size_255, &nsd->rx_size_255);
-	i40e_stat_update48(hw, I40E_GLPRT_PRC511H(hw->port),
-			   I40E_GLPRT_PRC511L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_size_511, &nsd->rx_size_511);
-	i40e_stat_update48(hw, I40E_GLPRT_PRC1023H(hw->port),
-			   I40E_GLPRT_PRC1023L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_size_1023, &nsd->rx_size_1023);
-	i40e_stat_update48(hw, I40E_GLPRT_PRC1522H(hw->port),
-			   I40E_GLPRT_PRC1522L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_size_1522, &nsd->rx_size_1522);
-	i40e_stat_update48(hw, I40E_GLPRT_PRC9522H(hw->port),
-			   I40E_GLPRT_PRC9522L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_size_big, &nsd->rx_size_big);
+	/* the per priority counters of a port are spaced evenly */
+	stride = I40E_GLPRT_PXONRXC(0, 1) - I40E_GLPRT_PXONRXC(0, 0);
+	i40e_stat_update32_batch(hw, I40E_GLPRT_PXOFFRXC(hw->port, 0), stride,
+				 ARRAY_SIZE(nsd->priority_xoff_rx),
+				 pf->stat_offsets_loaded,
+				 osd->priority_xoff_rx, nsd->priority_xoff_rx);
+	i40e_stat_update32_batch(hw, I40E_GLPRT_PXONRXC(hw->port, 0), stride,
+				 ARRAY_SIZE(nsd->priority_xon_rx),
+				 pf->stat_offsets_loaded,
+				 osd->priority_xon_rx, nsd->priority_xon_rx);
+	i40e_stat_update32_batch(hw, I40E_GLPRT_PXONTXC(hw->port, 0), stride,
+				 ARRAY_SIZE(nsd->priority_xon_tx),
+				 pf->stat_offsets_loaded,
+				 osd->priority_xon_tx, nsd->priority_xon_tx);
+	i40e_stat_update32_batch(hw, I40E_GLPRT_PXOFFTXC(hw->port, 0), stride,
+				 ARRAY_SIZE(nsd->priority_xoff_tx),
+				 pf->stat_offsets_loaded,
+				 osd->priority_xoff_tx, nsd->priority_xoff_tx);
+	i40e_stat_update32_batch(hw, I40E_GLPRT_RXON2OFFCNT(hw->port, 0),
+				 stride, ARRAY_SIZE(nsd->priority_xon_2_xoff),
+				 pf->stat_offsets_loaded,
+				 osd->priority_xon_2_xoff,
+				 nsd->priority_xon_2_xoff);
+}
+
+/**
+ * i40e_update_pf_size_stats - Update the packet size histograms
+ * @pf: the PF to be updated
+ **/
+static void i40e_update_pf_size_stats(struct i40e_pf *pf)
+{
+	struct i40e_hw_port_stats *osd = &pf->stats_offsets;
+	struct i40e_hw_port_stats *nsd = &pf->stats;
+	struct i40e_hw *hw = &pf->hw;
+	unsigned int count;
+	u32 stride;
 
-	i40e_stat_update48(hw, I40E_GLPRT_PTC64H(hw->port),
-			   I40E_GLPRT_PTC64L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->tx_size_64, &nsd->tx_size_64);
-	i40e_stat_update48(hw, I40E_GLPRT_PTC127H(hw->port),
-			   I40E_GLPRT_PTC127L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->tx_size_127, &nsd->tx_size_127);
-	i40e_stat_update48(hw, I40E_GLPRT_PTC255H(hw->port),
-			   I40E_GLPRT_PTC255L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->tx_size_255, &nsd->tx_size_255);
-	i40e_stat_update48(hw, I40E_GLPRT_PTC511H(hw->port),
-			   I40E_GLPRT_PTC511L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->tx_size_511, &nsd->tx_size_511);
-	i40e_stat_update48(hw, I40E_GLPRT_PTC1023H(hw->port),
-			   I40E_GLPRT_PTC1023L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->tx_size_1023, &nsd->tx_size_1023);
-	i40e_stat_update48(hw, I40E_GLPRT_PTC1522H(hw->port),
-			   I40E_GLPRT_PTC1522L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->tx_size_1522, &nsd->tx_size_1522);
-	i40e_stat_update48(hw, I40E_GLPRT_PTC9522H(hw->port),
-			   I40E_GLPRT_PTC9522L(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->tx_size_big, &nsd->tx_size_big);
+	/* each histogram is a run of consecutive stats in the same order
+	 * as its evenly spaced registers
+	 */
+	BUILD_BUG_ON(offsetof(struct i40e_hw_port_stats, rx_size_big) -
+		     offsetof(struct i40e_hw_port_stats, rx_size_64) !=
+		     offsetof(struct i40e_hw_port_stats, tx_size_big) -
+		     offsetof(struct i40e_hw_port_stats, tx_size_64));
+	count = (offsetof(struct i40e_hw_port_stats, rx_size_big) -
+		 offsetof(struct i40e_hw_port_stats, rx_size_64)) /
+		sizeof(u64) + 1;
+	stride = I40E_GLPRT_PRC127L(0) - I40E_GLPRT_PRC64L(0);
 
-	i40e_stat_update32(hw, I40E_GLPRT_RUC(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_undersize, &nsd->rx_undersize);
-	i40e_stat_update32(hw, I40E_GLPRT_RFC(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_fragments, &nsd->rx_fragments);
-	i40e_stat_update32(hw, I40E_GLPRT_ROC(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_oversize, &nsd->rx_oversize);
-	i40e_stat_update32(hw, I40E_GLPRT_RJC(hw->port),
-			   pf->stat_offsets_loaded,
-			   &osd->rx_jabber, &nsd->rx_jabber);
+	i40e_stat_update48_batch(hw, I40E_GLPRT_PRC64L(hw->port), stride,
+				 count, pf->stat_offsets_loaded,
+				 &osd->rx_size_64, &nsd->rx_size_64);
+	i40e_stat_update48_batch(hw, I40E_GLPRT_PTC64L(hw->port), stride,
+				 count, pf->stat_offsets_loaded,
+				 &osd->tx_size_64, &nsd->tx_size_64);
+}
+
+/**
+ * i40e_update_pf_fd_stats - Update the flow director stats
+ * @pf: the PF to be updated
+ **/
+static void i40e_update_pf_fd_stats(struct i40e_pf *pf)
+{
+	struct i40e_hw_port_stats *nsd = &pf->stats;
+	struct i40e_hw *hw = &pf->hw;
 
-	/* FDIR stats */
 	i40e_stat_update_and_clear32(hw,
 			I40E_GLQF_PCNT(I40E_FD_ATR_STAT_IDX(hw->pf_id)),
 			&nsd->fd_atr_match);
@@ -1283,13 +1517,6 @@ static void i40e_update_pf_stats(struct i40e_pf *pf)
 			I40E_GLQF_PCNT(I40E_FD_ATR_TUNNEL_STAT_IDX(hw->pf_id)),
 			&nsd->fd_atr_tunnel_match);
 
-	i40e_get_phy_lpi_status(hw, nsd);
-	i40e_lpi_stat_update(hw, pf->stat_offsets_loaded,
-			     &osd->tx_lpi_count, &nsd->tx_lpi_count,
-			     &osd->rx_lpi_count, &nsd->rx_lpi_count);
-	i40e_get_lpi_duration(hw, nsd,
-			      &nsd->tx_lpi_duration, &nsd->rx_lpi_duration);
-
 	if (pf->flags & I40E_FLAG_FD_SB_ENABLED &&
 	    !test_bit(__I40E_FD_SB_AUTO_DISABLED, pf->state))
 		nsd->fd_sb_status = true;
@@ -1301,43 +1528,156 @@ static void i40e_update_pf_stats(struct i40e_pf *pf)
 		nsd->fd_atr_status = true;
 	else
 		nsd->fd_atr_status = false;
+}
+
+/**
+ * i40e_update_pf_lpi_stats - Update the EEE low power idle stats
+ * @pf: the PF to be updated
+ *
+ * Some PHYs are only reachable through the admin queue, so this group is
+ * the most expensive one to refresh.
+ **/
+static void i40e_update_pf_lpi_stats(struct i40e_pf *pf)
+{
+	struct i40e_hw_port_stats *osd = &pf->stats_offsets;
+	struct i40e_hw_port_stats *nsd = &pf->stats;
+	struct i40e_hw *hw = &pf->hw;
+
+	i40e_get_phy_lpi_status(hw, nsd);
+	i40e_lpi_stat_update(hw, pf->stat_offsets_loaded,
+			     &osd->tx_lpi_count, &nsd->tx_lpi_count,
+			     &osd->rx_lpi_count, &nsd->rx_lpi_count);
+	i40e_get_lpi_duration(hw, nsd,
+			      &nsd->tx_lpi_duration, &nsd->rx_lpi_duration);
+}
+
+/* How long a group may go unread before the watchdog refreshes it anyway.
+ * 32 bit packet counters wrap after about 70 seconds at 40G line rate and
+ * the flow director matches have to be drained before they saturate.  The
+ * 48 bit size histograms take weeks to wrap.
+ */
+static const unsigned long i40e_stats_max_age[I40E_STATS_NUM_GROUPS] = {
+	[I40E_STATS_PORT]	= 30 * HZ,
+	[I40E_STATS_FC]		= 30 * HZ,
+	[I40E_STATS_SIZE]	= 3600 * HZ,
+	[I40E_STATS_FD]		= 30 * HZ,
+	[I40E_STATS_LPI]	= 60 * HZ,
+	[I40E_STATS_VSI]	= 30 * HZ,
+	[I40E_STATS_VEB]	= 30 * HZ,
+};
+
+/**
+ * i40e_stats_stale - Check whether a stats group is due for a refresh
+ * @refreshed: jiffies of the last refresh of the group
+ * @max_age: how old the group may be, in jiffies, 0 to always refresh
+ **/
+static bool i40e_stats_stale(unsigned long refreshed, unsigned long max_age)
+{
+	return !max_age || time_after_eq(jiffies, refreshed + max_age);
+}
+
+/**
+ * i40e_update_pf_stats - Update the PF statistics counters.
+ * @pf: the PF to be updated
+ * @groups: bitmap of the I40E_STATS_PF_GROUPS to refresh
+ * @max_age: refresh only groups older than this many jiffies, 0 for all
+ **/
+static void i40e_update_pf_stats(struct i40e_pf *pf, unsigned long groups,
+				 unsigned long max_age)
+{
+	unsigned long now = jiffies;
+	int group;
+
+	/* a single first pass loads the offsets of every group */
+	if (!pf->stat_offsets_loaded) {
+		groups = I40E_STATS_PF_GROUPS;
+		max_age = 0;
+	}
+
+	groups &= I40E_STATS_PF_GROUPS;
+	for_each_set_bit(group, &groups, I40E_STATS_NUM_GROUPS) {
+		if (!i40e_stats_stale(pf->stats_refreshed[group], max_age))
+			continue;
+
+		switch (group) {
+		case I40E_STATS_PORT:
+			i40e_update_pf_port_stats(pf);
+			break;
+		case I40E_STATS_FC:
+			i40e_update_pf_fc_stats(pf);
+			break;
+		case I40E_STATS_SIZE:
+			i40e_update_pf_size_stats(pf);
+			break;
+		case I40E_STATS_FD:
+			i40e_update_pf_fd_stats(pf);
+			break;
+		case I40E_STATS_LPI:
+			i40e_update_pf_lpi_stats(pf);
+			break;
+		}
+		pf->stats_refreshed[group] = now;
+	}
 
 	pf->stat_offsets_loaded = true;
 }
 
 /**
- * i40e_update_stats - Update the various statistics counters.
+ * i40e_update_stats_groups - Update some of the statistics counters.
  * @vsi: the VSI to be updated
+ * @groups: bitmap of enum i40e_stats_group to refresh
+ * @max_age: refresh only groups older than this many jiffies, 0 for all
  *
- * Update the various stats for this VSI and its related entities.
+ * The PF groups and the VEB the LAN VSI is attached to are only refreshed
+ * through the main VSI, which also pulls a few of the port error counters
+ * into its netdev stats.
  **/
-void i40e_update_stats(struct i40e_vsi *vsi)
+void i40e_update_stats_groups(struct i40e_vsi *vsi, unsigned long groups,
+			      unsigned long max_age)
 {
 	struct i40e_pf *pf = vsi->back;
+	struct i40e_veb *veb;
 
-	if (vsi == pf->vsi[pf->lan_vsi])
-		i40e_update_pf_stats(pf);
+	if (vsi == pf->vsi[pf->lan_vsi]) {
+		i40e_update_pf_stats(pf, groups, max_age);
 
-	i40e_update_vsi_stats(vsi);
+		veb = pf->lan_veb < I40E_MAX_VEB ? pf->veb[pf->lan_veb] : NULL;
+		if ((groups & BIT(I40E_STATS_VEB)) && veb &&
+		    (pf->flags & I40E_FLAG_VEB_STATS_ENABLED) &&
+		    (!veb->stat_offsets_loaded ||
+		     i40e_stats_stale(veb->stats_refreshed, max_age)))
+			i40e_update_veb_stats(veb);
+	}
+
+	if ((groups & BIT(I40E_STATS_VSI)) &&
+	    i40e_stats_stale(vsi->stats_refreshed, max_age))
+		i40e_update_vsi_stats(vsi);
+}
+
+/**
+ * i40e_update_stats - Update the various statistics counters.
+ * @vsi: the VSI to be updated
+ *
+ * Update the various stats for this VSI and its related entities.
+ **/
+void i40e_update_stats(struct i40e_vsi *vsi)
+{
+	i40e_update_stats_groups(vsi, I40E_STATS_PF_GROUPS |
+				 BIT(I40E_STATS_VSI), 0);
 }
 
 /**
  * i40e_count_filters - counts VSI mac filters
  * @vsi: the VSI to be searched
  *
+ * The count is maintained as filters are linked and unlinked, so this may be
+ * called without holding the mac_filter_hash_lock.
+ *
  * Returns count of mac filters
  **/
 int i40e_count_filters(struct i40e_vsi *vsi)
 {
-	struct i40e_mac_filter *f;
-	struct hlist_node *h;
-	int bkt;
-	int cnt = 0;
-
-	hash_for_each_safe(vsi->mac_filter_hash, bkt, h, f, hlist)
-		++cnt;
-
-	return cnt;
+	return READ_ONCE(vsi->num_mac_filters);
 }
 
 
@@ -1352,19 +1692,10 @@ int i40e_count_filters(struct i40e_vsi *vsi)
 struct i40e_mac_filter *i40e_find_filter(struct i40e_vsi *vsi,
 					 const u8 *macaddr, s16 vlan)
 {
-	struct i40e_mac_filter *f;
-	u64 key;
-
 	if (!vsi || !macaddr)
 		return NULL;
 
-	key = i40e_addr_to_hkey(macaddr);
-	hash_for_each_possible(vsi->mac_filter_hash, f, hlist, key) {
-		if ((ether_addr_equal(macaddr, f->macaddr)) &&
-		    (vlan == f->vlan))
-			return f;
-	}
-	return NULL;
+	return i40e_mac_filter_lookup(vsi, macaddr, vlan);
 }
 
 /**
@@ -1433,12 +1764,12 @@ bool i40e_is_vsi_in_vlan(struct i40e_vsi *vsi)
 	 *    i40e_add_filter.
 	 *
 	 * 2) the only place where filters are actually removed is in
-	 *    i40e_sync_filters_subtask.
+	 *    i40e_filter_sync_task.
 	 *
 	 * Thus, we can simply use a boolean value, has_vlan_filters which we
 	 * will set to true when we add a vlan filter in i40e_add_filter. Then
 	 * we have to perform the full search after deleting filters in
-	 * i40e_sync_filters_subtask, but we already have to search
+	 * i40e_filter_sync_task, but we already have to search
 	 * filters here and can perform the check at the same time. This
 	 * results in avoiding embedding a loop for vlan mode inside another
 	 * loop over all the filters, and should maintain correctness as noted
@@ -1503,9 +1834,10 @@ static int i40e_correct_mac_vlan_filters(struct i40e_vsi *vsi,
 	/* Update the filters about to be added in place */
 	hlist_for_each_entry(new_mac, tmp_add_list, hlist) {
 		if (vlan_filters && new_mac->f->vlan == I40E_VLAN_ANY)
-			new_mac->f->vlan = 0;
+			i40e_mac_filter_set_vlan(vsi, new_mac->f, 0);
 		else if (!vlan_filters && new_mac->f->vlan == 0)
-			new_mac->f->vlan = I40E_VLAN_ANY;
+			i40e_mac_filter_set_vlan(vsi, new_mac->f,
+						 I40E_VLAN_ANY);
 	}
 
 	/* Update the remaining active filters */
@@ -1541,7 +1873,7 @@ static int i40e_correct_mac_vlan_filters(struct i40e_vsi *vsi,
 
 			/* Put the original filter into the delete list */
 			f->state = I40E_FILTER_REMOVE;
-			hash_del(&f->hlist);
+			i40e_mac_filter_unlink(vsi, f);
 			hlist_add_head(&f->hlist, tmp_del_list);
 		}
 	}
@@ -1632,8 +1964,9 @@ static int i40e_correct_vf_mac_vlan_filters(struct i40e_vsi *vsi,
 	int bkt, new_vlan;
 
 	hlist_for_each_entry(new_mac, tmp_add_list, hlist) {
-		new_mac->f->vlan = i40e_get_vf_new_vlan(vsi, new_mac, NULL,
-							vlan_filters, trusted);
+		new_vlan = i40e_get_vf_new_vlan(vsi, new_mac, NULL,
+						vlan_filters, trusted);
+		i40e_mac_filter_set_vlan(vsi, new_mac->f, new_vlan);
 	}
 
 	hash_for_each_safe(vsi->mac_filter_hash, bkt, h, f, hlist) {
@@ -1656,7 +1989,7 @@ static int i40e_correct_vf_mac_vlan_filters(struct i40e_vsi *vsi,
 
 			/* Put the original filter into the delete list */
 			f->state = I40E_FILTER_REMOVE;
-			hash_del(&f->hlist);
+			i40e_mac_filter_unlink(vsi, f);
 			hlist_add_head(&f->hlist, tmp_del_list);
 		}
 	}
@@ -1682,6 +2015,7 @@ static int i40e_correct_vf_mac_vlan_filters(struct i40e_vsi *vsi,
 				add_head->vlan = 0;
 				add_head->state = I40E_FILTER_REMOVE;
 				INIT_HLIST_NODE(&add_head->hlist);
+				INIT_HLIST_NODE(&add_head->vlan_hlist);
 				/* Add the existing filter to the tmp del list,
 				 * it will be removed from FW in
 				 * sync_vsi_filters
@@ -1761,7 +2095,6 @@ struct i40e_mac_filter *i40e_add_filter(struct i40e_vsi *vsi,
 					const u8 *macaddr, s16 vlan)
 {
 	struct i40e_mac_filter *f;
-	u64 key;
 
 	if (!vsi || !macaddr)
 		return NULL;
@@ -1783,9 +2116,8 @@ struct i40e_mac_filter *i40e_add_filter(struct i40e_vsi *vsi,
 		f->state = I40E_FILTER_NEW;
 
 		INIT_HLIST_NODE(&f->hlist);
-
-		key = i40e_addr_to_hkey(macaddr);
-		hash_add(vsi->mac_filter_hash, &f->hlist, key);
+		INIT_HLIST_NODE(&f->vlan_hlist);
+		i40e_mac_filter_link(vsi, f);
 
 		vsi->flags |= I40E_VSI_FLAG_FILTER_CHANGED;
 		set_bit(__I40E_MACVLAN_SYNC_PENDING, vsi->back->state);
@@ -1966,7 +2298,7 @@ static int i40e_set_mac(struct net_device *netdev, void *p)
 	/* schedule our worker thread which will take care of
 	 * applying the new filter changes
 	 */
-	i40e_service_event_schedule(pf);
+	i40e_filter_sync_schedule(pf);
 	return 0;
 }
 
@@ -2369,7 +2701,7 @@ static void i40e_set_rx_mode(struct net_device *netdev)
 	/* schedule our worker thread which will take care of
 	 * applying the new filter changes
 	 */
-	i40e_service_event_schedule(vsi->back);
+	i40e_filter_sync_schedule(vsi->back);
 }
 
 /**
@@ -2387,11 +2719,9 @@ static void i40e_undo_del_filter_entries(struct i40e_vsi *vsi,
 	struct hlist_node *h;
 
 	hlist_for_each_entry_safe(f, h, from, hlist) {
-		u64 key = i40e_addr_to_hkey(f->macaddr);
-
 		/* Move the element back into MAC filter list*/
 		hlist_del(&f->hlist);
-		hash_add(vsi->mac_filter_hash, &f->hlist, key);
+		i40e_mac_filter_link(vsi, f);
 	}
 }
 
@@ -2718,14 +3048,17 @@ static void i40e_set_switch_mode(struct i40e_pf *pf, u8 l4type)
 }
 
 /**
- * i40e_sync_vsi_filters - Update the VSI filter list to the HW
+ * __i40e_sync_vsi_filters - Update the VSI filter list to the HW
  * @vsi: ptr to the VSI
+ * @aq_buf: buffer of hw->aq.asq_buf_size bytes for the AQ element lists, or
+ *	    NULL to allocate one for this call
  *
- * Push any outstanding VSI filter changes through the AdminQ.
+ * Push any outstanding VSI filter changes through the AdminQ. The caller must
+ * own the __I40E_VSI_SYNCING_FILTERS bit of the VSI.
  *
  * Returns 0 or error value
  **/
-int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
+static int __i40e_sync_vsi_filters(struct i40e_vsi *vsi, void *aq_buf)
 {
 	struct i40e_new_mac_filter *new_mac, *add_head = NULL;
 	struct hlist_head tmp_add_list, tmp_del_list;
@@ -2751,8 +3084,6 @@ int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
 	struct i40e_aqc_add_macvlan_element_data *add_list;
 	struct i40e_aqc_remove_macvlan_element_data *del_list;
 
-	while (test_and_set_bit(__I40E_VSI_SYNCING_FILTERS, vsi->state))
-		usleep_range(1000, 2000);
 	pf = vsi->back;
 
 	old_overflow = test_bit(__I40E_VSI_OVERFLOW_PROMISC, vsi->state);
@@ -2778,7 +3109,7 @@ int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
 		hash_for_each_safe(vsi->mac_filter_hash, bkt, h, f, hlist) {
 			if (f->state == I40E_FILTER_REMOVE) {
 				/* Move the element into temporary del_list */
-				hash_del(&f->hlist);
+				i40e_mac_filter_unlink(vsi, f);
 				hlist_add_head(&f->hlist, &tmp_del_list);
 
 				/* Avoid counting removed filters */
@@ -2829,10 +3160,15 @@ int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
 			    sizeof(struct i40e_aqc_remove_macvlan_element_data);
 		list_size = filter_list_len *
 			    sizeof(struct i40e_aqc_remove_macvlan_element_data);
-		del_list = (struct i40e_aqc_remove_macvlan_element_data *)
-			kzalloc(list_size, GFP_ATOMIC);
-		if (!del_list)
-			goto err_no_memory;
+		if (aq_buf) {
+			del_list = aq_buf;
+			memset(del_list, 0, list_size);
+		} else {
+			del_list = (struct i40e_aqc_remove_macvlan_element_data *)
+				kzalloc(list_size, GFP_ATOMIC);
+			if (!del_list)
+				goto err_no_memory;
+		}
 
 		hlist_for_each_entry_safe(f, h, &tmp_del_list, hlist) {
 			cmd_flags = 0;
@@ -2865,7 +3201,7 @@ int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
 			if (num_del == filter_list_len) {
 				i40e_aqc_del_filters(vsi, vsi_name, del_list,
 						     num_del, &retval);
-				memset(del_list, 0, list_size);
+				memset(del_list, 0, num_del * sizeof(*del_list));
 				num_del = 0;
 			}
 			/* Release memory for MAC filter entries which were
@@ -2880,7 +3216,8 @@ int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
 					     num_del, &retval);
 		}
 
-		kfree(del_list);
+		if (!aq_buf)
+			kfree(del_list);
 		del_list = NULL;
 	}
 
@@ -2890,10 +3227,15 @@ int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
 			       sizeof(struct i40e_aqc_add_macvlan_element_data);
 		list_size = filter_list_len *
 			       sizeof(struct i40e_aqc_add_macvlan_element_data);
-		add_list = (struct i40e_aqc_add_macvlan_element_data *)
-			kzalloc(list_size, GFP_ATOMIC);
-		if (!add_list)
-			goto err_no_memory;
+		if (aq_buf) {
+			add_list = aq_buf;
+			memset(add_list, 0, list_size);
+		} else {
+			add_list = (struct i40e_aqc_add_macvlan_element_data *)
+				kzalloc(list_size, GFP_ATOMIC);
+			if (!add_list)
+				goto err_no_memory;
+		}
 
 		num_add = 0;
 		hlist_for_each_entry_safe(new_mac, h, &tmp_add_list, hlist) {
@@ -2935,7 +3277,7 @@ int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
 			if (num_add == filter_list_len) {
 				i40e_aqc_add_filters(vsi, vsi_name, add_list,
 						     add_head, num_add);
-				memset(add_list, 0, list_size);
+				memset(add_list, 0, num_add * sizeof(*add_list));
 				num_add = 0;
 			}
 		}
@@ -2958,7 +3300,8 @@ int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
 			kfree(new_mac);
 		}
 		spin_unlock_bh(&vsi->mac_filter_hash_lock);
-		kfree(add_list);
+		if (!aq_buf)
+			kfree(add_list);
 		add_list = NULL;
 	}
 
@@ -3044,7 +3387,6 @@ out:
 	if (retval)
 		vsi->flags |= I40E_VSI_FLAG_FILTER_CHANGED;
 
-	clear_bit(__I40E_VSI_SYNCING_FILTERS, vsi->state);
 	return retval;
 
 err_no_memory:
@@ -3055,38 +3397,114 @@ err_no_memory_locked:
 	i40e_undo_add_filter_entries(vsi, &tmp_add_list);
 	spin_unlock_bh(&vsi->mac_filter_hash_lock);
 
-	vsi->flags |= I40E_VSI_FLAG_FILTER_CHANGED;
+	vsi->flags |= I40E_VSI_FLAG_FILTER_CHANGED;
+	return -ENOMEM;
+}
+
+/**
+ * i40e_sync_vsi_filters_buf - Update the VSI filter list to the HW
+ * @vsi: ptr to the VSI
+ * @aq_buf: AQ buffer of asq_buf_size bytes to reuse, or NULL
+ *
+ * Push any outstanding VSI filter changes through the AdminQ, waiting for
+ * any sync already in progress on this VSI to finish first. Callers
+ * syncing several VSIs in a row pass one buffer to all of them.
+ *
+ * Returns 0 or error value
+ **/
+int i40e_sync_vsi_filters_buf(struct i40e_vsi *vsi, void *aq_buf)
+{
+	int ret;
+
+	while (test_and_set_bit(__I40E_VSI_SYNCING_FILTERS, vsi->state))
+		usleep_range(1000, 2000);
+
+	ret = __i40e_sync_vsi_filters(vsi, aq_buf);
+
 	clear_bit(__I40E_VSI_SYNCING_FILTERS, vsi->state);
-	return -ENOMEM;
+	return ret;
+}
+
+/**
+ * i40e_sync_vsi_filters - Update the VSI filter list to the HW
+ * @vsi: ptr to the VSI
+ *
+ * Returns 0 or error value
+ **/
+int i40e_sync_vsi_filters(struct i40e_vsi *vsi)
+{
+	return i40e_sync_vsi_filters_buf(vsi, NULL);
 }
 
 /**
- * i40e_sync_filters_subtask - Sync the VSI filter list with HW
+ * i40e_filter_sync_schedule - Schedule the filter sync task
  * @pf: board private structure
  **/
-static void i40e_sync_filters_subtask(struct i40e_pf *pf)
+void i40e_filter_sync_schedule(struct i40e_pf *pf)
+{
+	if (!test_bit(__I40E_DOWN, pf->state) &&
+	    !test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state) &&
+	    !test_bit(__I40E_RECOVERY_MODE, pf->state))
+		queue_work(i40e_wq, &pf->filter_sync_task);
+}
+
+/**
+ * i40e_filter_sync_task - Sync the VSI filter lists with HW
+ * @work: pointer to work_struct containing our data
+ *
+ * Walks every VSI once per pass so that changes made to several VSIs since
+ * the last pass are pushed together, reusing one AQ buffer throughout. VSIs
+ * without pending changes are skipped on the flag alone, and a VSI already
+ * being synced by someone else is left for the next pass instead of waiting.
+ **/
+static void i40e_filter_sync_task(struct work_struct *work)
 {
+	struct i40e_pf *pf = container_of(work,
+					  struct i40e_pf,
+					  filter_sync_task);
+	bool retry = false;
 	int v;
 
-	if (!pf)
+	if (test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state) ||
+	    test_bit(__I40E_SUSPENDED, pf->state) ||
+	    test_bit(__I40E_RECOVERY_MODE, pf->state))
 		return;
 
 	if (!test_and_clear_bit(__I40E_MACVLAN_SYNC_PENDING, pf->state))
 		return;
 
+	/* On failure each call simply allocates its own buffer */
+	if (!pf->filter_sync_buf)
+		pf->filter_sync_buf = kzalloc(pf->hw.aq.asq_buf_size,
+					      GFP_KERNEL);
+
 	for (v = 0; v < pf->num_alloc_vsi; v++) {
-		if (pf->vsi[v] &&
-		    (pf->vsi[v]->flags & I40E_VSI_FLAG_FILTER_CHANGED) &&
-		    !test_bit(__I40E_VSI_RELEASING, pf->vsi[v]->state)) {
-			int ret = i40e_sync_vsi_filters(pf->vsi[v]);
-			if (ret) {
-				/* come back and try again later */
-				set_bit(__I40E_MACVLAN_SYNC_PENDING,
-					pf->state);
-				break;
-			}
+		struct i40e_vsi *vsi = pf->vsi[v];
+
+		if (!vsi || !(READ_ONCE(vsi->flags) &
+			      I40E_VSI_FLAG_FILTER_CHANGED) ||
+		    test_bit(__I40E_VSI_RELEASING, vsi->state))
+			continue;
+
+		if (test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state)) {
+			retry = true;
+			break;
 		}
+
+		if (test_and_set_bit(__I40E_VSI_SYNCING_FILTERS, vsi->state)) {
+			retry = true;
+			continue;
+		}
+
+		if (__i40e_sync_vsi_filters(vsi, pf->filter_sync_buf))
+			retry = true;
+
+		clear_bit(__I40E_VSI_SYNCING_FILTERS, vsi->state);
 	}
+
+	/* come back and try again later, the service task kicks us */
+	if (retry)
+		set_bit(__I40E_MACVLAN_SYNC_PENDING, pf->state);
 }
 
 /**
@@ -3114,6 +3532,7 @@ static int i40e_change_mtu(struct net_device *netdev, int new_mtu)
 	int max_frame = new_mtu + I40E_PACKET_HDR_PAD;
 	struct i40e_vsi *vsi = np->vsi;
 	struct i40e_pf *pf = vsi->back;
+	u16 rx_max_frame, rx_buf_len;
 
 	/* MTU < 68 is an error and causes problems on some kernels */
 	if ((new_mtu < 68) || (max_frame > I40E_MAX_RXBUFFER))
@@ -3149,8 +3568,23 @@ static int i40e_change_mtu(struct net_device *netdev, int new_mtu)
 	netdev_info(netdev, "changing MTU from %d to %d\n",
 		    netdev->mtu, new_mtu);
 	netdev->mtu = new_mtu;
-	if (netif_running(netdev))
-		i40e_vsi_reinit_locked(vsi);
+	if (!netif_running(netdev))
+		goto out;
+
+	/* As long as the Rx buffers fit the new MTU the queue contexts stay
+	 * as they are and nothing needs to be restarted.
+	 */
+	i40e_vsi_calc_rx_buf_len(vsi, &rx_max_frame, &rx_buf_len);
+	if (rx_max_frame == vsi->max_frame && rx_buf_len == vsi->rx_buf_len)
+		goto out;
+
+#ifdef HAVE_XDP_SUPPORT
+	if (!i40e_vsi_restart_queue_pairs(vsi, rx_max_frame, rx_buf_len))
+		goto out;
+
+#endif
+	i40e_vsi_reinit_locked(vsi);
+out:
 	set_bit(__I40E_CLIENT_SERVICE_REQUESTED, pf->state);
 	set_bit(__I40E_CLIENT_L2_CHANGE, pf->state);
 	return 0;
@@ -3463,7 +3897,7 @@ int i40e_vsi_add_vlan(struct i40e_vsi *vsi, u16 vid)
 	/* schedule our worker thread which will take care of
 	 * applying the new filter changes
 	 */
-	i40e_service_event_schedule(vsi->back);
+	i40e_filter_sync_schedule(vsi->back);
 	return 0;
 }
 
@@ -3509,7 +3943,7 @@ void i40e_vsi_kill_vlan(struct i40e_vsi *vsi, u16 vid)
 	/* schedule our worker thread which will take care of
 	 * applying the new filter changes
 	 */
-	i40e_service_event_schedule(vsi->back);
+	i40e_filter_sync_schedule(vsi->back);
 }
 
 /**
@@ -4309,6 +4743,7 @@ static int i40e_configure_rx_ring(struct i40e_ring *ring)
 		clear_ring_build_skb_enabled(ring);
 	else
 		set_ring_build_skb_enabled(ring);
+	i40e_set_clean_rx_irq(ring);
 
 	/* cache tail for quicker writes, and clear the reg before use */
 	ring->tail = hw->hw_addr + I40E_QRX_TAIL(pf_q);
@@ -4375,42 +4810,54 @@ static int i40e_vsi_configure_tx(struct i40e_vsi *vsi)
 }
 
 /**
- * i40e_vsi_configure_rx - Configure the VSI for Rx
+ * i40e_vsi_calc_rx_buf_len - Work out the Rx buffer layout for the MTU
  * @vsi: the VSI being configured
- *
- * Configure the Rx VSI for operation.
+ * @max_frame: returns the largest frame the Rx queues accept
+ * @rx_buf_len: returns the size of the Rx buffers
  **/
-static int i40e_vsi_configure_rx(struct i40e_vsi *vsi)
+static void i40e_vsi_calc_rx_buf_len(struct i40e_vsi *vsi, u16 *max_frame,
+				     u16 *rx_buf_len)
 {
-	int err = 0;
-	u16 i;
 #ifdef CONFIG_I40E_DISABLE_PACKET_SPLIT
-	u16 max_frame = I40E_RXBUFFER_1536 - NET_IP_ALIGN;
+	*max_frame = I40E_RXBUFFER_1536 - NET_IP_ALIGN;
 
 	if (!vsi->netdev)
-		max_frame = I40E_RXBUFFER_2048;
-	else if (vsi->netdev->mtu + I40E_PACKET_HDR_PAD > max_frame)
-		max_frame = vsi->netdev->mtu + I40E_PACKET_HDR_PAD;
+		*max_frame = I40E_RXBUFFER_2048;
+	else if (vsi->netdev->mtu + I40E_PACKET_HDR_PAD > *max_frame)
+		*max_frame = vsi->netdev->mtu + I40E_PACKET_HDR_PAD;
 
-	vsi->max_frame = max_frame;
-	vsi->rx_buf_len = max_frame;
+	*rx_buf_len = *max_frame;
 #else /* CONFIG_I40E_DISABLE_PACKET_SPLIT */
 
 	if (!vsi->netdev || (vsi->back->flags & I40E_FLAG_LEGACY_RX)) {
-		vsi->max_frame = I40E_MAX_RXBUFFER;
-		vsi->rx_buf_len = I40E_RXBUFFER_2048;
+		*max_frame = I40E_MAX_RXBUFFER;
+		*rx_buf_len = I40E_RXBUFFER_2048;
 #if (PAGE_SIZE < 8192)
 	} else if (!I40E_2K_TOO_SMALL_WITH_PADDING &&
 		   (vsi->netdev->mtu <= ETH_DATA_LEN)) {
-		vsi->max_frame = I40E_RXBUFFER_1536 - NET_IP_ALIGN;
-		vsi->rx_buf_len = I40E_RXBUFFER_1536 - NET_IP_ALIGN;
+		*max_frame = I40E_RXBUFFER_1536 - NET_IP_ALIGN;
+		*rx_buf_len = I40E_RXBUFFER_1536 - NET_IP_ALIGN;
 #endif
 	} else {
-		vsi->max_frame = I40E_MAX_RXBUFFER;
-		vsi->rx_buf_len = (PAGE_SIZE < 8192) ? I40E_RXBUFFER_3072 :
-						       I40E_RXBUFFER_2048;
+		*max_frame = I40E_MAX_RXBUFFER;
+		*rx_buf_len = (PAGE_SIZE < 8192) ? I40E_RXBUFFER_3072 :
+						   I40E_RXBUFFER_2048;
 	}
 #endif /* CONFIG_I40E_DISABLE_PACKET_SPLIT */
+}
+
+/**
+ * i40e_vsi_configure_rx - Configure the VSI for Rx
+ * @vsi: the VSI being configured
+ *
+ * Configure the Rx VSI for operation.
+ **/
+static int i40e_vsi_configure_rx(struct i40e_vsi *vsi)
+{
+	int err = 0;
+	u16 i;
+
+	i40e_vsi_calc_rx_buf_len(vsi, &vsi->max_frame, &vsi->rx_buf_len);
 
 	/* set up individual rings */
 	for (i = 0; i < vsi->num_queue_pairs && !err; i++)
@@ -4495,7 +4942,9 @@ static void i40e_fdir_filter_restore(struct i40e_vsi *vsi)
 {
 	struct i40e_fdir_filter *filter;
 	struct i40e_pf *pf = vsi->back;
+	struct i40e_fdir_bulk bulk;
 	struct hlist_node *node;
+	bool use_bulk;
 
 	if (!(pf->flags & I40E_FLAG_FD_SB_ENABLED))
 		return;
@@ -4503,10 +4952,22 @@ static void i40e_fdir_filter_restore(struct i40e_vsi *vsi)
 	/* reset FDIR counters as we're replaying all existing filters */
 	i40e_reset_fdir_filter_cnt(pf);
 
+	/* queue the whole list on the FDIR ring instead of waiting on the
+	 * ring once per filter, fall back to the one by one path if the
+	 * bulk resources are not available
+	 */
+	use_bulk = !i40e_fdir_bulk_begin(pf, &bulk);
+
 	hlist_for_each_entry_safe(filter, node,
 				  &pf->fdir_filter_list, fdir_node) {
+		/* only a full ring leaves the filter untouched for a retry */
+		if (use_bulk && i40e_fdir_bulk_add(&bulk, filter, true) != -EAGAIN)
+			continue;
 		i40e_add_del_fdir(vsi, filter, true);
 	}
+
+	if (use_bulk)
+		i40e_fdir_bulk_commit(&bulk);
 }
 
 /**
@@ -4738,6 +5199,7 @@ static int i40e_vsi_configure(struct i40e_vsi *vsi)
 {
 	int err;
 
+	i40e_tx_keys_update(vsi->back, true);
 	i40e_set_vsi_rx_mode(vsi);
 	i40e_restore_vlan(vsi);
 	i40e_vsi_config_dcb_rings(vsi);
@@ -4749,74 +5211,90 @@ static int i40e_vsi_configure(struct i40e_vsi *vsi)
 }
 
 /**
- * i40e_vsi_configure_msix - MSIX mode Interrupt Config in the HW
+ * i40e_vsi_configure_msix_vector - MSIX mode Interrupt Config of one vector
  * @vsi: the VSI being configured
+ * @v_idx: index of the q_vector in the VSI
+ * @qp: first PF queue of the q_vector
+ *
+ * Programs the ITR and rate limit of the vector and links the interrupt
+ * causes of its num_ringpairs queue pairs, starting at @qp.
  **/
-static void i40e_vsi_configure_msix(struct i40e_vsi *vsi)
+static void i40e_vsi_configure_msix_vector(struct i40e_vsi *vsi, int v_idx,
+					   u32 qp)
 {
+	struct i40e_q_vector *q_vector = vsi->q_vectors[v_idx];
 	bool has_xdp = i40e_enabled_xdp_vsi(vsi);
+	u16 vector = vsi->base_vector + v_idx;
 	struct i40e_pf *pf = vsi->back;
 	struct i40e_hw *hw = &pf->hw;
-	u16 vector;
-	int i, q;
-	u32 qp;
+	int q;
 
 	/* The interrupt indexing is offset by 1 in the PFINT_ITRn
 	 * and PFINT_LNKLSTn registers, e.g.:
 	 *   PFINT_ITRn[0..n-1] gets msix-1..msix-n  (qpair interrupts)
 	 */
-	qp = vsi->base_queue;
-	vector = vsi->base_vector;
-	for (i = 0; i < vsi->num_q_vectors; i++, vector++) {
-		struct i40e_q_vector *q_vector = vsi->q_vectors[i];
-
-		q_vector->rx.next_update = jiffies + 1;
-		q_vector->rx.target_itr =
-			ITR_TO_REG(vsi->rx_rings[i]->itr_setting);
-		wr32(hw, I40E_PFINT_ITRN(I40E_RX_ITR, vector - 1),
-		     q_vector->rx.target_itr >> 1);
-		q_vector->rx.current_itr = q_vector->rx.target_itr;
-
-		q_vector->tx.next_update = jiffies + 1;
-		q_vector->tx.target_itr =
-			ITR_TO_REG(vsi->tx_rings[i]->itr_setting);
-		wr32(hw, I40E_PFINT_ITRN(I40E_TX_ITR, vector - 1),
-		     q_vector->tx.target_itr >> 1);
-		q_vector->tx.current_itr = q_vector->tx.target_itr;
-
-		wr32(hw, I40E_PFINT_RATEN(vector - 1),
-		     i40e_intrl_usec_to_reg(vsi->int_rate_limit));
-
-		/* begin of linked list for RX queue assigned to this vector */
-		wr32(hw, I40E_PFINT_LNKLSTN(vector - 1), qp);
-		for (q = 0; q < q_vector->num_ringpairs; q++) {
-			u32 nextqp = has_xdp ? qp + vsi->alloc_queue_pairs : qp;
-			u32 val;
-
-			/* RX queue in linked list with next queue set to TX */
-			val = I40E_QINT_RQCTL_VAL(nextqp, vector, TX);
-			wr32(hw, I40E_QINT_RQCTL(qp), val);
-
-			if (has_xdp) {
-				/* TX queue with next queue set to TX */
-				val = I40E_QINT_TQCTL_VAL(qp, vector, TX);
-				wr32(hw, I40E_QINT_TQCTL(nextqp), val);
-			}
+	q_vector->rx.next_update = jiffies + 1;
+	q_vector->rx.target_itr =
+		ITR_TO_REG(vsi->rx_rings[v_idx]->itr_setting);
+	wr32(hw, I40E_PFINT_ITRN(I40E_RX_ITR, vector - 1),
+	     q_vector->rx.target_itr >> 1);
+	q_vector->rx.current_itr = q_vector->rx.target_itr;
 
-			/* TX queue with next RX or end of linked list */
-			val = I40E_QINT_TQCTL_VAL((qp + 1), vector, RX);
+	q_vector->tx.next_update = jiffies + 1;
+	q_vector->tx.target_itr =
+		ITR_TO_REG(vsi->tx_rings[v_idx]->itr_setting);
+	wr32(hw, I40E_PFINT_ITRN(I40E_TX_ITR, vector - 1),
+	     q_vector->tx.target_itr >> 1);
+	q_vector->tx.current_itr = q_vector->tx.target_itr;
+
+	wr32(hw, I40E_PFINT_RATEN(vector - 1),
+	     i40e_intrl_usec_to_reg(vsi->int_rate_limit));
+
+	/* begin of linked list for RX queue assigned to this vector */
+	wr32(hw, I40E_PFINT_LNKLSTN(vector - 1), qp);
+	for (q = 0; q < q_vector->num_ringpairs; q++) {
+		u32 nextqp = has_xdp ? qp + vsi->alloc_queue_pairs : qp;
+		u32 val;
 
-			/* Terminate the linked list */
-			if (q == (q_vector->num_ringpairs - 1))
-				val |= (I40E_QUEUE_END_OF_LIST
-					   << I40E_QINT_TQCTL_NEXTQ_INDX_SHIFT);
+		/* RX queue in linked list with next queue set to TX */
+		val = I40E_QINT_RQCTL_VAL(nextqp, vector, TX);
+		wr32(hw, I40E_QINT_RQCTL(qp), val);
 
-			wr32(hw, I40E_QINT_TQCTL(qp), val);
-			qp++;
+		if (has_xdp) {
+			/* TX queue with next queue set to TX */
+			val = I40E_QINT_TQCTL_VAL(qp, vector, TX);
+			wr32(hw, I40E_QINT_TQCTL(nextqp), val);
 		}
+
+		/* TX queue with next RX or end of linked list */
+		val = I40E_QINT_TQCTL_VAL((qp + 1), vector, RX);
+
+		/* Terminate the linked list */
+		if (q == (q_vector->num_ringpairs - 1))
+			val |= (I40E_QUEUE_END_OF_LIST
+				   << I40E_QINT_TQCTL_NEXTQ_INDX_SHIFT);
+
+		wr32(hw, I40E_QINT_TQCTL(qp), val);
+		qp++;
 	}
+}
 
-	i40e_flush(hw);
+/**
+ * i40e_vsi_configure_msix - MSIX mode Interrupt Config in the HW
+ * @vsi: the VSI being configured
+ **/
+static void i40e_vsi_configure_msix(struct i40e_vsi *vsi)
+{
+	struct i40e_pf *pf = vsi->back;
+	u32 qp = vsi->base_queue;
+	int i;
+
+	for (i = 0; i < vsi->num_q_vectors; i++) {
+		i40e_vsi_configure_msix_vector(vsi, i, qp);
+		qp += vsi->q_vectors[i]->num_ringpairs;
+	}
+
+	i40e_flush(&pf->hw);
 }
 
 /**
@@ -4943,6 +5421,10 @@ static irqreturn_t i40e_msix_clean_rings(int irq, void *data)
 	if (!q_vector->tx.ring && !q_vector->rx.ring)
 		return IRQ_HANDLED;
 
+	if (static_branch_unlikely(&i40e_napi_hist_key) &&
+	    !READ_ONCE(q_vector->napi_hist.irq_ns))
+		WRITE_ONCE(q_vector->napi_hist.irq_ns, ktime_get_ns());
+
 	napi_schedule_irqoff(&q_vector->napi);
 
 	return IRQ_HANDLED;
@@ -4977,6 +5459,52 @@ static void i40e_irq_affinity_notify(struct irq_affinity_notify *notify,
 static void i40e_irq_affinity_release(struct kref *ref) {}
 #endif /* HAVE_IRQ_AFFINITY_NOTIFY */
 
+/**
+ * i40e_vsi_request_q_vector_irq - Request the IRQ of one q_vector
+ * @vsi: the VSI being configured
+ * @v_idx: index of the q_vector in the VSI, its name already set
+ **/
+static int i40e_vsi_request_q_vector_irq(struct i40e_vsi *vsi, int v_idx)
+{
+	struct i40e_q_vector *q_vector = vsi->q_vectors[v_idx];
+	struct i40e_pf *pf = vsi->back;
+	int irq_num, err;
+#ifdef HAVE_IRQ_AFFINITY_HINT
+	int cpu;
+#endif
+
+	irq_num = pf->msix_entries[vsi->base_vector + v_idx].vector;
+	err = request_irq(irq_num,
+			  vsi->irq_handler,
+			  0,
+			  q_vector->name,
+			  q_vector);
+	if (err) {
+		dev_info(&pf->pdev->dev,
+			 "MSIX request_irq failed, error: %d\n", err);
+		return err;
+	}
+
+#ifdef HAVE_IRQ_AFFINITY_NOTIFY
+	/* register for affinity change notifications */
+	q_vector->affinity_notify.notify = i40e_irq_affinity_notify;
+	q_vector->affinity_notify.release = i40e_irq_affinity_release;
+	irq_set_affinity_notifier(irq_num, &q_vector->affinity_notify);
+#endif
+#ifdef HAVE_IRQ_AFFINITY_HINT
+	/* Spread affinity hints out across online CPUs.
+	 *
+	 * get_cpu_mask returns a static constant mask with
+	 * a permanent lifetime so it's ok to pass to
+	 * irq_set_affinity_hint without making a copy.
+	 */
+	cpu = cpumask_local_spread(q_vector->v_idx, -1);
+	irq_set_affinity_hint(irq_num, get_cpu_mask(cpu));
+#endif /* HAVE_IRQ_AFFINITY_HINT */
+
+	return 0;
+}
+
 /**
  * i40e_vsi_request_irq_msix - Initialize MSI-X interrupts
  * @vsi: the VSI being configured
@@ -4993,15 +5521,10 @@ int i40e_vsi_request_irq_msix(struct i40e_vsi *vsi, char *basename)
 	int tx_int_idx = 0;
 	int vector, err;
 	int irq_num;
-#ifdef HAVE_IRQ_AFFINITY_HINT
-	int cpu;
-#endif
 
 	for (vector = 0; vector < q_vectors; vector++) {
 		struct i40e_q_vector *q_vector = vsi->q_vectors[vector];
 
-		irq_num = pf->msix_entries[base + vector].vector;
-
 		if (q_vector->tx.ring && q_vector->rx.ring) {
 			snprintf(q_vector->name, sizeof(q_vector->name) - 1,
 				 "%s-%s-%d", basename, "TxRx", rx_int_idx++);
@@ -5016,33 +5539,9 @@ int i40e_vsi_request_irq_msix(struct i40e_vsi *vsi, char *basename)
 			/* skip this unused q_vector */
 			continue;
 		}
-		err = request_irq(irq_num,
-				  vsi->irq_handler,
-				  0,
-				  q_vector->name,
-				  q_vector);
-		if (err) {
-			dev_info(&pf->pdev->dev,
-				 "MSIX request_irq failed, error: %d\n", err);
+		err = i40e_vsi_request_q_vector_irq(vsi, vector);
+		if (err)
 			goto free_queue_irqs;
-		}
-
-#ifdef HAVE_IRQ_AFFINITY_NOTIFY
-		/* register for affinity change notifications */
-		q_vector->affinity_notify.notify = i40e_irq_affinity_notify;
-		q_vector->affinity_notify.release = i40e_irq_affinity_release;
-		irq_set_affinity_notifier(irq_num, &q_vector->affinity_notify);
-#endif
-#ifdef HAVE_IRQ_AFFINITY_HINT
-		/* Spread affinity hints out across online CPUs.
-		 *
-		 * get_cpu_mask returns a static constant mask with
-		 * a permanent lifetime so it's ok to pass to
-		 * irq_set_affinity_hint without making a copy.
-		 */
-		cpu = cpumask_local_spread(q_vector->v_idx, -1);
-		irq_set_affinity_hint(irq_num, get_cpu_mask(cpu));
-#endif /* HAVE_IRQ_AFFINITY_HINT */
 	}
 
 	vsi->irqs_ready = true;
@@ -5201,6 +5700,7 @@ static irqreturn_t i40e_intr(int irq, void *data)
 		ena_mask &= ~I40E_PFINT_ICR0_ENA_ADMINQ_MASK;
 		set_bit(__I40E_ADMINQ_EVENT_PENDING, pf->state);
 		i40e_debug(&pf->hw, I40E_DEBUG_NVM, "AdminQ event\n");
+		i40e_adminq_event_schedule(pf);
 	}
 
 	if (icr0 & I40E_PFINT_ICR0_MAL_DETECT_MASK) {
@@ -5225,6 +5725,7 @@ static irqreturn_t i40e_intr(int irq, void *data)
 		if (!test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state))
 			set_bit(__I40E_RESET_INTR_RECEIVED, pf->state);
 		ena_mask &= ~I40E_PFINT_ICR0_ENA_GRST_MASK;
+		set_bit(__I40E_PORT_STATE_LOST, pf->state);
 		val = rd32(hw, I40E_GLGEN_RSTAT);
 		val = (val & I40E_GLGEN_RSTAT_RESET_TYPE_MASK)
 		       >> I40E_GLGEN_RSTAT_RESET_TYPE_SHIFT;
@@ -5304,8 +5805,10 @@ static bool i40e_clean_fdir_tx_irq(struct i40e_ring *tx_ring, int budget)
 	u16 i = tx_ring->next_to_clean;
 	struct i40e_tx_buffer *tx_buf;
 	struct i40e_tx_desc *tx_desc;
+	struct i40e_tx_dma *tx_dma;
 
 	tx_buf = &tx_ring->tx_bi[i];
+	tx_dma = &tx_ring->tx_dma[i];
 	tx_desc = I40E_TX_DESC(tx_ring, i);
 	i -= tx_ring->count;
 
@@ -5331,35 +5834,42 @@ static bool i40e_clean_fdir_tx_irq(struct i40e_ring *tx_ring, int budget)
 		tx_desc->cmd_type_offset_bsz = 0;
 		/* move past filter desc */
 		tx_buf++;
+		tx_dma++;
 		tx_desc++;
 		i++;
 		if (unlikely(!i)) {
 			i -= tx_ring->count;
 			tx_buf = tx_ring->tx_bi;
+			tx_dma = tx_ring->tx_dma;
 			tx_desc = I40E_TX_DESC(tx_ring, 0);
 		}
-		/* unmap skb header data */
-		dma_unmap_single(tx_ring->dev,
-				 dma_unmap_addr(tx_buf, dma),
-				 dma_unmap_len(tx_buf, len),
-				 DMA_TO_DEVICE);
+		/* unmap skb header data, arena packets stay mapped */
+		if (dma_unmap_len(tx_dma, len))
+			dma_unmap_single(tx_ring->dev,
+					 dma_unmap_addr(tx_dma, dma),
+					 dma_unmap_len(tx_dma, len),
+					 DMA_TO_DEVICE);
 		if (tx_buf->tx_flags & I40E_TX_FLAGS_FD_SB)
 			kfree(tx_buf->raw_buf);
+		else if (tx_buf->tx_flags & I40E_TX_FLAGS_FD_SB_ARENA)
+			vsi->back->fd_sb_bulk_done++;
 
 		tx_buf->raw_buf = NULL;
 		tx_buf->tx_flags = 0;
 		tx_buf->next_to_watch = NULL;
-		dma_unmap_len_set(tx_buf, len, 0);
+		dma_unmap_len_set(tx_dma, len, 0);
 		tx_desc->buffer_addr = 0;
 		tx_desc->cmd_type_offset_bsz = 0;
 
 		/* move us past the eop_desc for start of next FD desc */
 		tx_buf++;
+		tx_dma++;
 		tx_desc++;
 		i++;
 		if (unlikely(!i)) {
 			i -= tx_ring->count;
 			tx_buf = tx_ring->tx_bi;
+			tx_dma = tx_ring->tx_dma;
 			tx_desc = I40E_TX_DESC(tx_ring, 0);
 		}
 
@@ -5627,35 +6137,84 @@ int i40e_control_wait_tx_q(int seid, struct i40e_pf *pf, int pf_q,
 	return ret;
 }
 
+/**
+ * i40e_vsi_wait_queues - Wait for all Tx or Rx queues of a VSI
+ * @vsi: the VSI being configured
+ * @tx: wait for the Tx queues, XDP ones included, rather than the Rx queues
+ * @enable: enable or disable state of the queues
+ *
+ * Polls the queues in order, never looking at a queue again once it reached
+ * the requested state. The retry budget is the one of a single queue, and is
+ * only spent while no queue makes progress, so the wait is bounded by the
+ * slowest queue rather than by the sum of all of them.
+ * Returns -ETIMEDOUT in case a queue fails to reach the requested state;
+ * else will return 0 in case of success.
+ **/
+static int i40e_vsi_wait_queues(struct i40e_vsi *vsi, bool tx, bool enable)
+{
+	u32 stat = tx ? I40E_QTX_ENA_QENA_STAT_MASK : I40E_QRX_ENA_QENA_STAT_MASK;
+	struct i40e_pf *pf = vsi->back;
+	int n = vsi->num_queue_pairs;
+	int i = 0, retries = 0;
+	bool is_xdp = false;
+	int pf_q;
+	u32 reg;
+
+	if (tx && i40e_enabled_xdp_vsi(vsi))
+		n *= 2;
+
+	while (i < n) {
+		/* XDP Tx queues follow the regular ones */
+		is_xdp = i >= vsi->num_queue_pairs;
+		pf_q = vsi->base_queue + i;
+		if (is_xdp)
+			pf_q += vsi->alloc_queue_pairs - vsi->num_queue_pairs;
+
+		reg = rd32(&pf->hw, tx ? I40E_QTX_ENA(pf_q) : I40E_QRX_ENA(pf_q));
+		if (enable == !!(reg & stat)) {
+			retries = 0;
+			i++;
+			continue;
+		}
+
+		if (retries++ >= I40E_QUEUE_WAIT_RETRY_LIMIT) {
+			dev_info(&pf->pdev->dev,
+				 "VSI seid %d %s%s ring %d %sable timeout\n",
+				 vsi->seid, (is_xdp ? "XDP " : ""),
+				 (tx ? "Tx" : "Rx"), pf_q,
+				 (enable ? "en" : "dis"));
+			return -ETIMEDOUT;
+		}
+
+		usleep_range(10, 20);
+	}
+
+	return 0;
+}
+
 /**
  * i40e_vsi_control_tx - Start or stop a VSI's rings
  * @vsi: the VSI being configured
  * @enable: start or stop the rings
+ *
+ * The requests go to all the queues first, then the queues are waited for
+ * together.
  **/
 static int i40e_vsi_control_tx(struct i40e_vsi *vsi, bool enable)
 {
 	struct i40e_pf *pf = vsi->back;
-	int i, pf_q, ret = 0;
+	int i, pf_q;
 
 	pf_q = vsi->base_queue;
 	for (i = 0; i < vsi->num_queue_pairs; i++, pf_q++) {
-		ret = i40e_control_wait_tx_q(vsi->seid, pf,
-					     pf_q,
-					     false /*is xdp*/, enable);
-		if (ret)
-			break;
-
-		if (!i40e_enabled_xdp_vsi(vsi))
-			continue;
+		i40e_control_tx_q(pf, pf_q, enable);
 
-		ret = i40e_control_wait_tx_q(vsi->seid, pf,
-					     pf_q + vsi->alloc_queue_pairs,
-					     true /*is xdp*/, enable);
-
-		if (ret)
-			break;
+		if (i40e_enabled_xdp_vsi(vsi))
+			i40e_control_tx_q(pf, pf_q + vsi->alloc_queue_pairs,
+					  enable);
 	}
-	return ret;
+
+	return i40e_vsi_wait_queues(vsi, true, enable);
 }
 
 /**
@@ -5752,22 +6311,20 @@ int i40e_control_wait_rx_q(struct i40e_pf *pf, int pf_q, bool enable)
  * i40e_vsi_control_rx - Start or stop a VSI's rings
  * @vsi: the VSI being configured
  * @enable: start or stop the rings
+ *
+ * The requests go to all the queues first, then the queues are waited for
+ * together.
  **/
 static int i40e_vsi_control_rx(struct i40e_vsi *vsi, bool enable)
 {
 	struct i40e_pf *pf = vsi->back;
-	int i, pf_q, ret = 0;
+	int i, pf_q, ret;
 
 	pf_q = vsi->base_queue;
-	for (i = 0; i < vsi->num_queue_pairs; i++, pf_q++) {
-		ret = i40e_control_wait_rx_q(pf, pf_q, enable);
-		if (ret) {
-			dev_info(&pf->pdev->dev,
-				 "VSI seid %d Rx ring %d %sable timeout\n",
-				 vsi->seid, pf_q, (enable ? "en" : "dis"));
-			break;
-		}
-	}
+	for (i = 0; i < vsi->num_queue_pairs; i++, pf_q++)
+		i40e_control_rx_q(pf, pf_q, enable);
+
+	ret = i40e_vsi_wait_queues(vsi, false, enable);
 
 	/* HW needs up to 50ms to finish RX queue disable*/
 	if (!enable)
@@ -5834,93 +6391,106 @@ void i40e_vsi_stop_rings_no_wait(struct i40e_vsi *vsi)
 }
 
 /**
- * i40e_vsi_free_irq - Free the irq association with the OS
+ * i40e_vsi_free_q_vector_irq - Free the IRQ of one q_vector
  * @vsi: the VSI being configured
+ * @v_idx: index of the q_vector in the VSI
+ *
+ * Also unlinks the interrupt causes of the queues of the q_vector.
  **/
-static void i40e_vsi_free_irq(struct i40e_vsi *vsi)
+static void i40e_vsi_free_q_vector_irq(struct i40e_vsi *vsi, int v_idx)
 {
+	u16 vector = vsi->base_vector + v_idx;
 	struct i40e_pf *pf = vsi->back;
 	struct i40e_hw *hw = &pf->hw;
-	int base = vsi->base_vector;
+	int irq_num;
 	u32 val, qp;
-	int i;
-
-	if (pf->flags & I40E_FLAG_MSIX_ENABLED) {
-		if (!vsi->q_vectors)
-			return;
-
-		if (!vsi->irqs_ready)
-			return;
-
-		vsi->irqs_ready = false;
-		for (i = 0; i < vsi->num_q_vectors; i++) {
-			int irq_num;
-			u16 vector;
-
-			vector = i + base;
-			irq_num = pf->msix_entries[vector].vector;
 
-			/* free only the irqs that were actually requested */
-			if (!vsi->q_vectors[i] ||
-			    !vsi->q_vectors[i]->num_ringpairs)
-				continue;
+	irq_num = pf->msix_entries[vector].vector;
 
 #ifdef HAVE_IRQ_AFFINITY_NOTIFY
-			/* clear the affinity notifier in the IRQ descriptor */
-			irq_set_affinity_notifier(irq_num, NULL);
+	/* clear the affinity notifier in the IRQ descriptor */
+	irq_set_affinity_notifier(irq_num, NULL);
 #endif
 #ifdef HAVE_IRQ_AFFINITY_HINT
-			/* remove our suggested affinity mask for this IRQ */
-			irq_set_affinity_hint(irq_num, NULL);
+	/* remove our suggested affinity mask for this IRQ */
+	irq_set_affinity_hint(irq_num, NULL);
 #endif
-			synchronize_irq(irq_num);
-			free_irq(irq_num, vsi->q_vectors[i]);
-
-			/* Tear down the interrupt queue link list
-			 *
-			 * We know that they come in pairs and always
-			 * the Rx first, then the Tx.  To clear the
-			 * link list, stick the EOL value into the
-			 * next_q field of the registers.
-			 */
-			val = rd32(hw, I40E_PFINT_LNKLSTN(vector - 1));
-			qp = (val & I40E_PFINT_LNKLSTN_FIRSTQ_INDX_MASK)
-				>> I40E_PFINT_LNKLSTN_FIRSTQ_INDX_SHIFT;
-			val |= I40E_QUEUE_END_OF_LIST
-				<< I40E_PFINT_LNKLSTN_FIRSTQ_INDX_SHIFT;
-			wr32(hw, I40E_PFINT_LNKLSTN(vector - 1), val);
+	synchronize_irq(irq_num);
+	free_irq(irq_num, vsi->q_vectors[v_idx]);
+
+	/* Tear down the interrupt queue link list
+	 *
+	 * We know that they come in pairs and always
+	 * the Rx first, then the Tx.  To clear the
+	 * link list, stick the EOL value into the
+	 * next_q field of the registers.
+	 */
+	val = rd32(hw, I40E_PFINT_LNKLSTN(vector - 1));
+	qp = (val & I40E_PFINT_LNKLSTN_FIRSTQ_INDX_MASK)
+		>> I40E_PFINT_LNKLSTN_FIRSTQ_INDX_SHIFT;
+	val |= I40E_QUEUE_END_OF_LIST
+		<< I40E_PFINT_LNKLSTN_FIRSTQ_INDX_SHIFT;
+	wr32(hw, I40E_PFINT_LNKLSTN(vector - 1), val);
 
-			while (qp != I40E_QUEUE_END_OF_LIST) {
-				u32 next;
+	while (qp != I40E_QUEUE_END_OF_LIST) {
+		u32 next;
 
-				val = rd32(hw, I40E_QINT_RQCTL(qp));
+		val = rd32(hw, I40E_QINT_RQCTL(qp));
+
+		val &= ~(I40E_QINT_RQCTL_MSIX_INDX_MASK  |
+			 I40E_QINT_RQCTL_MSIX0_INDX_MASK |
+			 I40E_QINT_RQCTL_CAUSE_ENA_MASK  |
+			 I40E_QINT_RQCTL_INTEVENT_MASK);
+
+		val |= (I40E_QINT_RQCTL_ITR_INDX_MASK |
+			 I40E_QINT_RQCTL_NEXTQ_INDX_MASK);
 
-				val &= ~(I40E_QINT_RQCTL_MSIX_INDX_MASK  |
-					 I40E_QINT_RQCTL_MSIX0_INDX_MASK |
-					 I40E_QINT_RQCTL_CAUSE_ENA_MASK  |
-					 I40E_QINT_RQCTL_INTEVENT_MASK);
+		wr32(hw, I40E_QINT_RQCTL(qp), val);
+
+		val = rd32(hw, I40E_QINT_TQCTL(qp));
+
+		next = (val & I40E_QINT_TQCTL_NEXTQ_INDX_MASK)
+			>> I40E_QINT_TQCTL_NEXTQ_INDX_SHIFT;
+
+		val &= ~(I40E_QINT_TQCTL_MSIX_INDX_MASK  |
+			 I40E_QINT_TQCTL_MSIX0_INDX_MASK |
+			 I40E_QINT_TQCTL_CAUSE_ENA_MASK  |
+			 I40E_QINT_TQCTL_INTEVENT_MASK);
 
-				val |= (I40E_QINT_RQCTL_ITR_INDX_MASK |
-					 I40E_QINT_RQCTL_NEXTQ_INDX_MASK);
+		val |= (I40E_QINT_TQCTL_ITR_INDX_MASK |
+			 I40E_QINT_TQCTL_NEXTQ_INDX_MASK);
 
-				wr32(hw, I40E_QINT_RQCTL(qp), val);
+		wr32(hw, I40E_QINT_TQCTL(qp), val);
+		qp = next;
+	}
+}
 
-				val = rd32(hw, I40E_QINT_TQCTL(qp));
+/**
+ * i40e_vsi_free_irq - Free the irq association with the OS
+ * @vsi: the VSI being configured
+ **/
+static void i40e_vsi_free_irq(struct i40e_vsi *vsi)
+{
+	struct i40e_pf *pf = vsi->back;
+	struct i40e_hw *hw = &pf->hw;
+	u32 val, qp;
+	int i;
 
-				next = (val & I40E_QINT_TQCTL_NEXTQ_INDX_MASK)
-					>> I40E_QINT_TQCTL_NEXTQ_INDX_SHIFT;
+	if (pf->flags & I40E_FLAG_MSIX_ENABLED) {
+		if (!vsi->q_vectors)
+			return;
 
-				val &= ~(I40E_QINT_TQCTL_MSIX_INDX_MASK  |
-					 I40E_QINT_TQCTL_MSIX0_INDX_MASK |
-					 I40E_QINT_TQCTL_CAUSE_ENA_MASK  |
-					 I40E_QINT_TQCTL_INTEVENT_MASK);
+		if (!vsi->irqs_ready)
+			return;
 
-				val |= (I40E_QINT_TQCTL_ITR_INDX_MASK |
-					 I40E_QINT_TQCTL_NEXTQ_INDX_MASK);
+		vsi->irqs_ready = false;
+		for (i = 0; i < vsi->num_q_vectors; i++) {
+			/* free only the irqs that were actually requested */
+			if (!vsi->q_vectors[i] ||
+			    !vsi->q_vectors[i]->num_ringpairs)
+				continue;
 
-				wr32(hw, I40E_QINT_TQCTL(qp), val);
-				qp = next;
-			}
+			i40e_vsi_free_q_vector_irq(vsi, i);
 		}
 	} else {
 		free_irq(pf->pdev->irq, pf);
@@ -6178,45 +6748,13 @@ void i40e_pf_unquiesce_all_vsi(struct i40e_pf *pf)
 **/
 int i40e_vsi_wait_queues_disabled(struct i40e_vsi *vsi)
 {
-	struct i40e_pf *pf = vsi->back;
-	int i, pf_q, ret;
-
-	pf_q = vsi->base_queue;
-	for (i = 0; i < vsi->num_queue_pairs; i++, pf_q++) {
-		/* Check and wait for the Tx queue */
-		ret = i40e_pf_txq_wait(pf, pf_q, false);
-		if (ret) {
-			dev_info(&pf->pdev->dev,
-				 "VSI seid %d Tx ring %d disable timeout\n",
-				 vsi->seid, pf_q);
-			return ret;
-		}
-
-		if (!i40e_enabled_xdp_vsi(vsi))
-			goto wait_rx;
-
-		/* Check and wait for the XDP Tx queue */
-		ret = i40e_pf_txq_wait(pf, pf_q + vsi->alloc_queue_pairs,
-				       false);
+	int ret;
 
-		if (ret) {
-			dev_info(&pf->pdev->dev,
-				 "VSI seid %d XDP Tx ring %d disable timeout\n",
-				 vsi->seid, pf_q);
-			return ret;
-		}
-wait_rx:
-		/* Check and wait for the Rx queue */
-		ret = i40e_pf_rxq_wait(pf, pf_q, false);
-		if (ret) {
-			dev_info(&pf->pdev->dev,
-				 "VSI seid %d Rx ring %d disable timeout\n",
-				 vsi->seid, pf_q);
-			return ret;
-		}
-	}
+	ret = i40e_vsi_wait_queues(vsi, true, false);
+	if (ret)
+		return ret;
 
-	return 0;
+	return i40e_vsi_wait_queues(vsi, false, false);
 }
 
 #ifdef CONFIG_DCB
@@ -7283,6 +7821,7 @@ int i40e_hw_dcb_config(struct i40e_pf *pf, struct i40e_dcbx_config *new_cfg)
 			pf->flags |= I40E_FLAG_DCB_ENABLED;
 		else
 			pf->flags &= ~I40E_FLAG_DCB_ENABLED;
+		i40e_tx_keys_update(pf, true);
 
 		set_bit(__I40E_PORT_SUSPENDED, pf->state);
 		/* Reconfiguration needed quiesce all VSIs */
@@ -8283,7 +8822,7 @@ static void i40e_remove_queue_channels(struct i40e_vsi *vsi)
 			if (cfilter->seid != ch->seid)
 				continue;
 
-			hash_del(&cfilter->cloud_node);
+			i40e_cloud_filter_unlink(pf, cfilter);
 			if (cfilter->dst_port)
 				ret = i40e_add_del_cloud_filter_big_buf(vsi,
 									cfilter,
@@ -8306,7 +8845,7 @@ static void i40e_remove_queue_channels(struct i40e_vsi *vsi)
 			if (cfilter->seid != ch->seid)
 				continue;
 
-			hash_del(&cfilter->cloud_node);
+			i40e_cloud_filter_unlink(pf, cfilter);
 			if (cfilter->dst_port)
 				ret = i40e_add_del_cloud_filter_big_buf(vsi,
 									cfilter,
@@ -9160,6 +9699,7 @@ static int i40e_setup_tc(struct net_device *netdev, u8 tc)
 		       sizeof(*mqprio_qopt));
 		pf->flags |= I40E_FLAG_TC_MQPRIO;
 		pf->flags &= ~I40E_FLAG_DCB_ENABLED;
+		i40e_tx_keys_update(pf, true);
 		break;
 	default:
 		return -EINVAL;
@@ -9593,10 +10133,7 @@ static int i40e_configure_clsflower(struct i40e_vsi *vsi,
 		goto err;
 	}
 
-	/* add filter to the ordered list */
-	INIT_HLIST_NODE(&filter->cloud_node);
-
-	hlist_add_head(&filter->cloud_node, &pf->cloud_filter_list);
+	i40e_cloud_filter_link(pf, filter);
 
 	pf->num_cloud_filters++;
 
@@ -9616,10 +10153,9 @@ static struct i40e_cloud_filter *i40e_find_cloud_filter(struct i40e_vsi *vsi,
 							unsigned long *cookie)
 {
 	struct i40e_cloud_filter *filter = NULL;
-	struct hlist_node *node2;
 
-	hlist_for_each_entry_safe(filter, node2,
-				  &vsi->back->cloud_filter_list, cloud_node)
+	hash_for_each_possible(vsi->back->cloud_cookie_hash, filter,
+			       cloud_cookie_node, *cookie)
 		if (!memcmp(cookie, &filter->cookie, sizeof(filter->cookie)))
 			return filter;
 	return NULL;
@@ -9643,7 +10179,7 @@ static int i40e_delete_clsflower(struct i40e_vsi *vsi,
 	if (!filter)
 		return -EINVAL;
 
-	hash_del(&filter->cloud_node);
+	i40e_cloud_filter_unlink(pf, filter);
 
 	if (filter->dst_port)
 		err = i40e_add_del_cloud_filter_big_buf(vsi, filter, false);
@@ -9910,6 +10446,98 @@ err_setup_tx:
 	return err;
 }
 
+/**
+ * i40e_fdir_filter_link - Track a sideband filter in the PF
+ * @pf: Pointer to PF
+ * @f: filter to add to the filter list and lookup tables
+ **/
+void i40e_fdir_filter_link(struct i40e_pf *pf, struct i40e_fdir_filter *f)
+{
+	INIT_HLIST_NODE(&f->fdir_node);
+	hlist_add_head(&f->fdir_node, &pf->fdir_filter_list);
+	hash_add(pf->fdir_loc_hash, &f->fdir_loc_node, f->fd_id);
+	hash_add(pf->fdir_key_hash, &f->fdir_key_node, i40e_fdir_match_key(f));
+}
+
+/**
+ * i40e_fdir_filter_unlink - Stop tracking a sideband filter
+ * @pf: Pointer to PF
+ * @f: filter to remove from the filter list and lookup tables
+ **/
+void i40e_fdir_filter_unlink(struct i40e_pf *pf, struct i40e_fdir_filter *f)
+{
+	hlist_del(&f->fdir_node);
+	hash_del(&f->fdir_loc_node);
+	hash_del(&f->fdir_key_node);
+}
+
+/**
+ * i40e_find_fdir_filter_by_loc - Look up a sideband filter by location
+ * @pf: Pointer to PF
+ * @loc: ethtool location (fd_id) of the filter
+ **/
+struct i40e_fdir_filter *i40e_find_fdir_filter_by_loc(struct i40e_pf *pf,
+						      u32 loc)
+{
+	struct i40e_fdir_filter *f;
+
+	hash_for_each_possible(pf->fdir_loc_hash, f, fdir_loc_node, loc)
+		if (f->fd_id == loc)
+			return f;
+
+	return NULL;
+}
+
+/**
+ * i40e_cloud_filter_link - Track a cloud filter in the PF
+ * @pf: Pointer to PF
+ * @f: filter to add to the filter list and lookup tables
+ **/
+void i40e_cloud_filter_link(struct i40e_pf *pf, struct i40e_cloud_filter *f)
+{
+	INIT_HLIST_NODE(&f->cloud_node);
+	INIT_HLIST_NODE(&f->cloud_loc_node);
+	INIT_HLIST_NODE(&f->cloud_cookie_node);
+	hlist_add_head(&f->cloud_node, &pf->cloud_filter_list);
+
+	/* tc flower filters are found by cookie, ethtool ones by location */
+	if (f->cookie)
+		hash_add(pf->cloud_cookie_hash, &f->cloud_cookie_node,
+			 f->cookie);
+	else
+		hash_add(pf->cloud_loc_hash, &f->cloud_loc_node, f->id);
+}
+
+/**
+ * i40e_cloud_filter_unlink - Stop tracking a cloud filter
+ * @pf: Pointer to PF
+ * @f: filter to remove from the filter list and lookup tables
+ **/
+void i40e_cloud_filter_unlink(struct i40e_pf *pf,
+			      struct i40e_cloud_filter *f)
+{
+	hash_del(&f->cloud_node);
+	hash_del(&f->cloud_loc_node);
+	hash_del(&f->cloud_cookie_node);
+}
+
+/**
+ * i40e_find_cloud_filter_by_loc - Look up an ethtool cloud filter
+ * @pf: Pointer to PF
+ * @loc: ethtool location (id) of the filter
+ **/
+struct i40e_cloud_filter *i40e_find_cloud_filter_by_loc(struct i40e_pf *pf,
+							u32 loc)
+{
+	struct i40e_cloud_filter *f;
+
+	hash_for_each_possible(pf->cloud_loc_hash, f, cloud_loc_node, loc)
+		if (f->id == loc)
+			return f;
+
+	return NULL;
+}
+
 /**
  * i40e_fdir_filter_exit - Cleans up the Flow Director accounting
  * @pf: Pointer to PF
@@ -9925,7 +10553,7 @@ static void i40e_fdir_filter_exit(struct i40e_pf *pf)
 
 	hlist_for_each_entry_safe(filter, node2,
 				  &pf->fdir_filter_list, fdir_node) {
-		hlist_del(&filter->fdir_node);
+		i40e_fdir_filter_unlink(pf, filter);
 		kfree(filter);
 	}
 
@@ -10002,7 +10630,7 @@ static void i40e_cloud_filter_exit(struct i40e_pf *pf)
 
 	hlist_for_each_entry_safe(cfilter, node,
 				  &pf->cloud_filter_list, cloud_node) {
-		hlist_del(&cfilter->cloud_node);
+		i40e_cloud_filter_unlink(pf, cfilter);
 		kfree(cfilter);
 	}
 	pf->num_cloud_filters = 0;
@@ -10302,6 +10930,7 @@ static int i40e_handle_lldp_event(struct i40e_pf *pf,
 		pf->flags |= I40E_FLAG_DCB_ENABLED;
 	else
 		pf->flags &= ~I40E_FLAG_DCB_ENABLED;
+	i40e_tx_keys_update(pf, true);
 
 	set_bit(__I40E_PORT_SUSPENDED, pf->state);
 	/* Reconfiguration needed quiesce all VSIs */
@@ -10515,7 +11144,7 @@ static void i40e_delete_invalid_filter(struct i40e_pf *pf,
 	}
 
 	/* Remove the filter from the list and free memory */
-	hlist_del(&filter->fdir_node);
+	i40e_fdir_filter_unlink(pf, filter);
 	kfree(filter);
 }
 
@@ -10527,7 +11156,6 @@ void i40e_fdir_check_and_reenable(struct i40e_pf *pf)
 {
 	struct i40e_fdir_filter *filter;
 	u32 fcnt_prog, fcnt_avail;
-	struct hlist_node *node;
 
 	if (test_bit(__I40E_FD_FLUSH_REQUESTED, pf->state))
 		return;
@@ -10550,10 +11178,9 @@ void i40e_fdir_check_and_reenable(struct i40e_pf *pf)
 
 	/* if hw had a problem adding a filter, delete it */
 	if (pf->fd_inv > 0) {
-		hlist_for_each_entry_safe(filter, node,
-					  &pf->fdir_filter_list, fdir_node)
-			if (filter->fd_id == pf->fd_inv)
-				i40e_delete_invalid_filter(pf, filter);
+		filter = i40e_find_fdir_filter_by_loc(pf, pf->fd_inv);
+		if (filter)
+			i40e_delete_invalid_filter(pf, filter);
 	}
 }
 
@@ -10562,8 +11189,10 @@ void i40e_fdir_check_and_reenable(struct i40e_pf *pf)
 /**
  * i40e_fdir_flush_and_replay - Function to flush all FD filters and replay SB
  * @pf: board private structure
+ * @force: flush even if the last flush was less than
+ *	   I40E_MIN_FD_FLUSH_INTERVAL ago
  **/
-static void i40e_fdir_flush_and_replay(struct i40e_pf *pf)
+static void i40e_fdir_flush_and_replay(struct i40e_pf *pf, bool force)
 {
 	unsigned long min_flush_time;
 	int flush_wait_retry = 50;
@@ -10571,8 +11200,8 @@ static void i40e_fdir_flush_and_replay(struct i40e_pf *pf)
 	int fd_room;
 	int reg;
 
-	if (!time_after(jiffies, pf->fd_flush_timestamp +
-				 (I40E_MIN_FD_FLUSH_INTERVAL * HZ)))
+	if (!force && !time_after(jiffies, pf->fd_flush_timestamp +
+					   (I40E_MIN_FD_FLUSH_INTERVAL * HZ)))
 		return;
 
 	/* If the flush is happening too quick and we have mostly SB rules we
@@ -10645,7 +11274,7 @@ static void i40e_fdir_reinit_subtask(struct i40e_pf *pf)
 		return;
 
 	if (test_bit(__I40E_FD_FLUSH_REQUESTED, pf->state))
-		i40e_fdir_flush_and_replay(pf);
+		i40e_fdir_flush_and_replay(pf, false);
 
 	i40e_fdir_check_and_reenable(pf);
 
@@ -10795,10 +11424,58 @@ static void i40e_link_event(struct i40e_pf *pf)
 			pf->flags |= I40E_FLAG_DCB_CAPABLE;
 			pf->flags &= ~I40E_FLAG_DCB_ENABLED;
 		}
+		i40e_tx_keys_update(pf, true);
 	}
 #endif /* CONFIG_DCB */
 }
 
+/**
+ * i40e_watchdog_update_stats - background refresh of the hardware stats
+ * @pf: board private structure
+ *
+ * Netdevs whose stats were read since the previous pass get their VSI and
+ * port counters refreshed so the network stack sees current numbers.  Any
+ * other group is only read once it gets old enough to risk missing a wrap.
+ **/
+static void i40e_watchdog_update_stats(struct i40e_pf *pf)
+{
+	struct i40e_vsi *vsi;
+	int group;
+	int i;
+
+	for (i = 0; i < pf->num_alloc_vsi; i++) {
+		vsi = pf->vsi[i];
+		if (!vsi || !vsi->netdev)
+			continue;
+
+		if (READ_ONCE(vsi->stats_wanted))
+			i40e_update_stats_groups(vsi, BIT(I40E_STATS_PORT) |
+						 BIT(I40E_STATS_VSI), 0);
+		else if (!vsi->stat_offsets_loaded ||
+			 i40e_stats_stale(vsi->stats_refreshed,
+					  i40e_stats_max_age[I40E_STATS_VSI]))
+			i40e_update_stats_groups(vsi, BIT(I40E_STATS_VSI), 0);
+	}
+
+	vsi = pf->vsi[pf->lan_vsi];
+	for (group = 0; vsi && group < I40E_STATS_NUM_GROUPS; group++)
+		if ((BIT(group) & I40E_STATS_PF_GROUPS) &&
+		    i40e_stats_stale(pf->stats_refreshed[group],
+				     i40e_stats_max_age[group]))
+			i40e_update_stats_groups(vsi, BIT(group), 0);
+
+	if (!(pf->flags & I40E_FLAG_VEB_STATS_ENABLED))
+		return;
+
+	/* Update the stats for the active switching components */
+	for (i = 0; i < I40E_MAX_VEB; i++)
+		if (pf->veb[i] &&
+		    (!pf->veb[i]->stat_offsets_loaded ||
+		     i40e_stats_stale(pf->veb[i]->stats_refreshed,
+				      i40e_stats_max_age[I40E_STATS_VEB])))
+			i40e_update_veb_stats(pf->veb[i]);
+}
+
 /**
  * i40e_watchdog_subtask - periodic checks not using event driven response
  * @pf: board private structure
@@ -10822,19 +11499,10 @@ static void i40e_watchdog_subtask(struct i40e_pf *pf)
 	    test_bit(__I40E_TEMP_LINK_POLLING, pf->state))
 		i40e_link_event(pf);
 
-	/* Update the stats for active netdevs so the network stack
-	 * can look at updated numbers whenever it cares to
-	 */
-	for (i = 0; i < pf->num_alloc_vsi; i++)
-		if (pf->vsi[i] && pf->vsi[i]->netdev)
-			i40e_update_stats(pf->vsi[i]);
+	i40e_watchdog_update_stats(pf);
 
-	if (pf->flags & I40E_FLAG_VEB_STATS_ENABLED) {
-		/* Update the stats for the active switching components */
-		for (i = 0; i < I40E_MAX_VEB; i++)
-			if (pf->veb[i])
-				i40e_update_veb_stats(pf->veb[i]);
-	}
+	/* Refresh the VF stats snapshots that are being read */
+	i40e_vc_collect_vf_stats(pf);
 #ifdef HAVE_PTP_1588_CLOCK
 
 	i40e_ptp_rx_hang(pf);
@@ -10919,6 +11587,151 @@ static void i40e_handle_link_event(struct i40e_pf *pf,
 	}
 }
 
+/**
+ * i40e_aq_stats_slot - find or claim the accounting slot for an opcode
+ * @stats: AdminQ statistics of the PF
+ * @opcode: AdminQ opcode
+ *
+ * Must be called with stats->lock held. Returns NULL when every slot is
+ * already taken by another opcode.
+ **/
+static struct i40e_aq_op_stats *i40e_aq_stats_slot(struct i40e_aq_stats *stats,
+						   u16 opcode)
+{
+	unsigned int i, slot = opcode % I40E_AQ_STATS_SLOTS;
+
+	for (i = 0; i < I40E_AQ_STATS_SLOTS; i++) {
+		struct i40e_aq_op_stats *op = &stats->op[slot];
+
+		if (!op->used) {
+			op->used = true;
+			op->opcode = opcode;
+			return op;
+		}
+		if (op->opcode == opcode)
+			return op;
+		slot = (slot + 1) % I40E_AQ_STATS_SLOTS;
+	}
+
+	stats->untracked++;
+	return NULL;
+}
+
+/**
+ * i40e_aq_stats_submit_d - account an AdminQ command handed to firmware
+ * @hw: pointer to the hw struct
+ * @desc: descriptor placed on the send queue
+ *
+ * Returns the submit timestamp to be passed back on completion.
+ **/
+u64 i40e_aq_stats_submit_d(struct i40e_hw *hw, struct i40e_aq_desc *desc)
+{
+	struct i40e_pf *pf = (struct i40e_pf *)hw->back;
+	u16 opcode = LE16_TO_CPU(desc->opcode);
+	struct i40e_aq_op_stats *op;
+
+	if (!pf)
+		return 0;
+
+	spin_lock_bh(&pf->aq_stats.lock);
+	op = i40e_aq_stats_slot(&pf->aq_stats, opcode);
+	if (op)
+		op->asq_count++;
+	spin_unlock_bh(&pf->aq_stats.lock);
+
+	i40e_trace(aq_submit, hw, opcode, LE16_TO_CPU(desc->datalen));
+
+	return ktime_get_ns();
+}
+
+/**
+ * i40e_aq_stats_complete_d - account completion of an AdminQ command
+ * @hw: pointer to the hw struct
+ * @desc: descriptor as written back by firmware
+ * @timeout: true if firmware never completed the command
+ * @start: timestamp returned by i40e_aq_stats_submit_d, 0 if unknown
+ **/
+void i40e_aq_stats_complete_d(struct i40e_hw *hw, struct i40e_aq_desc *desc,
+			      bool timeout, u64 start)
+{
+	struct i40e_pf *pf = (struct i40e_pf *)hw->back;
+	u16 opcode = LE16_TO_CPU(desc->opcode);
+	u16 retval = LE16_TO_CPU(desc->retval);
+	struct i40e_aq_op_stats *op;
+	u64 usecs = 0;
+	unsigned int rc;
+
+	if (!pf)
+		return;
+
+	if (start)
+		usecs = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+
+	if (timeout || retval >= I40E_AQ_RC_TIMEOUT)
+		rc = I40E_AQ_RC_TIMEOUT;
+	else
+		rc = retval;
+
+	spin_lock_bh(&pf->aq_stats.lock);
+	op = i40e_aq_stats_slot(&pf->aq_stats, opcode);
+	if (op) {
+		op->rc[rc]++;
+		if (start) {
+			u32 us = (u32)min_t(u64, usecs, U32_MAX);
+
+			op->lat_hist[min_t(int, fls(us),
+					   I40E_AQ_LAT_BUCKETS - 1)]++;
+			op->lat_total_us += us;
+			if (us > op->lat_max_us)
+				op->lat_max_us = us;
+		}
+	}
+	spin_unlock_bh(&pf->aq_stats.lock);
+
+	i40e_trace(aq_complete, hw, opcode, retval, timeout, usecs);
+}
+
+/**
+ * i40e_aq_stats_arq_d - account an event received on the AdminQ
+ * @hw: pointer to the hw struct
+ * @desc: descriptor of the received event
+ **/
+void i40e_aq_stats_arq_d(struct i40e_hw *hw, struct i40e_aq_desc *desc)
+{
+	struct i40e_pf *pf = (struct i40e_pf *)hw->back;
+	struct i40e_aq_op_stats *op;
+
+	if (!pf)
+		return;
+
+	spin_lock_bh(&pf->aq_stats.lock);
+	op = i40e_aq_stats_slot(&pf->aq_stats, LE16_TO_CPU(desc->opcode));
+	if (op)
+		op->arq_count++;
+	spin_unlock_bh(&pf->aq_stats.lock);
+}
+
+/**
+ * i40e_adminq_rtnl_lock - Take rtnl from the AdminQ task
+ * @pf: board private structure
+ *
+ * i40e_prep_for_reset() waits for the AdminQ task and may do so with rtnl
+ * held, so give up instead of blocking once a reset is pending. The reset
+ * rebuild refreshes link and DCB state anyway.
+ *
+ * Returns true if rtnl was taken
+ **/
+static bool i40e_adminq_rtnl_lock(struct i40e_pf *pf)
+{
+	while (!rtnl_trylock()) {
+		if (test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state))
+			return false;
+		usleep_range(1000, 2000);
+	}
+
+	return true;
+}
+
 /**
  * i40e_clean_adminq_subtask - Clean the AdminQ rings
  * @pf: board private structure
@@ -10979,6 +11792,12 @@ static void i40e_clean_adminq_subtask(struct i40e_pf *pf)
 	if (oldval != val)
 		wr32(&pf->hw, pf->hw.aq.asq.len, val);
 
+	/* reap asynchronous send queue commands; firmware raises the AdminQ
+	 * interrupt cause when each of them completes
+	 */
+	if (hw->aq.asq_async_pending)
+		i40e_asq_clean_async(hw);
+
 	event.buf_len = I40E_MAX_AQ_BUF_SIZE;
 	event.msg_buf = (u8 *)kzalloc(event.buf_len, GFP_KERNEL);
 	if (!event.msg_buf)
@@ -10997,7 +11816,8 @@ static void i40e_clean_adminq_subtask(struct i40e_pf *pf)
 		switch (opcode) {
 
 		case i40e_aqc_opc_get_link_status:
-			rtnl_lock();
+			if (!i40e_adminq_rtnl_lock(pf))
+				break;
 			i40e_handle_link_event(pf, &event);
 			rtnl_unlock();
 			break;
@@ -11012,7 +11832,8 @@ static void i40e_clean_adminq_subtask(struct i40e_pf *pf)
 		case i40e_aqc_opc_lldp_update_mib:
 			dev_dbg(&pf->pdev->dev, "ARQ: Update LLDP MIB event received\n");
 #ifdef CONFIG_DCB
-			rtnl_lock();
+			if (!i40e_adminq_rtnl_lock(pf))
+				break;
 			i40e_handle_lldp_event(pf, &event);
 			rtnl_unlock();
 #endif /* CONFIG_DCB */
@@ -11037,10 +11858,13 @@ static void i40e_clean_adminq_subtask(struct i40e_pf *pf)
 				 opcode);
 			break;
 		}
-	} while (i++ < pf->adminq_work_limit);
+	} while (i++ < pf->adminq_work_limit &&
+		 !test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state));
 
 	if (i < pf->adminq_work_limit)
 		clear_bit(__I40E_ADMINQ_EVENT_PENDING, pf->state);
+	else
+		i40e_adminq_event_schedule(pf);
 
 	/* re-enable Admin queue interrupt cause */
 	val = rd32(hw, I40E_PFINT_ICR0_ENA);
@@ -11051,6 +11875,29 @@ static void i40e_clean_adminq_subtask(struct i40e_pf *pf)
 	kfree(event.msg_buf);
 }
 
+/**
+ * i40e_adminq_task - Drain the AdminQ from its own work item
+ * @work: pointer to work_struct containing our data
+ *
+ * Queued straight from the misc interrupt when the AdminQ cause fires, and
+ * from every service task pass to pick up the queue error indications.
+ * Being a single work item it never runs concurrently with itself, which
+ * keeps the ARQ events of a VF in order.
+ **/
+static void i40e_adminq_task(struct work_struct *work)
+{
+	struct i40e_pf *pf = container_of(work,
+					  struct i40e_pf,
+					  adminq_task);
+
+	/* the AdminQ is torn down and rebuilt by the reset path */
+	if (test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state) ||
+	    test_bit(__I40E_SUSPENDED, pf->state))
+		return;
+
+	i40e_clean_adminq_subtask(pf);
+}
+
 /**
  * i40e_verify_eeprom - make sure eeprom is good to use
  * @pf: board private structure
@@ -11380,6 +12227,7 @@ static void i40e_fdir_teardown(struct i40e_pf *pf)
 	vsi = i40e_find_vsi_by_type(pf, I40E_VSI_FDIR);
 	if (vsi)
 		i40e_vsi_release(vsi);
+	i40e_fdir_arena_free(pf);
 }
 
 /**
@@ -11397,6 +12245,18 @@ static void i40e_prep_for_reset(struct i40e_pf *pf)
 	clear_bit(__I40E_RESET_INTR_RECEIVED, pf->state);
 	if (test_and_set_bit(__I40E_RESET_RECOVERY_PENDING, pf->state))
 		return;
+	/* VF requests still queued are stale once the VFs are reset */
+	i40e_vc_flush_vf_msgs(pf);
+	/* no new filter sync pass starts with RESET_RECOVERY_PENDING set,
+	 * wait for one that may still be programming the old switch
+	 */
+	if (pf->filter_sync_task.func)
+		cancel_work_sync(&pf->filter_sync_task);
+	/* the AdminQ task bails out once RESET_RECOVERY_PENDING is set, wait
+	 * for it to leave the rings before they are shut down below
+	 */
+	if (pf->adminq_task.func)
+		cancel_work_sync(&pf->adminq_task);
 	if (i40e_check_asq_alive(&pf->hw))
 		i40e_vc_notify_reset(pf);
 
@@ -11510,6 +12370,46 @@ static int i40e_reset(struct i40e_pf *pf)
 	return ret;
 }
 
+/**
+ * i40e_rebuild_phase_done - Account the time spent in a rebuild phase
+ * @pf: board private structure
+ * @phase: the phase just completed
+ * @start: ktime_get_ns() at the start of the phase, moved on to now
+ **/
+static void i40e_rebuild_phase_done(struct i40e_pf *pf,
+				    enum i40e_rebuild_phase phase, u64 *start)
+{
+	struct i40e_rebuild_timing *timing = &pf->rebuild_timing;
+	u64 now = ktime_get_ns();
+	u64 usecs;
+
+	usecs = div_u64(now - *start, NSEC_PER_USEC);
+	timing->phase_us[phase] = usecs;
+	timing->phase_max_us[phase] = max(timing->phase_max_us[phase], usecs);
+	i40e_trace(rebuild_phase, &pf->hw, i40e_rebuild_phase_str[phase], usecs);
+	*start = now;
+}
+
+/**
+ * i40e_rebuild_done - Account a rebuild run to completion
+ * @pf: board private structure
+ * @start: ktime_get_ns() at the start of the rebuild
+ * @port_reset: the rebuild followed a reset wider than a PF reset
+ **/
+static void i40e_rebuild_done(struct i40e_pf *pf, u64 start, bool port_reset)
+{
+	struct i40e_rebuild_timing *timing = &pf->rebuild_timing;
+	u64 usecs = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+
+	timing->count++;
+	timing->port_reset = port_reset;
+	timing->total_us = usecs;
+	timing->total_max_us = max(timing->total_max_us, usecs);
+	i40e_trace(rebuild_done, &pf->hw, port_reset, usecs);
+	dev_dbg(&pf->pdev->dev, "Rebuilt after %s reset in %llu us\n",
+		port_reset ? "port" : "PF", usecs);
+}
+
 /**
  * i40e_rebuild - rebuild using a saved config
  * @pf: board private structure
@@ -11521,7 +12421,9 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 {
 	const bool is_recovery_mode_reported = i40e_check_recovery_mode(pf);
 	struct i40e_vsi *vsi = pf->vsi[pf->lan_vsi];
+	u64 start, rebuild_start, switch_done;
 	struct i40e_hw *hw = &pf->hw;
+	bool port_reset;
 	i40e_status ret;
 	u32 val;
 	int v;
@@ -11537,6 +12439,16 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 		goto clear_recovery;
 	dev_dbg(&pf->pdev->dev, "Rebuilding internal switch\n");
 
+	/* A PF reset leaves the port and the global registers alone, so the
+	 * port level programming below is only redone after anything wider,
+	 * or after the resume and PCI error paths.
+	 */
+	port_reset = test_bit(__I40E_PORT_STATE_LOST, pf->state);
+	memset(pf->rebuild_timing.phase_us, 0,
+	       sizeof(pf->rebuild_timing.phase_us));
+	rebuild_start = ktime_get_ns();
+	start = rebuild_start;
+
 	/* rebuild the basics for the AdminQ, HMC, and initial HW switch */
 	ret = i40e_init_adminq(&pf->hw);
 	if (ret) {
@@ -11554,6 +12466,7 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 		dev_info(&pf->pdev->dev, "Reset Requested! (EMPR)\n");
 		i40e_verify_eeprom(pf);
 	}
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_ADMINQ, &start);
 
 	/* if we are going out of or into recovery mode we have to act
 	 * accordingly with regard to resources initialization
@@ -11608,15 +12521,25 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 		dev_info(&pf->pdev->dev, "configure_lan_hmc failed: %d\n", ret);
 		goto end_core_reset;
 	}
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_HMC, &start);
 
 #ifdef CONFIG_DCB
 	/* Enable FW to write a default DCB config on link-up
 	 * unless I40E_FLAG_TC_MQPRIO is enabled
 	 */
 	if (i40e_is_tc_mqprio_enabled(pf)) {
-		i40e_aq_set_dcb_parameters(hw, false, NULL);
+		if (port_reset)
+			i40e_aq_set_dcb_parameters(hw, false, NULL);
+	} else if (!port_reset && (pf->flags & I40E_FLAG_DCB_CAPABLE) &&
+		   (pf->flags & (I40E_FLAG_DISABLE_FW_LLDP |
+				 I40E_FLAG_MULTIPLE_TRAFFIC_CLASSES))) {
+		/* the firmware kept the port's SW DCB config, programming
+		 * the default one again would also drop the user's
+		 */
+		dev_dbg(&pf->pdev->dev, "Keeping SW DCB config across PF reset\n");
 	} else {
-		i40e_aq_set_dcb_parameters(hw, true, NULL);
+		if (port_reset)
+			i40e_aq_set_dcb_parameters(hw, true, NULL);
 		ret = i40e_init_pf_dcb(pf);
 		if (ret) {
 			dev_info(&pf->pdev->dev, "DCB init failed %d, disabled\n",
@@ -11625,8 +12548,11 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 			/* Continue without DCB enabled */
 		}
 	}
+	i40e_tx_keys_update(pf, true);
 
 #endif /* CONFIG_DCB */
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_DCB, &start);
+
 	/* do basic switch setup */
 	if (!lock_acquired)
 		rtnl_lock();
@@ -11645,6 +12571,9 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 		dev_info(&pf->pdev->dev, "set phy mask fail, err %s aq_err %s\n",
 			 i40e_stat_str(&pf->hw, ret),
 			 i40e_aq_str(&pf->hw, pf->hw.aq.asq_last_status));
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_SWITCH, &start);
+	switch_done = start;
+
 	/* Rebuild the VSIs and VEBs that existed before reset.
 	 * They are still in our local switch element arrays, so only
 	 * need to rebuild the switch model in the HW.
@@ -11713,6 +12642,7 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 			goto end_unlock;
 	}
 #endif
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_VSI, &start);
 
 #ifdef __TC_MQPRIO_MODE_MAX
 	/* Not going to support channel VSI in L4 cloud filter mode */
@@ -11725,30 +12655,25 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 			goto end_unlock;
 	}
 #endif
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_CHANNELS, &start);
 
 	/* Reconfigure hardware for allowing smaller MSS in the case
 	 * of TSO, so that we avoid the MDD being fired and causing
-	 * a reset in the case of small MSS+TSO.
+	 * a reset in the case of small MSS+TSO. The register is global,
+	 * a PF reset keeps it.
 	 */
 #define I40E_REG_MSS          0x000E64DC
 #define I40E_REG_MSS_MIN_MASK 0x3FF0000
 #define I40E_64BYTE_MSS       0x400000
-	val = rd32(hw, I40E_REG_MSS);
-	if ((val & I40E_REG_MSS_MIN_MASK) > I40E_64BYTE_MSS) {
-		val &= ~I40E_REG_MSS_MIN_MASK;
-		val |= I40E_64BYTE_MSS;
-		wr32(hw, I40E_REG_MSS, val);
+	if (port_reset) {
+		val = rd32(hw, I40E_REG_MSS);
+		if ((val & I40E_REG_MSS_MIN_MASK) > I40E_64BYTE_MSS) {
+			val &= ~I40E_REG_MSS_MIN_MASK;
+			val |= I40E_64BYTE_MSS;
+			wr32(hw, I40E_REG_MSS, val);
+		}
 	}
 
-	if (pf->hw_features & I40E_HW_RESTART_AUTONEG) {
-		msleep(75);
-		ret = i40e_aq_set_link_restart_an(&pf->hw, true, NULL);
-		if (ret)
-			dev_info(&pf->pdev->dev, "link restart failed, err %s aq_err %s\n",
-				 i40e_stat_str(&pf->hw, ret),
-				 i40e_aq_str(&pf->hw,
-					     pf->hw.aq.asq_last_status));
-	}
 	/* reinit the misc interrupt */
 	if (pf->flags & I40E_FLAG_MSIX_ENABLED) {
 		ret = i40e_setup_misc_vector(pf);
@@ -11764,14 +12689,40 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 	 */
 	i40e_add_filter_to_drop_tx_flow_control_frames(&pf->hw,
 						       pf->main_vsi_seid);
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_MISC, &start);
 
 	/* restart the VSIs that were rebuilt and running before the reset */
 	i40e_pf_unquiesce_all_vsi(pf);
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_VSI_UP, &start);
 
 	/* Release the RTNL lock before we start resetting VFs */
 	if (!lock_acquired)
 		rtnl_unlock();
 
+	/* The link wants 75ms to settle after the switch came back; the VSIs
+	 * were brought up in the meantime, so only the rest of that is waited
+	 * out here.
+	 */
+	if (pf->hw_features & I40E_HW_RESTART_AUTONEG) {
+		u64 settled = switch_done + 75 * NSEC_PER_MSEC;
+		u64 now = ktime_get_ns();
+
+		if (now < settled) {
+			unsigned long wait_us;
+
+			wait_us = div_u64(settled - now, NSEC_PER_USEC);
+			usleep_range(wait_us, wait_us + 1000);
+		}
+		ret = i40e_aq_set_link_restart_an(&pf->hw, true, NULL);
+		if (ret)
+			dev_info(&pf->pdev->dev, "link restart failed, err %s aq_err %s\n",
+				 i40e_stat_str(&pf->hw, ret),
+				 i40e_aq_str(&pf->hw,
+					     pf->hw.aq.asq_last_status));
+	}
+	clear_bit(__I40E_PORT_STATE_LOST, pf->state);
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_LINK, &start);
+
 	/* Restore promiscuous settings */
 	ret = i40e_set_promiscuous(pf, pf->cur_promisc);
 	if (ret)
@@ -11821,12 +12772,15 @@ static void i40e_rebuild(struct i40e_pf *pf, bool reinit, bool lock_acquired)
 			pf->egress_vlan = I40E_NO_VF_MIRROR;
 	}
 #endif /* HAVE_NDO_SET_VF_LINK_STATE */
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_PORT_CFG, &start);
 
 	i40e_reset_all_vfs(pf, true);
+	i40e_rebuild_phase_done(pf, I40E_REBUILD_VFS, &start);
 
 	/* TODO: restart clients */
 	/* tell the firmware that we're starting */
 	i40e_send_version(pf);
+	i40e_rebuild_done(pf, rebuild_start, port_reset);
 
 	/* We've already released the lock, so don't do it again */
 	goto end_core_reset;
@@ -11839,6 +12793,12 @@ end_core_reset:
 clear_recovery:
 	clear_bit(__I40E_RESET_RECOVERY_PENDING, pf->state);
 	clear_bit(__I40E_TIMEOUT_RECOVERY_PENDING, pf->state);
+
+	/* pick up filter changes and AdminQ events left pending by
+	 * i40e_prep_for_reset()
+	 */
+	i40e_filter_sync_schedule(pf);
+	i40e_adminq_event_schedule(pf);
 }
 
 /**
@@ -12179,12 +13139,14 @@ static void i40e_service_task(struct work_struct *work)
 
 	if (!test_bit(__I40E_RECOVERY_MODE, pf->state)) {
 		i40e_detect_recover_hung(pf->vsi[pf->lan_vsi]);
-		i40e_sync_filters_subtask(pf);
+		if (test_bit(__I40E_MACVLAN_SYNC_PENDING, pf->state))
+			i40e_filter_sync_schedule(pf);
 		i40e_reset_subtask(pf);
 		i40e_handle_mdd_event(pf);
 		i40e_vc_process_vflr_event(pf);
 		i40e_watchdog_subtask(pf);
 		i40e_fdir_reinit_subtask(pf);
+		i40e_tx_keys_update(pf, true);
 		if (test_and_clear_bit(__I40E_CLIENT_RESET, pf->state)) {
 			/* Client subtask will reopen next time through. */
 			i40e_notify_client_of_netdev_close(
@@ -12207,7 +13169,7 @@ static void i40e_service_task(struct work_struct *work)
 		i40e_reset_subtask(pf);
 	}
 
-	i40e_clean_adminq_subtask(pf);
+	i40e_adminq_event_schedule(pf);
 
 	/* flush memory to make sure state is correct before next watchdog */
 	smp_mb__before_atomic();
@@ -12218,7 +13180,6 @@ static void i40e_service_task(struct work_struct *work)
 	 * rather than wait for the timer to tick again.
 	 */
 	if (time_after(jiffies, (start_time + pf->service_timer_period)) ||
-	    test_bit(__I40E_ADMINQ_EVENT_PENDING, pf->state)		 ||
 	    test_bit(__I40E_MDD_EVENT_PENDING, pf->state)		 ||
 	    test_bit(__I40E_VFLR_EVENT_PENDING, pf->state))
 		i40e_service_event_schedule(pf);
@@ -12406,6 +13367,9 @@ int i40e_vsi_mem_alloc(struct i40e_pf *pf, enum i40e_vsi_type type)
 	vsi->netdev_registered = false;
 	vsi->work_limit = I40E_DEFAULT_IRQ_WORK;
 	hash_init(vsi->mac_filter_hash);
+	ret = i40e_mac_vlan_hash_alloc(vsi);
+	if (ret)
+		goto err_rings;
 	vsi->irqs_ready = false;
 
 #ifdef HAVE_AF_XDP_ZC_SUPPORT
@@ -12441,6 +13405,7 @@ err_rings:
 	bitmap_free(vsi->af_xdp_zc_qps);
 #endif /* HAVE_AF_XDP_ZC_SUPPORT */
 	pf->next_vsi = i - 1;
+	i40e_mac_vlan_hash_free(vsi);
 	kfree(vsi);
 unlock_pf:
 	mutex_unlock(&pf->switch_mutex);
@@ -12499,6 +13464,16 @@ static int i40e_vsi_clear(struct i40e_vsi *vsi)
 		goto unlock_vsi;
 	}
 
+	/* Unpublish the VSI first so a new filter sync pass cannot pick it
+	 * up, then wait for a pass that may still hold a pointer to it. The
+	 * sync task does not take switch_mutex.
+	 */
+	pf->vsi[vsi->idx] = NULL;
+	if (vsi->idx < pf->next_vsi)
+		pf->next_vsi = vsi->idx;
+	if (pf->filter_sync_task.func)
+		flush_work(&pf->filter_sync_task);
+
 	/* updates the PF for this cleared vsi */
 	i40e_put_lump(pf->qp_pile, vsi->base_queue, vsi->idx);
 	i40e_put_lump(pf->irq_pile, vsi->base_vector, vsi->idx);
@@ -12509,13 +13484,10 @@ static int i40e_vsi_clear(struct i40e_vsi *vsi)
 	i40e_vsi_free_arrays(vsi, true);
 	i40e_clear_rss_config_user(vsi);
 
-	pf->vsi[vsi->idx] = NULL;
-	if (vsi->idx < pf->next_vsi)
-		pf->next_vsi = vsi->idx;
-
 unlock_vsi:
 	mutex_unlock(&pf->switch_mutex);
 free_vsi:
+	i40e_mac_vlan_hash_free(vsi);
 	kfree(vsi);
 
 	return 0;
@@ -13425,6 +14397,12 @@ int i40e_reconfig_rss_queues(struct i40e_pf *pf, int queue_count)
 	if (queue_count != vsi->num_queue_pairs) {
 		u16 qcount;
 
+#ifdef HAVE_XDP_SUPPORT
+		/* try to change the queue count without dropping traffic */
+		if (!i40e_reconfig_rss_queues_hitless(pf, queue_count))
+			goto out;
+
+#endif
 		vsi->req_queue_pairs = queue_count;
 		i40e_prep_for_reset(pf);
 		if (test_bit(__I40E_IN_REMOVE, pf->state))
@@ -13449,6 +14427,9 @@ int i40e_reconfig_rss_queues(struct i40e_pf *pf, int queue_count)
 
 		i40e_pf_config_rss(pf);
 	}
+#ifdef HAVE_XDP_SUPPORT
+out:
+#endif
 	dev_info(&pf->pdev->dev, "User requested queue count/HW max RSS count:  %d/%d\n",
 		 vsi->req_queue_pairs, pf->rss_size_max);
 	return pf->alloc_rss_size;
@@ -13881,6 +14862,8 @@ static int i40e_sw_init(struct i40e_pf *pf)
 	pf->flags |= I40E_FLAG_VF_SOURCE_PRUNING;
 
 	mutex_init(&pf->switch_mutex);
+	mutex_init(&pf->vc_mutex);
+	pf->vf_stats_max_age = msecs_to_jiffies(max(vf_stats_age, 0));
 	mutex_init(&pf->tc_mutex);
 sw_init_done:
 	return err;
@@ -14663,6 +15646,473 @@ int i40e_queue_pair_enable(struct i40e_vsi *vsi, int queue_pair)
 	return err;
 }
 
+/**
+ * i40e_queue_pair_stop - Stop a queue pair of a running VSI
+ * @vsi: vsi
+ * @queue_pair: queue pair
+ *
+ * Quiesces one queue pair while the others keep running, so its rings can
+ * be replaced. Unlike i40e_queue_pair_disable() this keeps the statistics
+ * and leaves the rings alone, and the caller is expected to hold
+ * __I40E_CONFIG_BUSY already. On failure the queue pair is left running.
+ *
+ * Returns 0 on success, <0 on failure.
+ **/
+int i40e_queue_pair_stop(struct i40e_vsi *vsi, int queue_pair)
+{
+	struct netdev_queue *txq = netdev_get_tx_queue(vsi->netdev, queue_pair);
+	int err;
+
+	i40e_queue_pair_disable_irq(vsi, queue_pair);
+	i40e_queue_pair_toggle_napi(vsi, queue_pair, false /* off */);
+
+	/* with NAPI off nothing wakes the queue behind our back, and taking
+	 * the Tx lock flushes out a transmit in progress
+	 */
+	__netif_tx_lock_bh(txq);
+	netif_tx_stop_queue(txq);
+	__netif_tx_unlock_bh(txq);
+
+	err = i40e_queue_pair_toggle_rings(vsi, queue_pair, false /* off */);
+	if (err) {
+		i40e_queue_pair_toggle_napi(vsi, queue_pair, true /* on */);
+		i40e_queue_pair_enable_irq(vsi, queue_pair);
+		netif_tx_wake_queue(txq);
+	}
+
+	return err;
+}
+
+/**
+ * i40e_queue_pair_start - Restart a queue pair stopped by i40e_queue_pair_stop
+ * @vsi: vsi
+ * @queue_pair: queue pair
+ *
+ * Programs the rings of the queue pair, which may have been replaced in the
+ * meantime, and puts the queue pair back in service. NAPI and interrupts
+ * are restored even on failure, so the VSI can still be taken down.
+ *
+ * Returns 0 on success, <0 on failure.
+ **/
+int i40e_queue_pair_start(struct i40e_vsi *vsi, int queue_pair)
+{
+	struct netdev_queue *txq = netdev_get_tx_queue(vsi->netdev, queue_pair);
+	int err;
+
+	err = i40e_configure_tx_ring(vsi->tx_rings[queue_pair]);
+	if (!err && i40e_enabled_xdp_vsi(vsi))
+		err = i40e_configure_tx_ring(vsi->xdp_rings[queue_pair]);
+	if (!err)
+		err = i40e_configure_rx_ring(vsi->rx_rings[queue_pair]);
+	if (!err)
+		err = i40e_queue_pair_toggle_rings(vsi, queue_pair, true /* on */);
+
+	i40e_queue_pair_toggle_napi(vsi, queue_pair, true /* on */);
+	i40e_queue_pair_enable_irq(vsi, queue_pair);
+	netif_tx_wake_queue(txq);
+
+	return err;
+}
+
+/**
+ * i40e_vsi_restart_queue_pairs - Move the Rx queues to a new buffer size
+ * @vsi: vsi, up and running
+ * @max_frame: the largest frame the Rx queues are to accept
+ * @rx_buf_len: the new size of the Rx buffers
+ *
+ * Restarts the queue pairs one at a time, refilling each Rx ring with
+ * buffers of the new size, while the others keep passing traffic. Needs
+ * MSI-X, so that a queue pair can be quiesced on its own.
+ *
+ * Returns 0 on success, <0 on failure; the VSI then needs a reinit.
+ * Note: expects to be called while under rtnl_lock()
+ **/
+int i40e_vsi_restart_queue_pairs(struct i40e_vsi *vsi, u16 max_frame,
+				 u16 rx_buf_len)
+{
+	struct i40e_pf *pf = vsi->back;
+	int i, err;
+
+	if (!vsi->netdev || !(pf->flags & I40E_FLAG_MSIX_ENABLED) ||
+	    test_bit(__I40E_VSI_DOWN, vsi->state))
+		return -EOPNOTSUPP;
+
+	err = i40e_enter_busy_conf(vsi);
+	if (err)
+		return err;
+
+	vsi->max_frame = max_frame;
+	vsi->rx_buf_len = rx_buf_len;
+
+	for (i = 0; i < vsi->num_queue_pairs; i++) {
+		err = i40e_queue_pair_stop(vsi, i);
+		if (err)
+			break;
+		/* the buffers go back at the size they were allocated with */
+		i40e_queue_pair_clean_rings(vsi, i);
+		err = i40e_queue_pair_start(vsi, i);
+		if (err)
+			break;
+	}
+
+	i40e_exit_busy_conf(vsi);
+
+	return err;
+}
+
+/**
+ * i40e_q_vector_clear_rings - Leave a q_vector without rings
+ * @q_vector: the q_vector
+ **/
+static void i40e_q_vector_clear_rings(struct i40e_q_vector *q_vector)
+{
+	q_vector->num_ringpairs = 0;
+	q_vector->rx.count = 0;
+	q_vector->tx.count = 0;
+	q_vector->rx.ring = NULL;
+	q_vector->tx.ring = NULL;
+}
+
+/**
+ * i40e_vsi_add_queue_pair - Bring up one more queue pair on a running VSI
+ * @vsi: vsi
+ * @queue_pair: queue pair, with an unused q_vector of the same index
+ * @basename: name for the vector
+ *
+ * Returns 0 on success, <0 on failure.
+ **/
+static int i40e_vsi_add_queue_pair(struct i40e_vsi *vsi, int queue_pair,
+				   const char *basename)
+{
+	struct i40e_q_vector *q_vector = vsi->q_vectors[queue_pair];
+	struct i40e_ring *tx_ring = vsi->tx_rings[queue_pair];
+	struct i40e_ring *rx_ring = vsi->rx_rings[queue_pair];
+	int err;
+
+	tx_ring->count = vsi->num_tx_desc;
+	rx_ring->count = vsi->num_rx_desc;
+	err = i40e_setup_tx_descriptors(tx_ring);
+	if (err)
+		return err;
+	err = i40e_setup_rx_descriptors(rx_ring);
+	if (err)
+		goto free_tx;
+
+	/* one queue pair per q_vector, as i40e_vsi_map_rings_to_vectors()
+	 * does when there are enough vectors
+	 */
+	i40e_q_vector_clear_rings(q_vector);
+	q_vector->num_ringpairs = 1;
+	q_vector->reg_idx = q_vector->v_idx + vsi->base_vector - 1;
+	i40e_map_vector_to_qp(vsi, queue_pair, queue_pair);
+	i40e_vsi_configure_msix_vector(vsi, queue_pair,
+				       vsi->base_queue + queue_pair);
+
+	snprintf(q_vector->name, sizeof(q_vector->name) - 1,
+		 "%s-%s-%d", basename, "TxRx", queue_pair);
+	err = i40e_vsi_request_q_vector_irq(vsi, queue_pair);
+	if (err)
+		goto unmap;
+
+	/* only a single TC is handled here */
+	tx_ring->dcb_tc = 0;
+	rx_ring->dcb_tc = 0;
+	err = i40e_configure_tx_ring(tx_ring);
+	if (!err)
+		err = i40e_configure_rx_ring(rx_ring);
+	if (!err)
+		err = i40e_queue_pair_toggle_rings(vsi, queue_pair, true /* on */);
+	if (err)
+		goto free_irq;
+
+	napi_enable(&q_vector->napi);
+	i40e_queue_pair_enable_irq(vsi, queue_pair);
+
+	/* the queue may have been left stopped when it was last removed */
+	netif_tx_start_queue(netdev_get_tx_queue(vsi->netdev, queue_pair));
+
+	return 0;
+
+free_irq:
+	i40e_queue_pair_toggle_rings(vsi, queue_pair, false /* off */);
+	i40e_vsi_free_q_vector_irq(vsi, queue_pair);
+unmap:
+	i40e_q_vector_clear_rings(q_vector);
+	i40e_free_rx_resources(rx_ring);
+free_tx:
+	i40e_free_tx_resources(tx_ring);
+	return err;
+}
+
+/**
+ * i40e_vsi_remove_queue_pair - Take down a queue pair of a running VSI
+ * @vsi: vsi
+ * @queue_pair: queue pair, no longer used by the stack or by RSS
+ **/
+static void i40e_vsi_remove_queue_pair(struct i40e_vsi *vsi, int queue_pair)
+{
+	struct i40e_q_vector *q_vector = vsi->q_vectors[queue_pair];
+
+	i40e_queue_pair_disable_irq(vsi, queue_pair);
+	napi_disable(&q_vector->napi);
+	i40e_queue_pair_toggle_rings(vsi, queue_pair, false /* off */);
+	i40e_vsi_free_q_vector_irq(vsi, queue_pair);
+	i40e_free_tx_resources(vsi->tx_rings[queue_pair]);
+	i40e_free_rx_resources(vsi->rx_rings[queue_pair]);
+	i40e_q_vector_clear_rings(q_vector);
+}
+
+/**
+ * i40e_vsi_remap_queues - Update the queue map of a VSI in place
+ * @vsi: vsi
+ *
+ * Recomputes the TC queue map from vsi->req_queue_pairs and pushes it to
+ * the VSI, without touching the Tx scheduler.
+ *
+ * Returns 0 on success, negative on failure
+ **/
+static int i40e_vsi_remap_queues(struct i40e_vsi *vsi)
+{
+	struct i40e_pf *pf = vsi->back;
+	struct i40e_hw *hw = &pf->hw;
+	struct i40e_vsi_context ctxt;
+	int ret;
+
+	ctxt.seid = vsi->seid;
+	ctxt.pf_num = hw->pf_id;
+	ctxt.vf_num = 0;
+	ctxt.uplink_seid = vsi->uplink_seid;
+	ctxt.info = vsi->info;
+	i40e_vsi_setup_queue_map(vsi, &ctxt, vsi->tc_config.enabled_tc, false);
+
+	if (pf->flags & I40E_FLAG_IWARP_ENABLED) {
+		ctxt.info.valid_sections |=
+				cpu_to_le16(I40E_AQ_VSI_PROP_QUEUE_OPT_VALID);
+		ctxt.info.queueing_opt_flags |= I40E_AQ_VSI_QUE_OPT_TCP_ENA;
+	}
+
+	ret = i40e_aq_update_vsi_params(hw, &ctxt, NULL);
+	if (ret) {
+		dev_info(&pf->pdev->dev,
+			 "Update vsi queue map failed, err %s aq_err %s\n",
+			 i40e_stat_str(hw, ret),
+			 i40e_aq_str(hw, hw->aq.asq_last_status));
+		return -EIO;
+	}
+	/* update the local VSI info with updated queue map */
+	i40e_vsi_update_queue_map(vsi, &ctxt);
+	vsi->info.valid_sections = 0;
+
+	return 0;
+}
+
+/**
+ * i40e_rebalance_rss_lut - Spread a lookup table over a new queue count
+ * @lut: the lookup table in use, updated in place
+ * @lut_size: Lookup table size
+ * @rss_size: the new range of queue numbers for hashing
+ *
+ * Moves only as many entries as it takes for every queue to end up with an
+ * even share of the table: the entries pointing past @rss_size and those a
+ * queue holds beyond its share go to the queues short of theirs. All other
+ * entries, and the flows hashing to them, stay where they are.
+ *
+ * Returns 0 on success, negative on failure
+ **/
+static int i40e_rebalance_rss_lut(u8 *lut, u16 lut_size, u16 rss_size)
+{
+	const u8 unset = U8_MAX;
+	u16 share, extra, i, q;
+	u16 *count;
+
+	count = kcalloc(rss_size, sizeof(*count), GFP_KERNEL);
+	if (!count)
+		return -ENOMEM;
+
+	/* the first lut_size % rss_size queues get one entry more */
+	share = lut_size / rss_size;
+	extra = lut_size % rss_size;
+
+	for (i = 0; i < lut_size; i++) {
+		q = lut[i];
+		if (q < rss_size && count[q] < share + (q < extra))
+			count[q]++;
+		else
+			lut[i] = unset;
+	}
+
+	for (i = 0, q = 0; i < lut_size; i++) {
+		if (lut[i] != unset)
+			continue;
+		while (count[q] >= share + (q < extra))
+			q++;
+		lut[i] = q;
+		count[q]++;
+	}
+
+	kfree(count);
+
+	return 0;
+}
+
+/**
+ * i40e_vsi_rebalance_rss - Rebalance the RSS lookup table of a VSI
+ * @vsi: vsi
+ * @rss_size: the new range of queue numbers for hashing
+ *
+ * Returns 0 on success, negative on failure
+ **/
+static int i40e_vsi_rebalance_rss(struct i40e_vsi *vsi, u16 rss_size)
+{
+	u8 *lut;
+	int ret;
+
+	lut = kzalloc(vsi->rss_table_size, GFP_KERNEL);
+	if (!lut)
+		return -ENOMEM;
+
+	if (vsi->rss_lut_user) {
+		memcpy(lut, vsi->rss_lut_user, vsi->rss_table_size);
+	} else {
+		ret = i40e_get_rss(vsi, NULL, lut, vsi->rss_table_size);
+		if (ret)
+			goto out;
+	}
+
+	ret = i40e_rebalance_rss_lut(lut, vsi->rss_table_size, rss_size);
+	if (ret)
+		goto out;
+
+	ret = i40e_config_rss(vsi, NULL, lut, vsi->rss_table_size);
+	if (!ret && vsi->rss_lut_user)
+		memcpy(vsi->rss_lut_user, lut, vsi->rss_table_size);
+out:
+	kfree(lut);
+
+	return ret;
+}
+
+/**
+ * i40e_reconfig_rss_queues_hitless - change the queue count without a reset
+ * @pf: board private structure
+ * @queue_count: the requested queue count for rss
+ *
+ * Grows or shrinks the queue pairs of the running main VSI in place. New
+ * queue pairs are brought up one by one before the RSS lookup table is
+ * rebalanced onto them; on shrink the table is rebalanced away from the
+ * queue pairs, and ATR filters are flushed, before they go down. A user
+ * lookup table is kept when growing and rebalanced when shrinking. Only
+ * MSI-X with a q_vector per queue pair, a single TC and no XDP program is
+ * handled; anything else is left to the rebuild done by
+ * i40e_reconfig_rss_queues().
+ *
+ * Returns 0 on success, -EOPNOTSUPP if a rebuild is needed instead, other
+ * negative values on failure, with the queue count unchanged.
+ * Note: expects to be called while under rtnl_lock()
+ **/
+int i40e_reconfig_rss_queues_hitless(struct i40e_pf *pf, int queue_count)
+{
+	struct i40e_vsi *vsi = pf->vsi[pf->lan_vsi];
+	u16 old_alloc_rss_size = pf->alloc_rss_size;
+	u16 old_req_queue_pairs = vsi->req_queue_pairs;
+	u16 old_count = vsi->num_queue_pairs;
+	char int_name[I40E_INT_NAME_STR_LEN];
+	u16 rss_size;
+	int i, err;
+
+	if (!vsi->netdev || !netif_running(vsi->netdev) ||
+	    test_bit(__I40E_VSI_DOWN, vsi->state) ||
+	    !(pf->flags & I40E_FLAG_MSIX_ENABLED) ||
+	    vsi->tc_config.numtc != 1 || i40e_enabled_xdp_vsi(vsi) ||
+	    queue_count > vsi->num_q_vectors ||
+	    old_count > vsi->num_q_vectors)
+		return -EOPNOTSUPP;
+
+	err = i40e_enter_busy_conf(vsi);
+	if (err)
+		return err;
+
+	pf->alloc_rss_size = min_t(int, queue_count, pf->rss_size_max);
+	rss_size = pf->alloc_rss_size;
+	vsi->req_queue_pairs = queue_count;
+
+	if (queue_count > old_count) {
+		/* the queue map has to cover the new queue pairs first */
+		err = i40e_vsi_remap_queues(vsi);
+		vsi->num_queue_pairs = old_count;
+		if (err)
+			goto restore;
+
+		snprintf(int_name, sizeof(int_name) - 1, "%s-%s",
+			 dev_driver_string(&pf->pdev->dev), vsi->netdev->name);
+		for (i = old_count; i < queue_count; i++) {
+			err = i40e_vsi_add_queue_pair(vsi, i, int_name);
+			if (err)
+				break;
+		}
+		if (!err)
+			err = netif_set_real_num_tx_queues(vsi->netdev,
+							   queue_count);
+		if (!err)
+			err = netif_set_real_num_rx_queues(vsi->netdev,
+							   queue_count);
+		if (err) {
+			netif_set_real_num_tx_queues(vsi->netdev, old_count);
+			while (i-- > old_count)
+				i40e_vsi_remove_queue_pair(vsi, i);
+			goto restore;
+		}
+		vsi->num_queue_pairs = queue_count;
+
+		/* a user lookup table keeps steering where it was told to */
+		if (!vsi->rss_lut_user && i40e_vsi_rebalance_rss(vsi, rss_size))
+			dev_warn(&pf->pdev->dev,
+				 "Failed to spread RSS over the new queues\n");
+	} else {
+		/* the user hash key stays as is and a user lookup table is
+		 * rebalanced along with the default one, so driver state and
+		 * hardware keep matching
+		 */
+		err = i40e_vsi_rebalance_rss(vsi, rss_size);
+		if (err)
+			goto restore;
+
+		/* the stack flushes anything queued on the dropped queues */
+		netif_set_real_num_tx_queues(vsi->netdev, queue_count);
+		netif_set_real_num_rx_queues(vsi->netdev, queue_count);
+		vsi->num_queue_pairs = queue_count;
+
+		/* ATR filters may steer flows to the queues going away;
+		 * i40e_set_channels() already refuses sideband rules that do
+		 */
+		if ((pf->flags & I40E_FLAG_FD_ATR_ENABLED) &&
+		    i40e_get_current_atr_cnt(pf))
+			i40e_fdir_flush_and_replay(pf, true);
+
+		for (i = queue_count; i < old_count; i++)
+			i40e_vsi_remove_queue_pair(vsi, i);
+
+		/* a queue map wider than needed does no harm, keep going */
+		i40e_vsi_remap_queues(vsi);
+		vsi->num_queue_pairs = queue_count;
+	}
+
+	vsi->rss_size = rss_size;
+	i40e_exit_busy_conf(vsi);
+
+	return 0;
+
+restore:
+	vsi->req_queue_pairs = old_req_queue_pairs;
+	pf->alloc_rss_size = old_alloc_rss_size;
+	if (queue_count > old_count)
+		i40e_vsi_remap_queues(vsi);
+	vsi->num_queue_pairs = old_count;
+	i40e_exit_busy_conf(vsi);
+
+	return err;
+}
+
 /**
  * i40e_xdp_setup - add/remove an XDP program
  * @vsi: VSI to changed
@@ -15389,7 +16839,7 @@ static int i40e_config_netdev(struct i40e_vsi *vsi)
 	 * filter and add it for the new VLAN.
 	 *
 	 * Broadcast filters are handled specially by
-	 * i40e_sync_filters_subtask, as the driver must to set the broadcast
+	 * i40e_filter_sync_task, as the driver must to set the broadcast
 	 * promiscuous bit instead of adding this directly as a MAC/VLAN
 	 * filter. The subtask will update the correct broadcast promiscuous
 	 * bits as VLANs become active or inactive.
@@ -15420,6 +16870,9 @@ static int i40e_config_netdev(struct i40e_vsi *vsi)
 
 #ifdef HAVE_NET_DEVICE_OPS
 	netdev->netdev_ops = &i40e_netdev_ops;
+#ifdef HAVE_NETDEV_STAT_OPS
+	netdev->stat_ops = &i40e_stat_ops;
+#endif /* HAVE_NETDEV_STAT_OPS */
 #ifdef HAVE_RHEL6_NET_DEVICE_OPS_EXT
 	set_netdev_ops_ext(netdev, &i40e_netdev_ops_ext);
 #endif /* HAVE_RHEL6_NET_DEVICE_OPS_EXT */
@@ -17216,6 +18669,8 @@ static int i40e_init_recovery_mode(struct i40e_pf *pf, struct i40e_hw *hw)
 	pf->service_timer_period = HZ;
 
 	INIT_WORK(&pf->service_task, i40e_service_task);
+	INIT_WORK(&pf->filter_sync_task, i40e_filter_sync_task);
+	INIT_WORK(&pf->adminq_task, i40e_adminq_task);
 	clear_bit(__I40E_SERVICE_SCHED, pf->state);
 
 	err = i40e_init_interrupt_scheme(pf);
@@ -17456,10 +18911,15 @@ static int i40e_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	INIT_LIST_HEAD(&pf->l3_flex_pit_list);
 	INIT_LIST_HEAD(&pf->l4_flex_pit_list);
 	INIT_LIST_HEAD(&pf->ddp_old_prof);
+	hash_init(pf->fdir_loc_hash);
+	hash_init(pf->fdir_key_hash);
+	hash_init(pf->cloud_loc_hash);
+	hash_init(pf->cloud_cookie_hash);
 
 	/* set up the spinlocks for the AQ, do this only once in probe
 	 * and destroy them only once in remove
 	 */
+	spin_lock_init(&pf->aq_stats.lock);
 	i40e_init_spinlock_d(&hw->aq.asq_spinlock);
 	i40e_init_spinlock_d(&hw->aq.arq_spinlock);
 
@@ -17639,6 +19099,8 @@ static int i40e_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	pf->service_timer_period = HZ;
 
 	INIT_WORK(&pf->service_task, i40e_service_task);
+	INIT_WORK(&pf->filter_sync_task, i40e_filter_sync_task);
+	INIT_WORK(&pf->adminq_task, i40e_adminq_task);
 	clear_bit(__I40E_SERVICE_SCHED, pf->state);
 
 	/* NVM bit on means WoL not supported for the port */
@@ -18066,6 +19528,10 @@ static void i40e_remove(struct pci_dev *pdev)
 		i40e_free_vfs(pf);
 		pf->flags &= ~I40E_FLAG_SRIOV_ENABLED;
 	}
+	if (pf->vc_wq) {
+		destroy_workqueue(pf->vc_wq);
+		pf->vc_wq = NULL;
+	}
 	/* Turn off double VLAN */
 	if (i40e_is_double_vlan(&pf->hw))
 		i40e_aq_set_port_parameters(&pf->hw, 0, false, true, false,
@@ -18077,6 +19543,10 @@ static void i40e_remove(struct pci_dev *pdev)
 		del_timer_sync(&pf->service_timer);
 	if (pf->service_task.func)
 		cancel_work_sync(&pf->service_task);
+	if (pf->filter_sync_task.func)
+		cancel_work_sync(&pf->filter_sync_task);
+	if (pf->adminq_task.func)
+		cancel_work_sync(&pf->adminq_task);
 	/* Client close must be called explicitly here because the timer
 	 * has been stopped.
 	 */
@@ -18163,6 +19633,9 @@ unmap:
 	rtnl_unlock();
 
 debug_mode_clear:
+	/* the netdevs are gone, nothing can take a Tx key back anymore */
+	i40e_tx_keys_update(pf, false);
+
 	/* shutdown the adminq */
 	i40e_shutdown_adminq(hw);
 
@@ -18177,6 +19650,7 @@ debug_mode_clear:
 
 	kfree(pf->qp_pile);
 	kfree(pf->vsi);
+	kfree(pf->filter_sync_buf);
 
 	iounmap(hw->hw_addr);
 	kfree(pf);
@@ -18209,6 +19683,9 @@ static pci_ers_result_t i40e_pci_error_detected(struct pci_dev *pdev,
 		return PCI_ERS_RESULT_DISCONNECT;
 	}
 
+	/* the slot reset takes the port down along with the PF */
+	set_bit(__I40E_PORT_STATE_LOST, pf->state);
+
 	/* shutdown all operations */
 	if (!test_bit(__I40E_SUSPENDED, pf->state))
 		i40e_prep_for_reset(pf);
@@ -18271,6 +19748,7 @@ static void i40e_pci_error_reset_prepare(struct pci_dev *pdev)
 {
 	struct i40e_pf *pf = pci_get_drvdata(pdev);
 
+	set_bit(__I40E_PORT_STATE_LOST, pf->state);
 	i40e_prep_for_reset(pf);
 }
 
@@ -18400,6 +19878,8 @@ static void i40e_shutdown(struct pci_dev *pdev)
 
 	del_timer_sync(&pf->service_timer);
 	cancel_work_sync(&pf->service_task);
+	cancel_work_sync(&pf->filter_sync_task);
+	cancel_work_sync(&pf->adminq_task);
 	i40e_cloud_filter_exit(pf);
 	i40e_fdir_teardown(pf);
 
@@ -18490,6 +19970,8 @@ static int i40e_suspend(struct device *dev)
 	/* Ensure service task will not be running */
 	del_timer_sync(&pf->service_timer);
 	cancel_work_sync(&pf->service_task);
+	cancel_work_sync(&pf->filter_sync_task);
+	cancel_work_sync(&pf->adminq_task);
 
 	/* Client close must be called explicitly here because the timer
 	 * has been stopped.
@@ -18556,6 +20038,7 @@ static int i40e_resume(struct device *dev)
 	}
 
 	clear_bit(__I40E_DOWN, pf->state);
+	set_bit(__I40E_PORT_STATE_LOST, pf->state);
 	i40e_reset_and_rebuild(pf, false, true);
 
 	rtnl_unlock();
@@ -18721,6 +20204,18 @@ static int __init i40e_init_module(void)
 		pr_err("%s: Failed to create workqueue\n", i40e_driver_name);
 		return -ENOMEM;
 	}
+
+	/* AdminQ events are latency sensitive, VF mailbox round trips wait
+	 * on them, so they get a queue served by the high priority pools.
+	 */
+	i40e_aq_wq = alloc_workqueue("%s_aq", WQ_HIGHPRI | WQ_MEM_RECLAIM, 0,
+				     i40e_driver_name);
+	if (!i40e_aq_wq) {
+		pr_err("%s: Failed to create AdminQ workqueue\n",
+		       i40e_driver_name);
+		destroy_workqueue(i40e_wq);
+		return -ENOMEM;
+	}
 #ifdef HAVE_RHEL7_PCI_DRIVER_RH
 	/* The size member must be initialized in the driver via a call to
 	 * set_pci_driver_rh_size before pci_register_driver is called
@@ -18742,6 +20237,7 @@ module_init(i40e_init_module);
 static void __exit i40e_exit_module(void)
 {
 	pci_unregister_driver(&i40e_driver);
+	destroy_workqueue(i40e_aq_wq);
 	destroy_workqueue(i40e_wq);
 	ida_destroy(&i40e_client_ida);
 	i40e_dbg_exit();
@@ -81,6 +81,18 @@ do {								\
 			(h)->bus.func, ##__VA_ARGS__);		\
 } while (0)
 
+/* AdminQ command accounting, implemented by the driver */
+struct i40e_hw;
+struct i40e_aq_desc;
+u64 i40e_aq_stats_submit_d(struct i40e_hw *hw, struct i40e_aq_desc *desc);
+void i40e_aq_stats_complete_d(struct i40e_hw *hw, struct i40e_aq_desc *desc,
+			      bool timeout, u64 start);
+void i40e_aq_stats_arq_d(struct i40e_hw *hw, struct i40e_aq_desc *desc);
+
+#define i40e_aq_stats_submit(h, d) i40e_aq_stats_submit_d(h, d)
+#define i40e_aq_stats_complete(h, d, t, s) i40e_aq_stats_complete_d(h, d, t, s)
+#define i40e_aq_stats_arq(h, d) i40e_aq_stats_arq_d(h, d)
+
 /* these things are all directly replaced with sed during the kernel build */
 #define INLINE inline
 
@@ -51,6 +51,11 @@ i40e_asq_send_command_v2(struct i40e_hw *hw,
 			 struct i40e_asq_cmd_details *cmd_details,
 			 enum i40e_admin_queue_err *aq_status);
 
+void i40e_fill_async_cmd_details(struct i40e_asq_cmd_details *details,
+				 I40E_ADMINQ_ASYNC_CB cb, void *cb_data);
+u16 i40e_asq_clean_async(struct i40e_hw *hw);
+i40e_status i40e_asq_wait_async(struct i40e_hw *hw, u32 timeout);
+
 /* debug function for adminq */
 void i40e_debug_aq(struct i40e_hw *hw, enum i40e_debug_mask mask,
 		   void *desc, void *buffer, u16 buf_len);
@@ -1403,6 +1403,7 @@ static int i40e_ptp_set_timestamp_mode(struct i40e_pf *pf,
 	default:
 		return -ERANGE;
 	}
+	i40e_tx_keys_update(pf, true);
 
 	switch (config->rx_filter) {
 	case HWTSTAMP_FILTER_NONE:
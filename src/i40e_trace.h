@@ -210,10 +210,364 @@ DEFINE_EVENT(
 
 	TP_ARGS(skb, ring));
 
+/* Rx buffer allocation failures, split like the rx_stats counters */
+DECLARE_EVENT_CLASS(
+	i40e_rx_alloc_template,
+
+	TP_PROTO(struct i40e_ring *ring),
+
+	TP_ARGS(ring),
+
+	TP_STRUCT__entry(
+		__field(void*, ring)
+		__field(u16, queue_index)
+		__field(u16, next_to_use)
+		__string(devname, ring->netdev ? ring->netdev->name : "fdir")
+	),
+
+	TP_fast_assign(
+		__entry->ring = ring;
+		__entry->queue_index = ring->queue_index;
+		__entry->next_to_use = ring->next_to_use;
+		__assign_str(devname,
+			     ring->netdev ? ring->netdev->name : "fdir");
+	),
+
+	TP_printk(
+		"netdev: %s ring: %p queue: %u next_to_use: %u",
+		__get_str(devname), __entry->ring,
+		__entry->queue_index, __entry->next_to_use)
+);
+
+DEFINE_EVENT(
+	i40e_rx_alloc_template, i40e_rx_alloc_page_failed,
+	TP_PROTO(struct i40e_ring *ring),
+
+	TP_ARGS(ring));
+
+DEFINE_EVENT(
+	i40e_rx_alloc_template, i40e_rx_alloc_buff_failed,
+	TP_PROTO(struct i40e_ring *ring),
+
+	TP_ARGS(ring));
+
+/*
+ * XDP verdicts of an Rx clean batch. The verdict counts are the ring's
+ * running xdp_stats totals, so consecutive events on the same ring give
+ * the per-batch breakdown; xdp_res carries the I40E_XDP_TX/REDIR bits
+ * that the batch left to be flushed.
+ */
+TRACE_EVENT(
+	i40e_xdp_rx_batch,
+
+	TP_PROTO(struct i40e_ring *ring, unsigned int xdp_res),
+
+	TP_ARGS(ring, xdp_res),
+
+	TP_STRUCT__entry(
+		__field(void*, ring)
+		__field(unsigned int, xdp_res)
+		__field(u16, queue_index)
+		__field(u64, pass)
+		__field(u64, drop)
+		__field(u64, tx)
+		__field(u64, redirect)
+		__field(u64, redirect_fail)
+		__field(u64, unknown)
+		__string(devname, ring->netdev ? ring->netdev->name : "fdir")
+	),
+
+	TP_fast_assign(
+		__entry->ring = ring;
+		__entry->xdp_res = xdp_res;
+		__entry->queue_index = ring->queue_index;
+		__entry->pass = ring->xdp_stats.xdp_pass;
+		__entry->drop = ring->xdp_stats.xdp_drop;
+		__entry->tx = ring->xdp_stats.xdp_tx;
+		__entry->redirect = ring->xdp_stats.xdp_redirect;
+		__entry->redirect_fail = ring->xdp_stats.xdp_redirect_fail;
+		__entry->unknown = ring->xdp_stats.xdp_unknown;
+		__assign_str(devname,
+			     ring->netdev ? ring->netdev->name : "fdir");
+	),
+
+	TP_printk(
+		"netdev: %s queue: %u xdp_res: 0x%x pass: %llu drop: %llu tx: %llu redirect: %llu redirect_fail: %llu unknown: %llu",
+		__get_str(devname), __entry->queue_index, __entry->xdp_res,
+		__entry->pass, __entry->drop, __entry->tx, __entry->redirect,
+		__entry->redirect_fail, __entry->unknown)
+);
+
+/* Tx queue flow control; needed is the descriptor count being waited on */
+DECLARE_EVENT_CLASS(
+	i40e_tx_queue_template,
+
+	TP_PROTO(struct i40e_ring *ring, u16 unused, u16 needed),
+
+	TP_ARGS(ring, unused, needed),
+
+	TP_STRUCT__entry(
+		__field(void*, ring)
+		__field(u16, unused)
+		__field(u16, needed)
+		__field(u16, queue_index)
+		__string(devname, ring->netdev ? ring->netdev->name : "fdir")
+	),
+
+	TP_fast_assign(
+		__entry->ring = ring;
+		__entry->unused = unused;
+		__entry->needed = needed;
+		__entry->queue_index = ring->queue_index;
+		__assign_str(devname,
+			     ring->netdev ? ring->netdev->name : "fdir");
+	),
+
+	TP_printk(
+		"netdev: %s ring: %p queue: %u unused: %u needed: %u",
+		__get_str(devname), __entry->ring, __entry->queue_index,
+		__entry->unused, __entry->needed)
+);
+
+DEFINE_EVENT(
+	i40e_tx_queue_template, i40e_tx_stop,
+	TP_PROTO(struct i40e_ring *ring, u16 unused, u16 needed),
+
+	TP_ARGS(ring, unused, needed));
+
+DEFINE_EVENT(
+	i40e_tx_queue_template, i40e_tx_restart,
+	TP_PROTO(struct i40e_ring *ring, u16 unused, u16 needed),
+
+	TP_ARGS(ring, unused, needed));
+
+/*
+ * Interrupt moderation. The ITR values are in usecs with the
+ * I40E_ITR_ADAPTIVE_LATENCY mode bit stripped.
+ */
+TRACE_EVENT(
+	i40e_update_itr,
+
+	TP_PROTO(struct i40e_q_vector *q_vector, bool is_rx, u16 old_itr,
+		 u16 new_itr, unsigned int packets, unsigned int bytes),
+
+	TP_ARGS(q_vector, is_rx, old_itr, new_itr, packets, bytes),
+
+	TP_STRUCT__entry(
+		__field(void*, q_vector)
+		__field(bool, is_rx)
+		__field(u16, old_itr)
+		__field(u16, new_itr)
+		__field(unsigned int, packets)
+		__field(unsigned int, bytes)
+		__field(u16, v_idx)
+		__field(bool, old_latency)
+		__field(bool, new_latency)
+	),
+
+	TP_fast_assign(
+		__entry->q_vector = q_vector;
+		__entry->is_rx = is_rx;
+		__entry->old_itr = old_itr & I40E_ITR_MASK;
+		__entry->new_itr = new_itr & I40E_ITR_MASK;
+		__entry->packets = packets;
+		__entry->bytes = bytes;
+		__entry->v_idx = q_vector->v_idx;
+		__entry->old_latency = !!(old_itr & I40E_ITR_ADAPTIVE_LATENCY);
+		__entry->new_latency = !!(new_itr & I40E_ITR_ADAPTIVE_LATENCY);
+	),
+
+	TP_printk(
+		"q_vector: %u %s itr: %u%s -> %u%s packets: %u bytes: %u",
+		__entry->v_idx, __entry->is_rx ? "rx" : "tx",
+		__entry->old_itr, __entry->old_latency ? " latency" : " bulk",
+		__entry->new_itr, __entry->new_latency ? " latency" : " bulk",
+		__entry->packets, __entry->bytes)
+);
+
+TRACE_EVENT(
+	i40e_force_wb,
+
+	TP_PROTO(struct i40e_vsi *vsi, struct i40e_q_vector *q_vector),
+
+	TP_ARGS(vsi, q_vector),
+
+	TP_STRUCT__entry(
+		__field(void*, vsi)
+		__field(void*, q_vector)
+		__field(u16, seid)
+		__field(u16, v_idx)
+		__field(u16, reg_idx)
+	),
+
+	TP_fast_assign(
+		__entry->vsi = vsi;
+		__entry->q_vector = q_vector;
+		__entry->seid = vsi->seid;
+		__entry->v_idx = q_vector->v_idx;
+		__entry->reg_idx = q_vector->reg_idx;
+	),
+
+	TP_printk(
+		"vsi: %u q_vector: %u reg_idx: %u",
+		__entry->seid, __entry->v_idx, __entry->reg_idx)
+);
+
 /*
  * Events unique to the PF.
  */
 
+TRACE_EVENT(
+	i40e_fd_status,
+
+	TP_PROTO(struct i40e_hw *hw, u32 error, u32 fd_id),
+
+	TP_ARGS(hw, error, fd_id),
+
+	TP_STRUCT__entry(
+		__field(u16, bus)
+		__field(u16, dev)
+		__field(u16, func)
+		__field(u32, error)
+		__field(u32, fd_id)
+	),
+
+	TP_fast_assign(
+		__entry->bus = hw->bus.bus_id;
+		__entry->dev = hw->bus.device;
+		__entry->func = hw->bus.func;
+		__entry->error = error;
+		__entry->fd_id = fd_id;
+	),
+
+	TP_printk(
+		"%02x:%02x.%x error: 0x%x fd_id: %u",
+		__entry->bus, __entry->dev, __entry->func,
+		__entry->error, __entry->fd_id)
+);
+
+TRACE_EVENT(
+	i40e_aq_submit,
+
+	TP_PROTO(struct i40e_hw *hw, u16 opcode, u16 datalen),
+
+	TP_ARGS(hw, opcode, datalen),
+
+	TP_STRUCT__entry(
+		__field(u16, bus)
+		__field(u16, dev)
+		__field(u16, func)
+		__field(u16, opcode)
+		__field(u16, datalen)
+	),
+
+	TP_fast_assign(
+		__entry->bus = hw->bus.bus_id;
+		__entry->dev = hw->bus.device;
+		__entry->func = hw->bus.func;
+		__entry->opcode = opcode;
+		__entry->datalen = datalen;
+	),
+
+	TP_printk(
+		"%02x:%02x.%x opcode: 0x%04x datalen: %u",
+		__entry->bus, __entry->dev, __entry->func,
+		__entry->opcode, __entry->datalen)
+);
+
+TRACE_EVENT(
+	i40e_aq_complete,
+
+	TP_PROTO(struct i40e_hw *hw, u16 opcode, u16 retval, bool timeout,
+		 u64 latency_us),
+
+	TP_ARGS(hw, opcode, retval, timeout, latency_us),
+
+	TP_STRUCT__entry(
+		__field(u16, bus)
+		__field(u16, dev)
+		__field(u16, func)
+		__field(u16, opcode)
+		__field(u16, retval)
+		__field(bool, timeout)
+		__field(u64, latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->bus = hw->bus.bus_id;
+		__entry->dev = hw->bus.device;
+		__entry->func = hw->bus.func;
+		__entry->opcode = opcode;
+		__entry->retval = retval;
+		__entry->timeout = timeout;
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk(
+		"%02x:%02x.%x opcode: 0x%04x retval: %u timeout: %d latency: %llu us",
+		__entry->bus, __entry->dev, __entry->func,
+		__entry->opcode, __entry->retval, __entry->timeout,
+		__entry->latency_us)
+);
+
+TRACE_EVENT(
+	i40e_rebuild_phase,
+
+	TP_PROTO(struct i40e_hw *hw, const char *phase, u64 latency_us),
+
+	TP_ARGS(hw, phase, latency_us),
+
+	TP_STRUCT__entry(
+		__field(u16, bus)
+		__field(u16, dev)
+		__field(u16, func)
+		__array(char, phase, I40E_REBUILD_PHASE_NAME_LEN)
+		__field(u64, latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->bus = hw->bus.bus_id;
+		__entry->dev = hw->bus.device;
+		__entry->func = hw->bus.func;
+		strscpy(__entry->phase, phase, sizeof(__entry->phase));
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk(
+		"%02x:%02x.%x phase: %s latency: %llu us",
+		__entry->bus, __entry->dev, __entry->func,
+		__entry->phase, __entry->latency_us)
+);
+
+TRACE_EVENT(
+	i40e_rebuild_done,
+
+	TP_PROTO(struct i40e_hw *hw, bool port_reset, u64 latency_us),
+
+	TP_ARGS(hw, port_reset, latency_us),
+
+	TP_STRUCT__entry(
+		__field(u16, bus)
+		__field(u16, dev)
+		__field(u16, func)
+		__field(bool, port_reset)
+		__field(u64, latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->bus = hw->bus.bus_id;
+		__entry->dev = hw->bus.device;
+		__entry->func = hw->bus.func;
+		__entry->port_reset = port_reset;
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk(
+		"%02x:%02x.%x port_reset: %d latency: %llu us",
+		__entry->bus, __entry->dev, __entry->func,
+		__entry->port_reset, __entry->latency_us)
+);
+
 #endif /* _I40E_TRACE_H_ */
 /* This must be outside ifdef _I40E_TRACE_H */
 
@@ -2,6 +2,9 @@
 /* Copyright (C) 2013-2023 Intel Corporation */
 
 #include <linux/prefetch.h>
+#ifndef NEED_INDIRECT_CALL_WRAPPER_MACROS
+#include <linux/indirect_call_wrapper.h>
+#endif /* NEED_INDIRECT_CALL_WRAPPER_MACROS */
 #ifdef HAVE_XDP_SUPPORT
 #include <net/xdp.h>
 #endif
@@ -91,6 +94,7 @@ static int i40e_program_fdir_filter(struct i40e_fdir_filter *fdir_data,
 {
 	struct i40e_tx_buffer *tx_buf, *first;
 	struct i40e_tx_desc *tx_desc;
+	struct i40e_tx_dma *tx_dma;
 	struct i40e_ring *tx_ring;
 	struct i40e_vsi *vsi;
 	struct device *dev;
@@ -128,14 +132,15 @@ static int i40e_program_fdir_filter(struct i40e_fdir_filter *fdir_data,
 	i = tx_ring->next_to_use;
 	tx_desc = I40E_TX_DESC(tx_ring, i);
 	tx_buf = &tx_ring->tx_bi[i];
+	tx_dma = &tx_ring->tx_dma[i];
 
 	tx_ring->next_to_use = ((i + 1) < tx_ring->count) ? i + 1 : 0;
 
 	memset(tx_buf, 0, sizeof(struct i40e_tx_buffer));
 
 	/* record length, and DMA address */
-	dma_unmap_len_set(tx_buf, len, I40E_FDIR_MAX_RAW_PACKET_SIZE);
-	dma_unmap_addr_set(tx_buf, dma, dma);
+	dma_unmap_len_set(tx_dma, len, I40E_FDIR_MAX_RAW_PACKET_SIZE);
+	dma_unmap_addr_set(tx_dma, dma, dma);
 
 	tx_desc->buffer_addr = cpu_to_le64(dma);
 	td_cmd = I40E_TXD_CMD | I40E_TX_DESC_CMD_DUMMY;
@@ -297,6 +302,33 @@ static void i40e_create_dummy_sctp_packet(u8 *raw_packet, bool ipv4,
 	sctp->source = data->src_port;
 }
 
+/**
+ * i40e_fdir_set_flex_word - place the user flex word into a dummy packet
+ * @fd_data: filter data
+ * @packet_addr: address of dummy packet
+ * @payload_offset: offset from dummy packet address to user defined data
+ **/
+static void i40e_fdir_set_flex_word(struct i40e_fdir_filter *fd_data,
+				    u8 *packet_addr, int payload_offset)
+{
+	__be16 pattern = fd_data->flex_word;
+	u16 off = fd_data->flex_offset;
+	u8 *payload;
+
+	if (!fd_data->flex_filter)
+		return;
+
+	payload = (packet_addr + payload_offset);
+
+	/* If user provided vlan, offset payload by vlan
+	 * header length
+	 */
+	if (!!fd_data->vlan_tag)
+		payload += VLAN_HLEN;
+
+	*((__force __be16 *)(payload + off)) = pattern;
+}
+
 /**
  * i40e_prepare_fdir_filter - Prepare and program fdir filter
  * @pf: physical function to attach filter to
@@ -316,21 +348,7 @@ static int i40e_prepare_fdir_filter(struct i40e_pf *pf,
 {
 	int ret = 0;
 
-	if (fd_data->flex_filter) {
-		u8 *payload;
-		__be16 pattern = fd_data->flex_word;
-		u16 off = fd_data->flex_offset;
-
-		payload = (packet_addr + payload_offset);
-
-		/* If user provided vlan, offset payload by vlan
-		 * header length
-		 */
-		if (!!fd_data->vlan_tag)
-			payload += VLAN_HLEN;
-
-		*((__force __be16 *)(payload + off)) = pattern;
-	}
+	i40e_fdir_set_flex_word(fd_data, (u8 *)packet_addr, payload_offset);
 
 	fd_data->pctype = pctype;
 	ret = i40e_program_fdir_filter(fd_data, packet_addr, pf, add);
@@ -517,36 +535,29 @@ err:
 }
 
 /**
- * i40e_add_del_fdir_ip - Add/Remove IPv4/v6 Flow Director filter
- * @vsi: pointer to the targeted VSI
+ * i40e_add_del_fdir_ip_pctypes - Add/Remove IPv4/v6 filters from a pctype on
+ * @pf: board private structure
  * @fd_data: the flow director data required for the FDir descriptor
  * @add: true adds a filter, false removes it
  * @ipv4: true is v4, false is v6
+ * @first: first pctype of the IP flow spec to program
  *
- * Adds or removes IPv4 or IPv6 filters for a specific flow spec.
+ * Programs the pctypes from @first up to the fragmented one, one by one.
  * Returns 0 if the filters were successfully added or removed.
  **/
-static int i40e_add_del_fdir_ip(struct i40e_vsi *vsi,
-				struct i40e_fdir_filter *fd_data,
-				bool add,
-				bool ipv4)
+static int i40e_add_del_fdir_ip_pctypes(struct i40e_pf *pf,
+					struct i40e_fdir_filter *fd_data,
+					bool add, bool ipv4, u8 first)
 {
-	struct i40e_pf *pf = vsi->back;
 	u8 *raw_packet;
-	int iter_start;
 	int iter_end;
 	int ret;
 	int i;
 
-	if (ipv4) {
-		iter_start = I40E_FILTER_PCTYPE_NONF_IPV4_OTHER;
-		iter_end = I40E_FILTER_PCTYPE_FRAG_IPV4;
-	} else {
-		iter_start = I40E_FILTER_PCTYPE_NONF_IPV6_OTHER;
-		iter_end = I40E_FILTER_PCTYPE_FRAG_IPV6;
-	}
+	iter_end = ipv4 ? I40E_FILTER_PCTYPE_FRAG_IPV4 :
+		I40E_FILTER_PCTYPE_FRAG_IPV6;
 
-	for (i = iter_start; i <= iter_end; i++) {
+	for (i = first; i <= iter_end; i++) {
 		int payload_offset;
 
 		raw_packet = (u8 *)kzalloc(I40E_FDIR_MAX_RAW_PACKET_SIZE, GFP_KERNEL);
@@ -566,14 +577,41 @@ static int i40e_add_del_fdir_ip(struct i40e_vsi *vsi,
 			goto err;
 	}
 
-	i40e_change_filter_num(ipv4, add, &pf->fd_ip4_filter_cnt,
-			       &pf->fd_ip6_filter_cnt);
 	return 0;
 err:
 	kfree(raw_packet);
 	return ret;
 }
 
+/**
+ * i40e_add_del_fdir_ip - Add/Remove IPv4/v6 Flow Director filter
+ * @vsi: pointer to the targeted VSI
+ * @fd_data: the flow director data required for the FDir descriptor
+ * @add: true adds a filter, false removes it
+ * @ipv4: true is v4, false is v6
+ *
+ * Adds or removes IPv4 or IPv6 filters for a specific flow spec.
+ * Returns 0 if the filters were successfully added or removed.
+ **/
+static int i40e_add_del_fdir_ip(struct i40e_vsi *vsi,
+				struct i40e_fdir_filter *fd_data,
+				bool add,
+				bool ipv4)
+{
+	struct i40e_pf *pf = vsi->back;
+	int ret;
+
+	ret = i40e_add_del_fdir_ip_pctypes(pf, fd_data, add, ipv4,
+					   ipv4 ? I40E_FILTER_PCTYPE_NONF_IPV4_OTHER :
+					   I40E_FILTER_PCTYPE_NONF_IPV6_OTHER);
+	if (ret)
+		return ret;
+
+	i40e_change_filter_num(ipv4, add, &pf->fd_ip4_filter_cnt,
+			       &pf->fd_ip6_filter_cnt);
+	return 0;
+}
+
 /**
  * i40e_add_del_fdir - Build raw packets to add/del fdir filter
  * @vsi: pointer to the targeted VSI
@@ -666,6 +704,350 @@ int i40e_add_del_fdir(struct i40e_vsi *vsi,
 	return ret;
 }
 
+#define I40E_FD_BULK_WAIT_LOOPS		200
+#define I40E_FD_BULK_WAIT_MIN_US	50
+#define I40E_FD_BULK_WAIT_MAX_US	100
+/**
+ * i40e_fdir_bulk_flush - Hand the queued programming descriptors to HW
+ * @bulk: bulk programming context
+ *
+ * All descriptors queued since the last flush are released to hardware
+ * with a single tail write.
+ **/
+static void i40e_fdir_bulk_flush(struct i40e_fdir_bulk *bulk)
+{
+	struct i40e_ring *tx_ring = bulk->tx_ring;
+
+	if (!bulk->pending)
+		return;
+
+	/* Force memory writes to complete before letting h/w
+	 * know there are new descriptors to fetch.
+	 */
+	wmb();
+	writel(tx_ring->next_to_use, tx_ring->tail);
+	bulk->pending = 0;
+}
+
+/**
+ * i40e_fdir_bulk_reserve - Make room for one filter on the FDIR ring
+ * @bulk: bulk programming context
+ *
+ * When the ring is full the descriptors queued so far are flushed and we
+ * poll for the FDIR interrupt handler to reclaim completed entries. Unlike
+ * i40e_program_fdir_filter() this uses short sleeps, since a bulk caller
+ * is expected to refill the ring many times in a row.
+ **/
+static int i40e_fdir_bulk_reserve(struct i40e_fdir_bulk *bulk)
+{
+	struct i40e_ring *tx_ring = bulk->tx_ring;
+	int i;
+
+	if (likely(I40E_DESC_UNUSED(tx_ring) >= 2))
+		return 0;
+
+	i40e_fdir_bulk_flush(bulk);
+
+	for (i = I40E_FD_BULK_WAIT_LOOPS; I40E_DESC_UNUSED(tx_ring) < 2; i--) {
+		if (!i)
+			return -EAGAIN;
+		usleep_range(I40E_FD_BULK_WAIT_MIN_US,
+			     I40E_FD_BULK_WAIT_MAX_US);
+	}
+
+	return 0;
+}
+
+/**
+ * i40e_fdir_bulk_queue - Queue one filter program/dummy descriptor pair
+ * @bulk: bulk programming context
+ * @fd_data: filter data
+ * @add: true adds a filter, false removes it
+ * @ipv4: is layer 3 packet of version 4 or 6
+ * @l4proto: layer 4 protocol of the dummy packet
+ * @payload_offset: offset from dummy packet address to user defined data
+ * @pctype: Packet type for which filter is used
+ *
+ * The dummy packet is built in place in the pre-mapped arena slot that
+ * belongs to the dummy descriptor, so no allocation or DMA mapping is
+ * needed. The tail is not bumped here, see i40e_fdir_bulk_flush().
+ **/
+static int i40e_fdir_bulk_queue(struct i40e_fdir_bulk *bulk,
+				struct i40e_fdir_filter *fd_data, bool add,
+				bool ipv4, u8 l4proto, int payload_offset,
+				u8 pctype)
+{
+	struct i40e_ring *tx_ring = bulk->tx_ring;
+	struct i40e_tx_buffer *tx_buf, *first;
+	struct i40e_pf *pf = bulk->pf;
+	struct i40e_tx_desc *tx_desc;
+	u8 *raw_packet;
+	dma_addr_t dma;
+	u16 i;
+	int err;
+
+	err = i40e_fdir_bulk_reserve(bulk);
+	if (err)
+		return err;
+
+	first = &tx_ring->tx_bi[tx_ring->next_to_use];
+
+	fd_data->pctype = pctype;
+	i40e_fdir(tx_ring, fd_data, add);
+
+	/* Now program a dummy descriptor out of the arena */
+	i = tx_ring->next_to_use;
+	tx_desc = I40E_TX_DESC(tx_ring, i);
+	tx_buf = &tx_ring->tx_bi[i];
+
+	raw_packet = pf->fdir_arena + i * I40E_FDIR_MAX_RAW_PACKET_SIZE;
+	dma = pf->fdir_arena_dma + i * I40E_FDIR_MAX_RAW_PACKET_SIZE;
+
+	memset(raw_packet, 0, I40E_FDIR_MAX_RAW_PACKET_SIZE);
+	switch (l4proto) {
+	case IPPROTO_TCP:
+		i40e_create_dummy_tcp_packet(raw_packet, ipv4, fd_data);
+		break;
+	case IPPROTO_UDP:
+		i40e_create_dummy_udp_packet(raw_packet, ipv4, fd_data);
+		break;
+	case IPPROTO_SCTP:
+		i40e_create_dummy_sctp_packet(raw_packet, ipv4, IPPROTO_SCTP,
+					      fd_data);
+		break;
+	default:
+		/* IPv6 no header option differs from IPv4 */
+		(void)i40e_create_dummy_packet
+			(raw_packet, ipv4, (ipv4) ? IPPROTO_IP : IPPROTO_NONE,
+			 fd_data);
+		break;
+	}
+	i40e_fdir_set_flex_word(fd_data, raw_packet, payload_offset);
+
+	tx_ring->next_to_use = ((i + 1) < tx_ring->count) ? i + 1 : 0;
+
+	/* the arena stays mapped, so leave the unmap length at zero */
+	memset(tx_buf, 0, sizeof(struct i40e_tx_buffer));
+	dma_unmap_len_set(&tx_ring->tx_dma[i], len, 0);
+	tx_buf->tx_flags = I40E_TX_FLAGS_FD_SB_ARENA;
+
+	tx_desc->buffer_addr = cpu_to_le64(dma);
+	tx_desc->cmd_type_offset_bsz =
+		build_ctob(I40E_TXD_CMD | I40E_TX_DESC_CMD_DUMMY, 0,
+			   I40E_FDIR_MAX_RAW_PACKET_SIZE, 0);
+
+	/* descriptors must be visible before the cleaner can see the pair */
+	smp_wmb();
+	first->next_to_watch = tx_desc;
+
+	bulk->pending++;
+	pf->fd_sb_bulk_queued++;
+
+	return 0;
+}
+
+/**
+ * i40e_fdir_bulk_begin - Prepare for bulk sideband filter programming
+ * @pf: board private structure
+ * @bulk: bulk programming context to initialize
+ *
+ * Looks up the FDIR ring and makes sure the dummy packet arena, one
+ * I40E_FDIR_MAX_RAW_PACKET_SIZE slot per FDIR descriptor, is allocated.
+ * Callers must serialize against other FDIR ring producers the same way
+ * i40e_add_del_fdir() callers do.
+ *
+ * Returns 0 on success, negative on failure
+ **/
+int i40e_fdir_bulk_begin(struct i40e_pf *pf, struct i40e_fdir_bulk *bulk)
+{
+	struct i40e_ring *tx_ring;
+	struct i40e_vsi *vsi;
+	size_t size;
+
+	vsi = i40e_find_vsi_by_type(pf, I40E_VSI_FDIR);
+	if (!vsi || !vsi->tx_rings || !vsi->tx_rings[0])
+		return -ENOENT;
+
+	tx_ring = vsi->tx_rings[0];
+	if (!tx_ring->desc)
+		return -ENOENT;
+
+	if (!pf->fdir_arena) {
+		size = (size_t)tx_ring->count * I40E_FDIR_MAX_RAW_PACKET_SIZE;
+		pf->fdir_arena = dma_alloc_coherent(&pf->pdev->dev, size,
+						    &pf->fdir_arena_dma,
+						    GFP_KERNEL);
+		if (!pf->fdir_arena)
+			return -ENOMEM;
+		pf->fdir_arena_size = size;
+	}
+
+	bulk->pf = pf;
+	bulk->tx_ring = tx_ring;
+	bulk->pending = 0;
+
+	return 0;
+}
+
+/**
+ * i40e_fdir_bulk_add - Queue a sideband filter add or delete
+ * @bulk: bulk programming context from i40e_fdir_bulk_begin()
+ * @input: filter to add or delete
+ * @add: true adds a filter, false removes it
+ *
+ * Mirrors i40e_add_del_fdir(), but the descriptors are only released to
+ * hardware when the ring fills up or on i40e_fdir_bulk_commit(). The
+ * programming result is reported asynchronously through
+ * i40e_fd_handle_status() like for any other sideband filter.
+ *
+ * Returns 0 if the filter was queued. -EAGAIN means the ring had no room
+ * and nothing of @input went out, so the caller may fall back to
+ * i40e_add_del_fdir(). Any other error is final.
+ **/
+int i40e_fdir_bulk_add(struct i40e_fdir_bulk *bulk,
+		       struct i40e_fdir_filter *input, bool add)
+{
+	struct i40e_pf *pf = bulk->pf;
+	u16 *ipv4_cnt, *ipv6_cnt;
+	int payload_offset;
+	u8 l4proto;
+	u8 i, first, last;
+	bool ipv4;
+	int err;
+
+	switch (input->flow_type) {
+	case TCP_V4_FLOW:
+	case TCP_V6_FLOW:
+		l4proto = IPPROTO_TCP;
+		break;
+	case UDP_V4_FLOW:
+	case UDP_V6_FLOW:
+		l4proto = IPPROTO_UDP;
+		break;
+	case SCTP_V4_FLOW:
+	case SCTP_V6_FLOW:
+		l4proto = IPPROTO_SCTP;
+		break;
+	case IP_USER_FLOW:
+#ifdef HAVE_ETHTOOL_FLOW_UNION_IP6_SPEC
+	case IPV6_USER_FLOW:
+#endif /* HAVE_ETHTOOL_FLOW_UNION_IP6_SPEC */
+		l4proto = input->ipl4_proto;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	switch (input->flow_type) {
+	case TCP_V6_FLOW:
+	case UDP_V6_FLOW:
+	case SCTP_V6_FLOW:
+#ifdef HAVE_ETHTOOL_FLOW_UNION_IP6_SPEC
+	case IPV6_USER_FLOW:
+#endif /* HAVE_ETHTOOL_FLOW_UNION_IP6_SPEC */
+		ipv4 = false;
+		break;
+	default:
+		ipv4 = true;
+		break;
+	}
+
+	switch (l4proto) {
+	case IPPROTO_TCP:
+		err = i40e_fdir_bulk_queue(bulk, input, add, ipv4, l4proto,
+					   ipv4 ? I40E_TCPIP_DUMMY_PACKET_LEN :
+					   I40E_TCPIP6_DUMMY_PACKET_LEN,
+					   ipv4 ? I40E_FILTER_PCTYPE_NONF_IPV4_TCP :
+					   I40E_FILTER_PCTYPE_NONF_IPV6_TCP);
+		ipv4_cnt = &pf->fd_tcp4_filter_cnt;
+		ipv6_cnt = &pf->fd_tcp6_filter_cnt;
+		break;
+	case IPPROTO_UDP:
+		err = i40e_fdir_bulk_queue(bulk, input, add, ipv4, l4proto,
+					   ipv4 ? I40E_UDPIP_DUMMY_PACKET_LEN :
+					   I40E_UDPIP6_DUMMY_PACKET_LEN,
+					   ipv4 ? I40E_FILTER_PCTYPE_NONF_IPV4_UDP :
+					   I40E_FILTER_PCTYPE_NONF_IPV6_UDP);
+		ipv4_cnt = &pf->fd_udp4_filter_cnt;
+		ipv6_cnt = &pf->fd_udp6_filter_cnt;
+		break;
+	case IPPROTO_SCTP:
+		err = i40e_fdir_bulk_queue(bulk, input, add, ipv4, l4proto,
+					   ipv4 ? I40E_SCTPIP_DUMMY_PACKET_LEN :
+					   I40E_SCTPIP6_DUMMY_PACKET_LEN,
+					   ipv4 ? I40E_FILTER_PCTYPE_NONF_IPV4_SCTP :
+					   I40E_FILTER_PCTYPE_NONF_IPV6_SCTP);
+		ipv4_cnt = &pf->fd_sctp4_filter_cnt;
+		ipv6_cnt = &pf->fd_sctp6_filter_cnt;
+		break;
+	case IPPROTO_IP:
+		payload_offset = ipv4 ? I40E_IP_DUMMY_PACKET_LEN :
+			I40E_IP6_DUMMY_PACKET_LEN;
+		first = ipv4 ? I40E_FILTER_PCTYPE_NONF_IPV4_OTHER :
+			I40E_FILTER_PCTYPE_NONF_IPV6_OTHER;
+		last = ipv4 ? I40E_FILTER_PCTYPE_FRAG_IPV4 :
+			I40E_FILTER_PCTYPE_FRAG_IPV6;
+		err = 0;
+		for (i = first; i <= last; i++) {
+			err = i40e_fdir_bulk_queue(bulk, input, add, ipv4,
+						   l4proto, payload_offset, i);
+			if (err)
+				break;
+		}
+		/* Part of the flow spec is already on the ring, so the caller
+		 * must not replay the whole filter. Release what is queued
+		 * and program only the remaining pctypes one by one.
+		 */
+		if (err && i != first) {
+			i40e_fdir_bulk_flush(bulk);
+			err = i40e_add_del_fdir_ip_pctypes(pf, input, add,
+							   ipv4, i);
+		}
+		ipv4_cnt = &pf->fd_ip4_filter_cnt;
+		ipv6_cnt = &pf->fd_ip6_filter_cnt;
+		break;
+	default:
+		/* We cannot support masking based on protocol */
+		return -EINVAL;
+	}
+
+	if (err)
+		return err;
+
+	i40e_change_filter_num(ipv4, add, ipv4_cnt, ipv6_cnt);
+	if (add && l4proto == IPPROTO_TCP)
+		set_bit(__I40E_FD_ATR_AUTO_DISABLED, pf->state);
+
+	return 0;
+}
+
+/**
+ * i40e_fdir_bulk_commit - Release all queued filters to hardware
+ * @bulk: bulk programming context from i40e_fdir_bulk_begin()
+ **/
+void i40e_fdir_bulk_commit(struct i40e_fdir_bulk *bulk)
+{
+	i40e_fdir_bulk_flush(bulk);
+}
+
+/**
+ * i40e_fdir_arena_free - Release the bulk programming dummy packet arena
+ * @pf: board private structure
+ *
+ * Must only be called once no arena backed descriptor is pending on the
+ * FDIR ring, e.g. after the FDIR VSI has been released.
+ **/
+void i40e_fdir_arena_free(struct i40e_pf *pf)
+{
+	if (!pf->fdir_arena)
+		return;
+
+	dma_free_coherent(&pf->pdev->dev, pf->fdir_arena_size,
+			  pf->fdir_arena, pf->fdir_arena_dma);
+	pf->fdir_arena = NULL;
+	pf->fdir_arena_size = 0;
+}
+
 #ifdef HAVE_MEM_TYPE_XSK_BUFF_POOL
 /**
  * i40e_fd_handle_status - check the Programming Status for FD
@@ -711,6 +1093,13 @@ void i40e_fd_handle_status(struct i40e_ring *rx_ring,
 #endif /* HAVE_MEM_TYPE_XSK_BUFF_POOL */
 		I40E_RX_PROG_STATUS_DESC_QW1_ERROR_SHIFT;
 
+#ifdef HAVE_MEM_TYPE_XSK_BUFF_POOL
+	i40e_trace(fd_status, &pf->hw, error, le32_to_cpu(qw0->hi_dword.fd_id));
+#else
+	i40e_trace(fd_status, &pf->hw, error,
+		   le32_to_cpu(rx_desc->wb.qword0.hi_dword.fd_id));
+#endif /* HAVE_MEM_TYPE_XSK_BUFF_POOL */
+
 	if (error == BIT(I40E_RX_PROG_STATUS_DESC_FD_TBL_FULL_SHIFT)) {
 #ifdef HAVE_MEM_TYPE_XSK_BUFF_POOL
 		pf->fd_inv = le32_to_cpu(qw0->hi_dword.fd_id);
@@ -779,11 +1168,13 @@ void i40e_fd_handle_status(struct i40e_ring *rx_ring,
 /**
  * i40e_unmap_and_free_tx_resource - Release a Tx buffer
  * @ring:      the ring that owns the buffer
- * @tx_buffer: the buffer to free
+ * @i:         index of the buffer to free
  **/
-static void i40e_unmap_and_free_tx_resource(struct i40e_ring *ring,
-					    struct i40e_tx_buffer *tx_buffer)
+static void i40e_unmap_and_free_tx_resource(struct i40e_ring *ring, u16 i)
 {
+	struct i40e_tx_buffer *tx_buffer = &ring->tx_bi[i];
+	struct i40e_tx_dma *tx_dma = &ring->tx_dma[i];
+
 	if (tx_buffer->skb) {
 		if (tx_buffer->tx_flags & I40E_TX_FLAGS_FD_SB)
 			kfree(tx_buffer->raw_buf);
@@ -797,21 +1188,21 @@ static void i40e_unmap_and_free_tx_resource(struct i40e_ring *ring,
 #endif
 		else
 			dev_kfree_skb_any(tx_buffer->skb);
-		if (dma_unmap_len(tx_buffer, len))
+		if (dma_unmap_len(tx_dma, len))
 			dma_unmap_single(ring->dev,
-					 dma_unmap_addr(tx_buffer, dma),
-					 dma_unmap_len(tx_buffer, len),
+					 dma_unmap_addr(tx_dma, dma),
+					 dma_unmap_len(tx_dma, len),
 					 DMA_TO_DEVICE);
-	} else if (dma_unmap_len(tx_buffer, len)) {
+	} else if (dma_unmap_len(tx_dma, len)) {
 		dma_unmap_page(ring->dev,
-			       dma_unmap_addr(tx_buffer, dma),
-			       dma_unmap_len(tx_buffer, len),
+			       dma_unmap_addr(tx_dma, dma),
+			       dma_unmap_len(tx_dma, len),
 			       DMA_TO_DEVICE);
 	}
 
 	tx_buffer->next_to_watch = NULL;
 	tx_buffer->skb = NULL;
-	dma_unmap_len_set(tx_buffer, len, 0);
+	dma_unmap_len_set(tx_dma, len, 0);
 	/* tx_buffer must be completely set up in the transmit path */
 }
 
@@ -821,7 +1212,6 @@ static void i40e_unmap_and_free_tx_resource(struct i40e_ring *ring,
  **/
 void i40e_clean_tx_ring(struct i40e_ring *tx_ring)
 {
-	unsigned long bi_size;
 	u16 i;
 
 #ifdef HAVE_AF_XDP_ZC_SUPPORT
@@ -839,14 +1229,13 @@ void i40e_clean_tx_ring(struct i40e_ring *tx_ring)
 
 		/* Free all the Tx ring sk_buffs */
 		for (i = 0; i < tx_ring->count; i++)
-			i40e_unmap_and_free_tx_resource(tx_ring, &tx_ring->tx_bi[i]);
+			i40e_unmap_and_free_tx_resource(tx_ring, i);
 
 #ifdef HAVE_AF_XDP_ZC_SUPPORT
 	}
 #endif /* HAVE_AF_XDP_ZC_SUPPORT */
 
-	bi_size = sizeof(struct i40e_tx_buffer) * tx_ring->count;
-	memset(tx_ring->tx_bi, 0, bi_size);
+	memset(tx_ring->tx_bi, 0, i40e_tx_bi_size(tx_ring));
 
 	/* Zero out the descriptor ring */
 	memset(tx_ring->desc, 0, tx_ring->size);
@@ -872,6 +1261,7 @@ void i40e_free_tx_resources(struct i40e_ring *tx_ring)
 	i40e_clean_tx_ring(tx_ring);
 	kfree(tx_ring->tx_bi);
 	tx_ring->tx_bi = NULL;
+	tx_ring->tx_dma = NULL;
 #ifdef HAVE_AF_XDP_ZC_SUPPORT
 #ifdef HAVE_XSK_BATCHED_DESCRIPTOR_INTERFACES
 	kfree(tx_ring->xsk_descs);
@@ -983,10 +1373,12 @@ static bool i40e_clean_tx_irq(struct i40e_vsi *vsi,
 	struct i40e_tx_buffer *tx_buf;
 	struct i40e_tx_desc *tx_head;
 	struct i40e_tx_desc *tx_desc;
+	struct i40e_tx_dma *tx_dma;
 	unsigned int total_bytes = 0, total_packets = 0;
 	unsigned int budget = vsi->work_limit;
 
 	tx_buf = &tx_ring->tx_bi[i];
+	tx_dma = &tx_ring->tx_dma[i];
 	tx_desc = I40E_TX_DESC(tx_ring, i);
 	i -= tx_ring->count;
 
@@ -1028,45 +1420,51 @@ static bool i40e_clean_tx_irq(struct i40e_vsi *vsi,
 
 		/* unmap skb header data */
 		dma_unmap_single(tx_ring->dev,
-				 dma_unmap_addr(tx_buf, dma),
-				 dma_unmap_len(tx_buf, len),
+				 dma_unmap_addr(tx_dma, dma),
+				 dma_unmap_len(tx_dma, len),
 				 DMA_TO_DEVICE);
 
 		/* clear tx_buffer data */
 		tx_buf->skb = NULL;
-		dma_unmap_len_set(tx_buf, len, 0);
+		dma_unmap_len_set(tx_dma, len, 0);
 
-		/* unmap remaining buffers */
+		/* unmap remaining buffers, only their tx_dma entries are
+		 * used so tx_buf is advanced without being dereferenced
+		 */
 		while (tx_desc != eop_desc) {
 			i40e_trace(clean_tx_irq_unmap,
 				   tx_ring, tx_desc, tx_buf);
 
 			tx_buf++;
+			tx_dma++;
 			tx_desc++;
 			i++;
 			if (unlikely(!i)) {
 				i -= tx_ring->count;
 				tx_buf = tx_ring->tx_bi;
+				tx_dma = tx_ring->tx_dma;
 				tx_desc = I40E_TX_DESC(tx_ring, 0);
 			}
 
 			/* unmap any remaining paged data */
-			if (dma_unmap_len(tx_buf, len)) {
+			if (dma_unmap_len(tx_dma, len)) {
 				dma_unmap_page(tx_ring->dev,
-					       dma_unmap_addr(tx_buf, dma),
-					       dma_unmap_len(tx_buf, len),
+					       dma_unmap_addr(tx_dma, dma),
+					       dma_unmap_len(tx_dma, len),
 					       DMA_TO_DEVICE);
-				dma_unmap_len_set(tx_buf, len, 0);
+				dma_unmap_len_set(tx_dma, len, 0);
 			}
 		}
 
 		/* move us one more past the eop_desc for start of next pkt */
 		tx_buf++;
+		tx_dma++;
 		tx_desc++;
 		i++;
 		if (unlikely(!i)) {
 			i -= tx_ring->count;
 			tx_buf = tx_ring->tx_bi;
+			tx_dma = tx_ring->tx_dma;
 			tx_desc = I40E_TX_DESC(tx_ring, 0);
 		}
 
@@ -1120,6 +1518,9 @@ static bool i40e_clean_tx_irq(struct i40e_vsi *vsi,
 			netif_wake_subqueue(tx_ring->netdev,
 					    tx_ring->queue_index);
 			++tx_ring->tx_stats.restart_queue;
+			i40e_trace(tx_restart, tx_ring,
+				   I40E_DESC_UNUSED(tx_ring),
+				   TX_WAKE_THRESHOLD);
 		}
 	}
 
@@ -1170,6 +1571,8 @@ static void i40e_enable_wb_on_itr(struct i40e_vsi *vsi,
  **/
 void i40e_force_wb(struct i40e_vsi *vsi, struct i40e_q_vector *q_vector)
 {
+	i40e_trace(force_wb, vsi, q_vector);
+
 	if (vsi->back->flags & I40E_FLAG_MSIX_ENABLED) {
 		u32 val = I40E_PFINT_DYN_CTLN_INTENA_MASK |
 			  I40E_PFINT_DYN_CTLN_ITR_INDX_MASK | /* set noitr */
@@ -1417,6 +1820,9 @@ adjust_by_size:
 	}
 
 clear_counts:
+	i40e_trace(update_itr, q_vector, i40e_container_is_rx(q_vector, rc),
+		   rc->target_itr, itr, rc->total_packets, rc->total_bytes);
+
 	/* write back value */
 	rc->target_itr = itr;
 
@@ -1573,17 +1979,17 @@ struct i40e_rx_buffer *i40e_clean_programming_status
 int i40e_setup_tx_descriptors(struct i40e_ring *tx_ring)
 {
 	struct device *dev = tx_ring->dev;
-	int bi_size;
 
 	if (!dev)
 		return -ENOMEM;
 
 	/* warn if we are about to overwrite the pointer */
 	WARN_ON(tx_ring->tx_bi);
-	bi_size = sizeof(struct i40e_tx_buffer) * tx_ring->count;
-	tx_ring->tx_bi = (struct i40e_tx_buffer *)kzalloc(bi_size, GFP_KERNEL);
+	tx_ring->tx_bi = kzalloc(i40e_tx_bi_size(tx_ring), GFP_KERNEL);
 	if (!tx_ring->tx_bi)
 		goto err;
+	tx_ring->tx_dma = (struct i40e_tx_dma *)(tx_ring->tx_bi +
+						 tx_ring->count);
 
 #ifdef HAVE_AF_XDP_ZC_SUPPORT
 #ifdef HAVE_XSK_BATCHED_DESCRIPTOR_INTERFACES
@@ -1625,6 +2031,7 @@ err:
 #endif /* HAVE_AF_XDP_ZC_SUPPORT */
 	kfree(tx_ring->tx_bi);
 	tx_ring->tx_bi = NULL;
+	tx_ring->tx_dma = NULL;
 	return -ENOMEM;
 }
 
@@ -1897,6 +2304,7 @@ static bool i40e_alloc_mapped_skb(struct i40e_ring *rx_ring,
 				       GFP_ATOMIC | __GFP_NOWARN);
 		if (unlikely(!skb)) {
 			rx_ring->rx_stats.alloc_buff_failed++;
+			i40e_trace(rx_alloc_buff_failed, rx_ring);
 			return false;
 		}
 	}
@@ -1911,6 +2319,7 @@ static bool i40e_alloc_mapped_skb(struct i40e_ring *rx_ring,
 	if (dma_mapping_error(rx_ring->dev, dma)) {
 		dev_kfree_skb_any(skb);
 		rx_ring->rx_stats.alloc_buff_failed++;
+		i40e_trace(rx_alloc_buff_failed, rx_ring);
 		return false;
 	}
 
@@ -1956,6 +2365,7 @@ static bool i40e_alloc_mapped_page(struct i40e_ring *rx_ring,
 	page = dev_alloc_pages(i40e_rx_pg_order(rx_ring));
 	if (unlikely(!page)) {
 		rx_ring->rx_stats.alloc_page_failed++;
+		i40e_trace(rx_alloc_page_failed, rx_ring);
 		return false;
 	}
 
@@ -1971,6 +2381,7 @@ static bool i40e_alloc_mapped_page(struct i40e_ring *rx_ring,
 	if (dma_mapping_error(rx_ring->dev, dma)) {
 		__free_pages(page, i40e_rx_pg_order(rx_ring));
 		rx_ring->rx_stats.alloc_page_failed++;
+		i40e_trace(rx_alloc_page_failed, rx_ring);
 		return false;
 	}
 
@@ -2910,6 +3321,9 @@ void i40e_update_rx_stats(struct i40e_ring *rx_ring,
 void i40e_finalize_xdp_rx(struct i40e_ring *rx_ring,
 			  unsigned int xdp_res)
 {
+	if (READ_ONCE(rx_ring->xdp_prog))
+		i40e_trace(xdp_rx_batch, rx_ring, xdp_res);
+
 	if (xdp_res & I40E_XDP_REDIR)
 		xdp_do_flush_map();
 
@@ -2937,18 +3351,25 @@ static void i40e_inc_ntc(struct i40e_ring *rx_ring)
 #endif /* HAVE_AF_XDP_ZC_SUPPORT && HAVE_MEM_TYPE_XSK_BUFF_POOL */
 
 /**
- * i40e_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
+ * __i40e_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @rx_ring: rx descriptor ring to transact packets on
  * @budget: Total limit on number of packets to process
+ * @xdp_on: the ring may have an XDP program attached
+ * @build_skb: build skbs around the Rx buffers instead of copying headers
  *
  * This function provides a "bounce buffer" approach to Rx interrupt
  * processing.  The advantage to this is that on systems that have
  * expensive overhead for IOMMU access this provides a means of avoiding
  * it by maintaining the mapping of the page to the system.
  *
+ * @xdp_on and @build_skb are compile time constants in every caller, so
+ * each Rx clean variant below only carries the paths it can take.
+ *
  * Returns amount of work completed
  **/
-static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
+static __always_inline int __i40e_clean_rx_irq(struct i40e_ring *rx_ring,
+					       int budget, const bool xdp_on,
+					       const bool build_skb)
 {
 	unsigned int total_rx_bytes = 0, total_rx_packets = 0;
 	struct sk_buff *skb = rx_ring->skb;
@@ -3052,10 +3473,11 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 			xdp.frame_sz = i40e_rx_frame_truesize(rx_ring, size);
 #endif
 #endif /* HAVE_XDP_BUFF_FRAME_SZ */
-			skb = i40e_run_xdp(rx_ring, &xdp);
+			if (xdp_on)
+				skb = i40e_run_xdp(rx_ring, &xdp);
 		}
 
-		if (IS_ERR(skb)) {
+		if (xdp_on && IS_ERR(skb)) {
 			unsigned int xdp_res = -PTR_ERR(skb);
 
 			if (xdp_res & (I40E_XDP_TX | I40E_XDP_REDIR)) {
@@ -3069,7 +3491,7 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 		} else if (skb) {
 			i40e_add_rx_frag(rx_ring, rx_buffer, skb, size);
 #ifdef HAVE_SWIOTLB_SKIP_CPU_SYNC
-		} else if (ring_uses_build_skb(rx_ring)) {
+		} else if (build_skb) {
 			skb = i40e_build_skb(rx_ring, rx_buffer, &xdp);
 #endif
 		} else {
@@ -3079,6 +3501,7 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 		/* exit if we failed to retrieve a buffer */
 		if (!skb) {
 			rx_ring->rx_stats.alloc_buff_failed++;
+			i40e_trace(rx_alloc_buff_failed, rx_ring);
 			rx_buffer->pagecnt_bias++;
 			break;
 		}
@@ -3114,7 +3537,8 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 		total_rx_packets++;
 	}
 
-	i40e_finalize_xdp_rx(rx_ring, xdp_xmit);
+	if (xdp_on)
+		i40e_finalize_xdp_rx(rx_ring, xdp_xmit);
 	rx_ring->skb = skb;
 
 	i40e_update_rx_stats(rx_ring, total_rx_bytes, total_rx_packets);
@@ -3123,6 +3547,78 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 	return failure ? budget : (int)total_rx_packets;
 }
 
+#ifdef CONFIG_I40E_DISABLE_PACKET_SPLIT
+static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
+{
+	return __i40e_clean_rx_irq(rx_ring, budget, false, false);
+}
+#else
+/* The common case: no XDP program and skbs built around the Rx pages */
+static int i40e_clean_rx_irq_build_skb(struct i40e_ring *rx_ring, int budget)
+{
+	return __i40e_clean_rx_irq(rx_ring, budget, false, true);
+}
+
+/* legacy-rx, or a VSI without a netdev */
+static int i40e_clean_rx_irq_construct_skb(struct i40e_ring *rx_ring,
+					   int budget)
+{
+	return __i40e_clean_rx_irq(rx_ring, budget, false, false);
+}
+
+/* The XDP program dominates the cost here, so keep one variant for both
+ * Rx buffer layouts.
+ */
+static int i40e_clean_rx_irq_xdp(struct i40e_ring *rx_ring, int budget)
+{
+	return __i40e_clean_rx_irq(rx_ring, budget, true,
+				   ring_uses_build_skb(rx_ring));
+}
+#endif /* CONFIG_I40E_DISABLE_PACKET_SPLIT */
+
+/**
+ * i40e_set_clean_rx_irq - Select the Rx clean variant of a ring
+ * @rx_ring: Rx ring being configured
+ *
+ * Called from Rx ring configuration, once the Rx buffer layout is known.
+ * Attaching or removing an XDP program rebuilds the rings, so the choice
+ * holds until the next configuration; swapping one program for another
+ * keeps the XDP variant.
+ **/
+void i40e_set_clean_rx_irq(struct i40e_ring *rx_ring)
+{
+#ifdef CONFIG_I40E_DISABLE_PACKET_SPLIT
+	rx_ring->clean_rx_irq = i40e_clean_rx_irq;
+#else
+	if (i40e_enabled_xdp_vsi(rx_ring->vsi))
+		rx_ring->clean_rx_irq = i40e_clean_rx_irq_xdp;
+	else if (ring_uses_build_skb(rx_ring))
+		rx_ring->clean_rx_irq = i40e_clean_rx_irq_build_skb;
+	else
+		rx_ring->clean_rx_irq = i40e_clean_rx_irq_construct_skb;
+#endif /* CONFIG_I40E_DISABLE_PACKET_SPLIT */
+}
+
+/**
+ * i40e_run_clean_rx_irq - Clean a ring with its configured Rx clean variant
+ * @rx_ring: rx descriptor ring to transact packets on
+ * @budget: Total limit on number of packets to process
+ *
+ * Returns amount of work completed
+ **/
+static inline int i40e_run_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
+{
+#ifdef CONFIG_I40E_DISABLE_PACKET_SPLIT
+	return i40e_clean_rx_irq(rx_ring, budget);
+#else
+	return INDIRECT_CALL_3(rx_ring->clean_rx_irq,
+			       i40e_clean_rx_irq_build_skb,
+			       i40e_clean_rx_irq_construct_skb,
+			       i40e_clean_rx_irq_xdp,
+			       rx_ring, budget);
+#endif /* CONFIG_I40E_DISABLE_PACKET_SPLIT */
+}
+
 static inline u32 i40e_buildreg_itr(const int type, u16 itr)
 {
 	u32 val;
@@ -3227,15 +3723,17 @@ static inline void i40e_update_enable_itr(struct i40e_vsi *vsi,
 }
 
 /**
- * i40e_napi_poll - NAPI polling Rx/Tx cleanup routine
+ * __i40e_napi_poll - NAPI polling Rx/Tx cleanup routine
  * @napi: napi struct with our devices info in it
  * @budget: amount of work driver is allowed to do this pass, in packets
+ * @rx_work: returns the number of Rx packets cleaned
  *
  * This function will clean all queues associated with a q_vector.
  *
  * Returns the amount of work done
  **/
-int i40e_napi_poll(struct napi_struct *napi, int budget)
+static __always_inline int __i40e_napi_poll(struct napi_struct *napi,
+					    int budget, int *rx_work)
 {
 	struct i40e_q_vector *q_vector =
 			       container_of(napi, struct i40e_q_vector, napi);
@@ -3247,6 +3745,8 @@ int i40e_napi_poll(struct napi_struct *napi, int budget)
 	int budget_per_ring;
 	int work_done = 0;
 
+	*rx_work = 0;
+
 	if (test_bit(__I40E_VSI_DOWN, vsi->state)) {
 		napi_complete(napi);
 		return 0;
@@ -3293,9 +3793,9 @@ int i40e_napi_poll(struct napi_struct *napi, int budget)
 		int cleaned = ring->xsk_umem ?
 #endif /* HAVE_NETDEV_BPF_XSK_POOL */
 			i40e_clean_rx_irq_zc(ring, budget_per_ring) :
-			i40e_clean_rx_irq(ring, budget_per_ring);
+			i40e_run_clean_rx_irq(ring, budget_per_ring);
 #else
-		int cleaned = i40e_clean_rx_irq(ring, budget_per_ring);
+		int cleaned = i40e_run_clean_rx_irq(ring, budget_per_ring);
 #endif /* HAVE_AF_XDP_ZC_SUPPORT */
 
 		work_done += cleaned;
@@ -3303,6 +3803,7 @@ int i40e_napi_poll(struct napi_struct *napi, int budget)
 		if (cleaned >= budget_per_ring)
 			clean_complete = false;
 	}
+	*rx_work = work_done;
 
 #ifndef HAVE_NETDEV_NAPI_LIST
 	/* if netdev is disabled we need to stop polling */
@@ -3352,6 +3853,181 @@ tx_only:
 	return min(work_done, budget - 1);
 }
 
+DEFINE_STATIC_KEY_FALSE(i40e_napi_hist_key);
+
+/**
+ * i40e_napi_hist_bucket - Get the log2 histogram bucket of a value
+ * @val: the value to account
+ **/
+static unsigned int i40e_napi_hist_bucket(u64 val)
+{
+	return min_t(unsigned int, fls64(val), I40E_NAPI_HIST_BUCKETS - 1);
+}
+
+/**
+ * i40e_napi_poll_hist - NAPI poll that also fills the vector histograms
+ * @napi: napi struct with our devices info in it
+ * @budget: amount of work driver is allowed to do this pass, in packets
+ *
+ * Kept out of line so the histograms cost i40e_napi_poll() nothing but a
+ * patched out branch while i40e_napi_hist_key is off.
+ *
+ * Returns the amount of work done
+ **/
+static noinline int i40e_napi_poll_hist(struct napi_struct *napi, int budget)
+{
+	struct i40e_q_vector *q_vector =
+			       container_of(napi, struct i40e_q_vector, napi);
+	struct i40e_napi_hist *hist = &q_vector->napi_hist;
+	u64 start = 0, irq_ns, usecs;
+	bool collect;
+	int work, ret;
+
+	/* the key is shared by all PFs, netpoll is not a real poll */
+	collect = test_bit(__I40E_NAPI_HIST, q_vector->vsi->back->state) &&
+		  budget > 0;
+	if (collect) {
+		start = ktime_get_ns();
+		irq_ns = READ_ONCE(hist->irq_ns);
+		if (irq_ns && start > irq_ns) {
+			usecs = div_u64(start - irq_ns, NSEC_PER_USEC);
+			hist->irq_lat[i40e_napi_hist_bucket(usecs)]++;
+		}
+		WRITE_ONCE(hist->irq_ns, 0);
+	}
+
+	ret = __i40e_napi_poll(napi, budget, &work);
+	if (!collect)
+		return ret;
+
+	usecs = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+	hist->poll_time[i40e_napi_hist_bucket(usecs)]++;
+	hist->work[i40e_napi_hist_bucket(work)]++;
+	hist->irq_polls++;
+	if (ret >= budget) {
+		hist->budget_exhausted++;
+	} else {
+		/* polling is done, the interrupt is enabled again */
+		hist->polls[i40e_napi_hist_bucket(hist->irq_polls)]++;
+		hist->irq_polls = 0;
+	}
+
+	return ret;
+}
+
+/**
+ * i40e_napi_poll - NAPI polling Rx/Tx cleanup routine
+ * @napi: napi struct with our devices info in it
+ * @budget: amount of work driver is allowed to do this pass, in packets
+ *
+ * Returns the amount of work done
+ **/
+int i40e_napi_poll(struct napi_struct *napi, int budget)
+{
+	int work;
+
+	if (static_branch_unlikely(&i40e_napi_hist_key))
+		return i40e_napi_poll_hist(napi, budget);
+
+	return __i40e_napi_poll(napi, budget, &work);
+}
+
+/**
+ * i40e_napi_hist_clear - Clear the NAPI histograms of all PF vectors
+ * @pf: board private structure
+ **/
+void i40e_napi_hist_clear(struct i40e_pf *pf)
+{
+	struct i40e_vsi *vsi;
+	int i, v;
+
+	for (i = 0; i < pf->num_alloc_vsi; i++) {
+		vsi = pf->vsi[i];
+		if (!vsi || !vsi->q_vectors)
+			continue;
+
+		for (v = 0; v < vsi->num_q_vectors; v++)
+			if (vsi->q_vectors[v])
+				memset(&vsi->q_vectors[v]->napi_hist, 0,
+				       sizeof(vsi->q_vectors[v]->napi_hist));
+	}
+}
+
+/**
+ * i40e_napi_hist_set - Start or stop collecting the NAPI histograms
+ * @pf: board private structure
+ * @enable: true to start collecting
+ *
+ * Collection restarts from empty histograms. The static key stays on
+ * while at least one PF collects.
+ **/
+void i40e_napi_hist_set(struct i40e_pf *pf, bool enable)
+{
+	if (enable) {
+		if (test_bit(__I40E_NAPI_HIST, pf->state))
+			return;
+		i40e_napi_hist_clear(pf);
+		set_bit(__I40E_NAPI_HIST, pf->state);
+		static_branch_inc(&i40e_napi_hist_key);
+	} else if (test_and_clear_bit(__I40E_NAPI_HIST, pf->state)) {
+		static_branch_dec(&i40e_napi_hist_key);
+	}
+}
+
+/* Tx features most setups never enable. Each key is shared by all PFs of
+ * the module and stays on while at least one PF uses the feature, so the
+ * per-packet checks below are patched out when no PF does.
+ */
+static DEFINE_STATIC_KEY_FALSE(i40e_tx_atr_key);
+static DEFINE_STATIC_KEY_FALSE(i40e_tx_dcb_key);
+#ifdef HAVE_PTP_1588_CLOCK
+static DEFINE_STATIC_KEY_FALSE(i40e_tx_ptp_key);
+#endif /* HAVE_PTP_1588_CLOCK */
+static DEFINE_STATIC_KEY_FALSE(i40e_tx_l2tag2_key);
+
+/**
+ * i40e_tx_key_hold - Take or drop the PF reference on a Tx feature key
+ * @pf: board private structure
+ * @bit: PF state bit recording the reference
+ * @key: the Tx feature key
+ * @hold: true if the PF uses the feature
+ **/
+static void i40e_tx_key_hold(struct i40e_pf *pf, enum i40e_state_t bit,
+			     struct static_key_false *key, bool hold)
+{
+	if (hold) {
+		if (!test_and_set_bit(bit, pf->state))
+			static_branch_inc(key);
+	} else if (test_and_clear_bit(bit, pf->state)) {
+		static_branch_dec(key);
+	}
+}
+
+/**
+ * i40e_tx_keys_update - Match the Tx feature keys to the PF configuration
+ * @pf: board private structure
+ * @active: false to drop all the PF references, e.g. on remove
+ *
+ * Must be called from process context. Called whenever the datapath is
+ * configured, right where the DCB flag or the Tx timestamping mode
+ * changes, and from the service task, which catches the ATR flag flips of
+ * the Flow Director subtasks. The keys only gate the existing per-packet
+ * checks, so a key left on for a while merely costs those checks.
+ **/
+void i40e_tx_keys_update(struct i40e_pf *pf, bool active)
+{
+	i40e_tx_key_hold(pf, __I40E_TX_KEY_ATR, &i40e_tx_atr_key,
+			 active && (pf->flags & I40E_FLAG_FD_ATR_ENABLED));
+	i40e_tx_key_hold(pf, __I40E_TX_KEY_DCB, &i40e_tx_dcb_key,
+			 active && (pf->flags & I40E_FLAG_DCB_ENABLED));
+#ifdef HAVE_PTP_1588_CLOCK
+	i40e_tx_key_hold(pf, __I40E_TX_KEY_PTP, &i40e_tx_ptp_key,
+			 active && pf->ptp_tx);
+#endif /* HAVE_PTP_1588_CLOCK */
+	i40e_tx_key_hold(pf, __I40E_TX_KEY_L2TAG2, &i40e_tx_l2tag2_key,
+			 active && i40e_is_double_vlan(&pf->hw));
+}
+
 /**
  * i40e_atr - Add a Flow Director ATR filter
  * @tx_ring:  ring to add programming descriptor to
@@ -3535,7 +4211,8 @@ static inline int i40e_tx_prepare_vlan_flags(struct sk_buff *skb,
 	/* if we have a HW VLAN tag being added, default to the HW one */
 	if (skb_vlan_tag_present(skb)) {
 		tx_flags |= skb_vlan_tag_get(skb) << I40E_TX_FLAGS_VLAN_SHIFT;
-		if (tx_ring->flags & I40E_TXR_FLAGS_L2TAG2)
+		if (static_branch_unlikely(&i40e_tx_l2tag2_key) &&
+		    (tx_ring->flags & I40E_TXR_FLAGS_L2TAG2))
 			tx_flags |= I40E_TX_FLAGS_HW_OUTER_VLAN;
 		else
 			tx_flags |= I40E_TX_FLAGS_HW_VLAN;
@@ -3553,7 +4230,8 @@ static inline int i40e_tx_prepare_vlan_flags(struct sk_buff *skb,
 		tx_flags |= I40E_TX_FLAGS_SW_VLAN;
 	}
 
-	if (!(tx_ring->vsi->back->flags & I40E_FLAG_DCB_ENABLED))
+	if (!static_branch_unlikely(&i40e_tx_dcb_key) ||
+	    !(tx_ring->vsi->back->flags & I40E_FLAG_DCB_ENABLED))
 		goto out;
 
 	/* Insert 802.1p priority into VLAN header */
@@ -3572,7 +4250,8 @@ static inline int i40e_tx_prepare_vlan_flags(struct sk_buff *skb,
 			vhdr = (struct vlan_ethhdr *)skb->data;
 			vhdr->h_vlan_TCI = htons(tx_flags >>
 						 I40E_TX_FLAGS_VLAN_SHIFT);
-		} else if (tx_ring->flags & I40E_TXR_FLAGS_L2TAG2) {
+		} else if (static_branch_unlikely(&i40e_tx_l2tag2_key) &&
+			   (tx_ring->flags & I40E_TXR_FLAGS_L2TAG2)) {
 			tx_flags |= I40E_TX_FLAGS_HW_OUTER_VLAN;
 		} else {
 			tx_flags |= I40E_TX_FLAGS_HW_VLAN;
@@ -4049,12 +4728,14 @@ int __i40e_maybe_stop_tx(struct i40e_ring *tx_ring, int size)
 	/* Check again in a case another CPU has just made room available. */
 	if (likely(I40E_DESC_UNUSED(tx_ring) < size)) {
 		++tx_ring->tx_stats.tx_stopped;
+		i40e_trace(tx_stop, tx_ring, I40E_DESC_UNUSED(tx_ring), size);
 		return -EBUSY;
 	}
 
 	/* A reprieve! - use start_queue because it doesn't call schedule */
 	netif_start_subqueue(tx_ring->netdev, tx_ring->queue_index);
 	++tx_ring->tx_stats.restart_queue;
+	i40e_trace(tx_restart, tx_ring, I40E_DESC_UNUSED(tx_ring), size);
 	return 0;
 }
 
@@ -4161,8 +4842,8 @@ static inline int i40e_tx_map(struct i40e_ring *tx_ring, struct sk_buff *skb,
 	unsigned int data_len = skb->data_len;
 	unsigned int size = skb_headlen(skb);
 	skb_frag_t *frag;
-	struct i40e_tx_buffer *tx_bi;
 	struct i40e_tx_desc *tx_desc;
+	struct i40e_tx_dma *tx_dma;
 	u16 i = tx_ring->next_to_use;
 	u32 td_tag = 0;
 	dma_addr_t dma;
@@ -4191,7 +4872,7 @@ static inline int i40e_tx_map(struct i40e_ring *tx_ring, struct sk_buff *skb,
 	dma = dma_map_single(tx_ring->dev, skb->data, size, DMA_TO_DEVICE);
 
 	tx_desc = I40E_TX_DESC(tx_ring, i);
-	tx_bi = first;
+	tx_dma = &tx_ring->tx_dma[i];
 
 	for (frag = &skb_shinfo(skb)->frags[0];; frag++) {
 		unsigned int max_data = I40E_MAX_DATA_PER_TXD_ALIGNED;
@@ -4200,8 +4881,8 @@ static inline int i40e_tx_map(struct i40e_ring *tx_ring, struct sk_buff *skb,
 			goto dma_error;
 
 		/* record length, and DMA address */
-		dma_unmap_len_set(tx_bi, len, size);
-		dma_unmap_addr_set(tx_bi, dma, dma);
+		dma_unmap_len_set(tx_dma, len, size);
+		dma_unmap_addr_set(tx_dma, dma, dma);
 
 		/* align size to end of page */
 		max_data += -dma & (I40E_MAX_READ_REQ_SIZE - 1);
@@ -4249,7 +4930,7 @@ static inline int i40e_tx_map(struct i40e_ring *tx_ring, struct sk_buff *skb,
 		dma = skb_frag_dma_map(tx_ring->dev, frag, 0, size,
 				       DMA_TO_DEVICE);
 
-		tx_bi = &tx_ring->tx_bi[i];
+		tx_dma = &tx_ring->tx_dma[i];
 	}
 
 	netdev_tx_sent_queue(txring_txq(tx_ring), first->bytecount);
@@ -4335,9 +5016,8 @@ dma_error:
 
 	/* clear dma mappings for failed tx_bi map */
 	for (;;) {
-		tx_bi = &tx_ring->tx_bi[i];
-		i40e_unmap_and_free_tx_resource(tx_ring, tx_bi);
-		if (tx_bi == first)
+		i40e_unmap_and_free_tx_resource(tx_ring, i);
+		if (&tx_ring->tx_bi[i] == first)
 			break;
 		if (i == 0)
 			i = tx_ring->count;
@@ -4528,8 +5208,8 @@ static int i40e_xmit_xdp_ring(struct xdp_buff *xdp,
 #endif
 
 	/* record length, and DMA address */
-	dma_unmap_len_set(tx_bi, len, size);
-	dma_unmap_addr_set(tx_bi, dma, dma);
+	dma_unmap_len_set(&xdp_ring->tx_dma[i], len, size);
+	dma_unmap_addr_set(&xdp_ring->tx_dma[i], dma, dma);
 
 	tx_desc = I40E_TX_DESC(xdp_ring, i);
 	tx_desc->buffer_addr = cpu_to_le64(dma);
@@ -4634,10 +5314,12 @@ static netdev_tx_t i40e_xmit_frame_ring(struct sk_buff *skb,
 		goto out_drop;
 
 #ifdef HAVE_PTP_1588_CLOCK
-	tsyn = i40e_tsyn(tx_ring, skb, tx_flags, &cd_type_cmd_tso_mss);
+	if (static_branch_unlikely(&i40e_tx_ptp_key)) {
+		tsyn = i40e_tsyn(tx_ring, skb, tx_flags, &cd_type_cmd_tso_mss);
 
-	if (tsyn)
-		tx_flags |= I40E_TX_FLAGS_TSYN;
+		if (tsyn)
+			tx_flags |= I40E_TX_FLAGS_TSYN;
+	}
 
 #endif /* HAVE_PTP_1588_CLOCK */
 
@@ -4658,7 +5340,8 @@ static netdev_tx_t i40e_xmit_frame_ring(struct sk_buff *skb,
 	 *
 	 * NOTE: this must always be directly before the data descriptor.
 	 */
-	i40e_atr(tx_ring, skb, tx_flags);
+	if (static_branch_unlikely(&i40e_tx_atr_key))
+		i40e_atr(tx_ring, skb, tx_flags);
 
 #ifdef HAVE_PTP_1588_CLOCK
 	if (i40e_tx_map(tx_ring, skb, first, tx_flags, hdr_len,
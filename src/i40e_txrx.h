@@ -285,6 +285,7 @@ static inline unsigned int i40e_txd_use_count(unsigned int size)
 #define I40E_TX_FLAGS_FD_SB		BIT(9)
 #define I40E_TX_FLAGS_TUNNEL		BIT(10)
 #define I40E_TX_FLAGS_HW_OUTER_VLAN	BIT(11)
+#define I40E_TX_FLAGS_FD_SB_ARENA	BIT(12)
 #define I40E_TX_FLAGS_VLAN_MASK		0xffff0000
 #define I40E_TX_FLAGS_VLAN_PRIO_MASK	0xe0000000
 #define I40E_TX_FLAGS_VLAN_PRIO_SHIFT	29
@@ -294,6 +295,11 @@ static inline unsigned int i40e_txd_use_count(unsigned int size)
 					 I40E_TX_FLAGS_HW_VLAN | \
 					 I40E_TX_FLAGS_SW_VLAN)
 
+/* Per packet Tx state. Only the entry of the first descriptor of a packet
+ * is used; the DMA unmap info of every descriptor lives in the parallel
+ * i40e_tx_dma array, so the completion sweep over fragments does not pull
+ * these entries into the cache.
+ */
 struct i40e_tx_buffer {
 	struct i40e_tx_desc *next_to_watch;
 	union {
@@ -302,11 +308,14 @@ struct i40e_tx_buffer {
 		void *raw_buf;
 	};
 	unsigned int bytecount;
+	u32 tx_flags;
 	unsigned short gso_segs;
+};
 
+/* DMA unmap info of one Tx descriptor, indexed like tx_bi */
+struct i40e_tx_dma {
 	DEFINE_DMA_UNMAP_ADDR(dma);
 	DEFINE_DMA_UNMAP_LEN(len);
-	u32 tx_flags;
 };
 
 struct i40e_rx_buffer {
@@ -370,6 +379,19 @@ struct i40e_rx_queue_stats {
 	u64 realloc_count;
 };
 
+#define I40E_NAPI_HIST_BUCKETS	16	/* log2, last is open ended */
+
+/* per q_vector, only collected while i40e_napi_hist_key is enabled */
+struct i40e_napi_hist {
+	u32 work[I40E_NAPI_HIST_BUCKETS];	/* Rx packets cleaned per poll */
+	u32 polls[I40E_NAPI_HIST_BUCKETS];	/* polls per interrupt */
+	u32 irq_lat[I40E_NAPI_HIST_BUCKETS];	/* usecs from hard IRQ to poll */
+	u32 poll_time[I40E_NAPI_HIST_BUCKETS];	/* usecs spent in one poll */
+	u64 budget_exhausted;			/* polls that used all budget */
+	u64 irq_ns;		/* time of the pending hard IRQ, 0 if none */
+	u32 irq_polls;		/* polls since the last interrupt */
+};
+
 enum i40e_ring_state_t {
 	__I40E_TX_FDIR_INIT_DONE,
 	__I40E_TX_XPS_INIT_DONE,
@@ -387,13 +409,19 @@ enum i40e_ring_state_t {
 #define I40E_RX_SPLIT_TCP_UDP 0x4
 #define I40E_RX_SPLIT_SCTP    0x8
 
-/* struct that defines a descriptor ring, associated with a VSI */
+/* struct that defines a descriptor ring, associated with a VSI
+ *
+ * The members are grouped by how often the datapath touches them: the
+ * first cache line holds what both the Rx and Tx paths use per packet,
+ * the second one the Rx-only and Tx-only per-packet state, the third and
+ * fourth the counters bumped per packet, and everything after that is
+ * configuration or slow path. Keep new members out of the first four lines
+ * unless they are used per packet; I40E_CHECK_HOT_FIELD() below enforces
+ * the placement.
+ */
 struct i40e_ring {
-	struct i40e_ring *next;		/* pointer to next ring in q_vector */
+	/* hot, Rx and Tx */
 	void *desc;			/* Descriptor ring memory */
-	struct device *dev;		/* Used for DMA mapping */
-	struct net_device *netdev;	/* netdev ring maps to */
-	struct bpf_prog *xdp_prog;
 	union {
 		struct i40e_tx_buffer *tx_bi;
 		struct i40e_rx_buffer *rx_bi;
@@ -401,33 +429,16 @@ struct i40e_ring {
 		struct xdp_buff **rx_bi_zc;
 #endif /* HAVE_MEM_TYPE_XSK_BUFF_POOL */
 	};
-	DECLARE_BITMAP(state, __I40E_RING_STATE_NBITS);
-	u16 queue_index;		/* Queue number of ring */
-	u8 dcb_tc;			/* Traffic class of ring */
 	u8 __iomem *tail;
-
-	/* high bit set means dynamic, use accessor routines to read/write.
-	 * hardware only supports 2us resolution for the ITR registers.
-	 * these values always store the USER setting, and must be converted
-	 * before programming to a register.
-	 */
-	u16 itr_setting;
-
-	u16 count;			/* Number of descriptors */
-	u16 reg_idx;			/* HW register index of the ring */
-	u16 rx_buf_len;
+	struct net_device *netdev;	/* netdev ring maps to */
+	struct device *dev;		/* Used for DMA mapping */
+	struct i40e_q_vector *q_vector;	/* Backreference to associated vector */
+	struct i40e_vsi *vsi;		/* Backreference to associated VSI */
 
 	/* used in interrupt processing */
 	u16 next_to_use;
 	u16 next_to_clean;
-	u16 xdp_tx_active;
-
-	u8 atr_sample_rate;
-	u8 atr_count;
-
-	bool ring_active;		/* is ring online or not */
-	bool arm_wb;		/* do something to arm write back */
-	u8 packet_stride;
+	u16 count;			/* Number of descriptors */
 
 	u16 flags;
 #define I40E_TXR_FLAGS_WB_ON_ITR		BIT(0)
@@ -435,49 +446,80 @@ struct i40e_ring {
 #define I40E_TXR_FLAGS_XDP			BIT(2)
 #define I40E_TXR_FLAGS_L2TAG2			BIT(3)
 
-	/* stats structs */
+	/* hot, Rx only, and the Tx counterpart of clean_rx_irq */
+	union {
+		/* Rx clean variant, see i40e_set_clean_rx_irq() */
+		int (*clean_rx_irq)(struct i40e_ring *rx_ring, int budget);
+		/* Tx DMA unmap info, allocated after tx_bi */
+		struct i40e_tx_dma *tx_dma;
+	};
+	struct bpf_prog *xdp_prog;
+	struct sk_buff *skb;		/* When i40e_clean_rx_ring_irq() must
+					 * return before it sees the EOP for
+					 * the current packet, we save that skb
+					 * here and resume receiving this
+					 * packet the next time
+					 * i40e_clean_rx_ring_irq() is called
+					 * for this ring.
+					 */
+#ifdef HAVE_AF_XDP_ZC_SUPPORT
+#ifdef HAVE_NETDEV_BPF_XSK_POOL
+	struct xsk_buff_pool *xsk_pool;
+#else
+	struct xdp_umem *xsk_umem;
+#endif /* HAVE_NETDEV_BFP_XSK_POOL */
+#endif /* HAVE_AF_XDP_ZC_SUPPORT */
+	u16 rx_buf_len;
+	u16 next_to_alloc;
+	u16 queue_index;		/* Queue number of ring */
+
+	/* hot, Tx only */
+	u16 xdp_tx_active;
+	u8 atr_sample_rate;
+	u8 atr_count;
+	bool arm_wb;		/* do something to arm write back */
+	u8 packet_stride;
+
+	/* high bit set means dynamic, use accessor routines to read/write.
+	 * hardware only supports 2us resolution for the ITR registers.
+	 * these values always store the USER setting, and must be converted
+	 * before programming to a register.
+	 */
+	u16 itr_setting;
+
+	/* walked once per poll, not per packet */
+	struct i40e_ring *next;		/* pointer to next ring in q_vector */
+
+	/* hot, stats structs */
 	struct i40e_queue_stats	stats;
 #ifdef HAVE_NDO_GET_STATS64
 	struct u64_stats_sync syncp;
-#endif
-#ifdef HAVE_XDP_SUPPORT
-	struct i40e_xdp_stats xdp_stats;
 #endif
 	union {
 		struct i40e_tx_queue_stats tx_stats;
 		struct i40e_rx_queue_stats rx_stats;
 	};
+#ifdef HAVE_XDP_SUPPORT
+	struct i40e_xdp_stats xdp_stats;
+#endif
 
+	/* cold */
+	DECLARE_BITMAP(state, __I40E_RING_STATE_NBITS);
 	unsigned int size;		/* length of descriptor ring in bytes */
 	dma_addr_t dma;			/* physical address of ring */
-
-	struct i40e_vsi *vsi;		/* Backreference to associated VSI */
-	struct i40e_q_vector *q_vector;	/* Backreference to associated vector */
+	u16 reg_idx;			/* HW register index of the ring */
+	u8 dcb_tc;			/* Traffic class of ring */
+	bool ring_active;		/* is ring online or not */
 
 	struct rcu_head rcu;		/* to avoid race on free */
-	u16 next_to_alloc;
-	struct sk_buff *skb;		/* When i40e_clean_rx_ring_irq() must
-					 * return before it sees the EOP for
-					 * the current packet, we save that skb
-					 * here and resume receiving this
-					 * packet the next time
-					 * i40e_clean_rx_ring_irq() is called
-					 * for this ring.
-					 */
-
 	struct i40e_channel *ch;
 #ifdef HAVE_XDP_BUFF_RXQ
 	struct xdp_rxq_info xdp_rxq;
 #endif
 
 #ifdef HAVE_AF_XDP_ZC_SUPPORT
-#ifdef HAVE_NETDEV_BPF_XSK_POOL
-	struct xsk_buff_pool *xsk_pool;
-#else
-struct xdp_umem *xsk_umem;
-#endif /* HAVE_NETDEV_BFP_XSK_POOL */
 #ifndef HAVE_MEM_TYPE_XSK_BUFF_POOL
-struct zero_copy_allocator zca; /* ZC allocator anchor */
+	struct zero_copy_allocator zca; /* ZC allocator anchor */
 #endif /* HAVE_MEM_TYPE_XSK_BUFF_POOL */
 #ifdef HAVE_XSK_BATCHED_DESCRIPTOR_INTERFACES
 	struct xdp_desc *xsk_descs;      /* For storing descriptors in the AF_XDP ZC path */
@@ -485,6 +527,65 @@ struct zero_copy_allocator zca; /* ZC allocator anchor */
 #endif /* HAVE_AF_XD_ZC_SUPPORT */
 } ____cacheline_internodealigned_in_smp;
 
+/* Build time layout check: @member of struct @type must end within the
+ * first @lines cache lines of 64 bytes. On 32-bit the groups only get
+ * smaller, so the same limits hold there.
+ */
+#define I40E_HOT_LINE_BYTES	64
+#define I40E_CHECK_HOT_FIELD(type, member, lines) \
+	enum i40e_hot_enum_##type##_##member \
+	{ i40e_hot_##type##_##member = 1 / \
+	  ((offsetof(struct type, member) + \
+	    sizeof(((struct type *)0)->member) <= \
+	    (lines) * I40E_HOT_LINE_BYTES) ? 1 : 0) }
+
+I40E_CHECK_HOT_FIELD(i40e_ring, desc, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, tx_bi, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, rx_bi, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, tail, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, netdev, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, dev, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, q_vector, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, vsi, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, next_to_use, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, next_to_clean, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, count, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, flags, 1);
+I40E_CHECK_HOT_FIELD(i40e_ring, clean_rx_irq, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, tx_dma, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, xdp_prog, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, skb, 2);
+#ifdef HAVE_AF_XDP_ZC_SUPPORT
+#ifdef HAVE_NETDEV_BPF_XSK_POOL
+I40E_CHECK_HOT_FIELD(i40e_ring, xsk_pool, 2);
+#else
+I40E_CHECK_HOT_FIELD(i40e_ring, xsk_umem, 2);
+#endif /* HAVE_NETDEV_BPF_XSK_POOL */
+#endif /* HAVE_AF_XDP_ZC_SUPPORT */
+I40E_CHECK_HOT_FIELD(i40e_ring, rx_buf_len, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, next_to_alloc, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, queue_index, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, xdp_tx_active, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, atr_sample_rate, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, atr_count, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, arm_wb, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, packet_stride, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, itr_setting, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, next, 2);
+I40E_CHECK_HOT_FIELD(i40e_ring, stats, 3);
+I40E_CHECK_HOT_FIELD(i40e_ring, tx_stats, 4);
+I40E_CHECK_HOT_FIELD(i40e_ring, rx_stats, 4);
+#ifdef HAVE_XDP_SUPPORT
+I40E_CHECK_HOT_FIELD(i40e_ring, xdp_stats, 4);
+#endif
+
+/* tx_bi and tx_dma share one allocation, tx_dma right after tx_bi */
+static inline size_t i40e_tx_bi_size(struct i40e_ring *tx_ring)
+{
+	return (sizeof(struct i40e_tx_buffer) + sizeof(struct i40e_tx_dma)) *
+	       tx_ring->count;
+}
+
 static inline bool ring_uses_build_skb(struct i40e_ring *ring)
 {
 	return !!(ring->flags & I40E_RXR_FLAGS_BUILD_SKB_ENABLED);
@@ -576,6 +677,8 @@ int i40e_setup_rx_descriptors(struct i40e_ring *rx_ring);
 void i40e_free_tx_resources(struct i40e_ring *tx_ring);
 void i40e_free_rx_resources(struct i40e_ring *rx_ring);
 int i40e_napi_poll(struct napi_struct *napi, int budget);
+void i40e_set_clean_rx_irq(struct i40e_ring *rx_ring);
+DECLARE_STATIC_KEY_FALSE(i40e_napi_hist_key);
 void i40e_force_wb(struct i40e_vsi *vsi, struct i40e_q_vector *q_vector);
 u32 i40e_get_tx_pending(struct i40e_ring *ring, bool in_sw);
 void i40e_detect_recover_hung(struct i40e_vsi *vsi);
@@ -31,6 +31,8 @@
 /* forward declaration */
 struct i40e_hw;
 typedef void (*I40E_ADMINQ_CALLBACK)(struct i40e_hw *, struct i40e_aq_desc *);
+typedef void (*I40E_ADMINQ_ASYNC_CB)(struct i40e_hw *, struct i40e_aq_desc *,
+				     void *);
 
 #ifndef ETH_ALEN
 #define ETH_ALEN	6
@@ -1485,10 +1485,11 @@ static int i40e_set_source_pruning(struct i40e_vf *vf)
  * i40e_alloc_vsi_res
  * @vf: pointer to the VF info
  * @idx: VSI index, applies only for ADq mode, zero otherwise
+ * @defer_sync: leave programming the default filters to the caller
  *
  * alloc VF vsi context & resources
  **/
-static int i40e_alloc_vsi_res(struct i40e_vf *vf, u8 idx)
+static int i40e_alloc_vsi_res(struct i40e_vf *vf, u8 idx, bool defer_sync)
 {
 	struct i40e_mac_filter *f = NULL;
 	struct i40e_pf *pf = vf->pf;
@@ -1551,10 +1552,14 @@ static int i40e_alloc_vsi_res(struct i40e_vf *vf, u8 idx)
 #endif /* HAVE_NDO_SET_VF_LINK_STATE */
 		wr32(&pf->hw, I40E_VFQF_HENA1(0, vf->vf_id), (u32)hena);
 		wr32(&pf->hw, I40E_VFQF_HENA1(1, vf->vf_id), (u32)(hena >> 32));
-		/* program mac filter only for VF VSI */
-		ret = i40e_sync_vsi_filters(vsi);
-		if (ret)
-			dev_err(&pf->pdev->dev, "Unable to program ucast filters\n");
+		/* program mac filter only for VF VSI. When many VFs are set up
+		 * together the filter sync task pushes them all in one pass.
+		 */
+		if (!defer_sync) {
+			ret = i40e_sync_vsi_filters(vsi);
+			if (ret)
+				dev_err(&pf->pdev->dev, "Unable to program ucast filters\n");
+		}
 	}
 
 	/* storing VSI index and id for ADq and don't apply the mac filter */
@@ -1908,6 +1913,12 @@ static void i40e_free_vf_res(struct i40e_vf *vf)
 	 * accessing the VF's VSI after it's freed / invalidated.
 	 */
 	clear_bit(I40E_VF_STATE_INIT, &vf->vf_states);
+
+	/* the snapshot belongs to the VSI about to be released */
+	spin_lock_bh(&vf->stats_lock);
+	vf->stats_valid = false;
+	vf->stats_wanted = false;
+	spin_unlock_bh(&vf->stats_lock);
 #ifdef HAVE_NDO_SET_VF_LINK_STATE
 	/* Release vlan mirror */
 	if (vf->lan_vsi_idx) {
@@ -1986,10 +1997,11 @@ static void i40e_free_vf_res(struct i40e_vf *vf)
 /**
  * i40e_alloc_vf_res
  * @vf: pointer to the VF info
+ * @defer_sync: leave programming the default filters to the caller
  *
  * allocate VF resources
  **/
-static int i40e_alloc_vf_res(struct i40e_vf *vf)
+static int i40e_alloc_vf_res(struct i40e_vf *vf, bool defer_sync)
 {
 	struct i40e_pf *pf = vf->pf;
 	int total_queue_pairs = 0;
@@ -2002,7 +2014,7 @@ static int i40e_alloc_vf_res(struct i40e_vf *vf)
 		pf->num_vf_qps = I40E_DEFAULT_QUEUES_PER_VF;
 
 	/* allocate hw vsi context & associated resources */
-	ret = i40e_alloc_vsi_res(vf, 0);
+	ret = i40e_alloc_vsi_res(vf, 0, defer_sync);
 	if (ret)
 		goto error_alloc;
 	total_queue_pairs += pf->vsi[vf->lan_vsi_idx]->alloc_queue_pairs;
@@ -2013,7 +2025,7 @@ static int i40e_alloc_vf_res(struct i40e_vf *vf)
 		    (I40E_MAX_VF_QUEUES - I40E_DEFAULT_QUEUES_PER_VF)) {
 			/* TC 0 always belongs to VF VSI */
 			for (idx = 1; idx < vf->num_tc; idx++) {
-				ret = i40e_alloc_vsi_res(vf, idx);
+				ret = i40e_alloc_vsi_res(vf, idx, defer_sync);
 				if (ret)
 					goto error_alloc;
 			}
@@ -2166,19 +2178,17 @@ static int i40e_sync_vfr_reset(struct i40e_hw *hw, int vf_id)
 }
 
 /**
- * i40e_trigger_vf_reset
+ * i40e_prep_vf_reset
  * @vf: pointer to the VF structure
  * @flr: VFLR was issued or not
  *
- * Trigger hardware to start a reset for a particular VF. Expects the caller
- * to wait the proper amount of time to allow hardware to reset the VF before
- * it cleans up and restores VF functionality.
+ * First step of a VF reset: take the VF out of service. Returns true when
+ * the VF driver is still finishing a reset of its own and the caller has
+ * to wait for it, see i40e_sync_vfr_reset(), before starting the reset.
  **/
-static void i40e_trigger_vf_reset(struct i40e_vf *vf, bool flr)
+static bool i40e_prep_vf_reset(struct i40e_vf *vf, bool flr)
 {
-	struct i40e_pf *pf = vf->pf;
-	struct i40e_hw *hw = &pf->hw;
-	u32 reg, reg_idx, bit_idx;
+	struct i40e_hw *hw = &vf->pf->hw;
 	bool vf_active;
 	u32 radq;
 
@@ -2193,20 +2203,35 @@ static void i40e_trigger_vf_reset(struct i40e_vf *vf, bool flr)
 	 */
 	clear_bit(I40E_VF_STATE_INIT, &vf->vf_states);
 
+	/* In the case of a VFLR, the HW has already reset the VF */
+	if (flr)
+		return false;
+
+	/* Sync VFR reset before trigger next one */
+	radq = rd32(hw, I40E_VFINT_ICR0_ENA(vf->vf_id)) &
+		    I40E_VFINT_ICR0_ADMINQ_MASK;
+
+	return vf_active && !radq;
+}
+
+/**
+ * i40e_start_vf_reset
+ * @vf: pointer to the VF structure
+ * @flr: VFLR was issued or not
+ *
+ * Second step of a VF reset: hit the reset trigger and clear the VFLR
+ * indication for the VF.
+ **/
+static void i40e_start_vf_reset(struct i40e_vf *vf, bool flr)
+{
+	struct i40e_pf *pf = vf->pf;
+	struct i40e_hw *hw = &pf->hw;
+	u32 reg, reg_idx, bit_idx;
+
 	/* In the case of a VFLR, the HW has already reset the VF and we
 	 * just need to clean up, so don't hit the VFRTRIG register.
 	 */
 	if (!flr) {
-		/* Sync VFR reset before trigger next one */
-		radq = rd32(hw, I40E_VFINT_ICR0_ENA(vf->vf_id)) &
-			    I40E_VFINT_ICR0_ADMINQ_MASK;
-		if (vf_active && !radq)
-			/* waiting for finish reset by virtual driver */
-			if (i40e_sync_vfr_reset(hw, vf->vf_id))
-				dev_info(&pf->pdev->dev,
-					 "Reset VF %d never finished\n",
-					 vf->vf_id);
-
 		/* Reset VF using VPGEN_VFRTRIG reg. It is also setting
 		 * in progress state in rstat1 register.
 		 */
@@ -2226,14 +2251,34 @@ static void i40e_trigger_vf_reset(struct i40e_vf *vf, bool flr)
 }
 
 /**
- * i40e_cleanup_reset_vf
+ * i40e_trigger_vf_reset
  * @vf: pointer to the VF structure
+ * @flr: VFLR was issued or not
  *
- * Cleanup a VF after the hardware reset is finished. Expects the caller to
- * have verified whether the reset is finished properly, and ensure the
- * minimum amount of wait time has passed.
+ * Trigger hardware to start a reset for a particular VF. Expects the caller
+ * to wait the proper amount of time to allow hardware to reset the VF before
+ * it cleans up and restores VF functionality.
  **/
-static void i40e_cleanup_reset_vf(struct i40e_vf *vf)
+static void i40e_trigger_vf_reset(struct i40e_vf *vf, bool flr)
+{
+	/* waiting for finish reset by virtual driver */
+	if (i40e_prep_vf_reset(vf, flr) &&
+	    i40e_sync_vfr_reset(&vf->pf->hw, vf->vf_id))
+		dev_info(&vf->pf->pdev->dev, "Reset VF %d never finished\n",
+			 vf->vf_id);
+
+	i40e_start_vf_reset(vf, flr);
+}
+
+/**
+ * i40e_rebuild_reset_vf
+ * @vf: pointer to the VF structure
+ * @defer_sync: leave programming the default filters to the caller
+ *
+ * First half of the VF cleanup after a reset: release the VF resources and
+ * set them up again. Returns true if the VF resources were allocated.
+ **/
+static bool i40e_rebuild_reset_vf(struct i40e_vf *vf, bool defer_sync)
 {
 	struct i40e_pf *pf = vf->pf;
 	struct i40e_hw *hw = &pf->hw;
@@ -2260,7 +2305,23 @@ static void i40e_cleanup_reset_vf(struct i40e_vf *vf)
 	wr32(hw, I40E_VPGEN_VFRTRIG(vf->vf_id), reg);
 
 	/* reallocate VF resources to finish resetting the VSI state */
-	if (!i40e_alloc_vf_res(vf)) {
+	return !i40e_alloc_vf_res(vf, defer_sync);
+}
+
+/**
+ * i40e_finish_reset_vf
+ * @vf: pointer to the VF structure
+ * @rebuilt: i40e_rebuild_reset_vf() succeeded
+ *
+ * Second half of the VF cleanup after a reset: map the queues, bring the
+ * VF back into service and tell the VF driver the reset is done.
+ **/
+static void i40e_finish_reset_vf(struct i40e_vf *vf, bool rebuilt)
+{
+	struct i40e_pf *pf = vf->pf;
+	struct i40e_hw *hw = &pf->hw;
+
+	if (rebuilt) {
 		int abs_vf_id = vf->vf_id + (int)hw->func_caps.vf_base_id;
 		i40e_enable_vf_mappings(vf);
 		set_bit(I40E_VF_STATE_ACTIVE, &vf->vf_states);
@@ -2283,6 +2344,37 @@ static void i40e_cleanup_reset_vf(struct i40e_vf *vf)
 	wr32(hw, I40E_VFGEN_RSTAT1(vf->vf_id), VIRTCHNL_VFR_VFACTIVE);
 }
 
+/**
+ * i40e_cleanup_reset_vf
+ * @vf: pointer to the VF structure
+ *
+ * Cleanup a VF after the hardware reset is finished. Expects the caller to
+ * have verified whether the reset is finished properly, and ensure the
+ * minimum amount of wait time has passed.
+ **/
+static void i40e_cleanup_reset_vf(struct i40e_vf *vf)
+{
+	i40e_finish_reset_vf(vf, i40e_rebuild_reset_vf(vf, false));
+}
+
+/**
+ * i40e_vc_quiesce_vf_msgs
+ * @vf: pointer to the VF structure
+ *
+ * Called once I40E_VF_STATE_RESETTING is set, which makes the VF's work
+ * item drop any further request, to wait for a request that may still be
+ * using the VF VSI. A request resetting its own VF is already serialized
+ * and does not wait.
+ **/
+static void i40e_vc_quiesce_vf_msgs(struct i40e_vf *vf)
+{
+	if (READ_ONCE(vf->msg_owner) == current)
+		return;
+
+	mutex_lock(&vf->msg_mutex);
+	mutex_unlock(&vf->msg_mutex);
+}
+
 /**
  * i40e_reset_vf
  * @vf: pointer to the VF structure
@@ -2309,6 +2401,7 @@ bool i40e_reset_vf(struct i40e_vf *vf, bool flr)
 	if (test_and_set_bit(I40E_VF_STATE_RESETTING, &vf->vf_states))
 		return false;
 
+	i40e_vc_quiesce_vf_msgs(vf);
 	i40e_trigger_vf_reset(vf, flr);
 
 	/* poll VPGEN_VFRSTAT reg to make sure
@@ -2351,124 +2444,232 @@ bool i40e_reset_vf(struct i40e_vf *vf, bool flr)
 }
 
 /**
- * i40e_reset_all_vfs
+ * i40e_reset_vf_set
  * @pf: pointer to the PF structure
+ * @vfs: bitmap of the VFs to reset, claimed by the caller
  * @flr: VFLR was issued or not
  *
- * Reset all allocated VFs in one go. First, tell the hardware to reset each
- * VF, then do all the waiting in one chunk, and finally finish restoring each
- * VF after the wait. This is useful during PF routines which need to reset
- * all VFs, as otherwise it must perform these resets in a serialized fashion.
- *
- * Returns true if any VFs were reset, and false otherwise.
+ * Reset a set of VFs with every phase pipelined across them: take them all
+ * out of service, wait for all VF drivers together, trigger all the resets,
+ * poll all the status registers in one loop and stop all the rings before
+ * waiting once. The VSIs are then set up for all VFs, leaving their default
+ * filters to a single filter sync pass, before the queues of all VFs are
+ * mapped and the VFs activated. The time spent in each phase is kept in
+ * pf->vf_reset_timing.
  **/
-bool i40e_reset_all_vfs(struct i40e_pf *pf, bool flr)
+static void i40e_reset_vf_set(struct i40e_pf *pf, unsigned long *vfs,
+			      bool flr)
 {
+	struct i40e_vf_reset_timing *timing = &pf->vf_reset_timing;
+	DECLARE_BITMAP(rebuilt, I40E_MAX_VF_COUNT);
+	DECLARE_BITMAP(pending, I40E_MAX_VF_COUNT);
 	struct i40e_hw *hw = &pf->hw;
+	int num_vfs = pf->num_alloc_vfs;
 	struct i40e_vf *vf;
+	u64 start, now;
+	void *aq_buf;
 	int i, v;
 	u32 reg;
 
-	/* If we don't have any VFs, then there is nothing to reset */
-	if (!pf->num_alloc_vfs)
-		return false;
+	memset(timing, 0, sizeof(*timing));
+	timing->num_vfs = bitmap_weight(vfs, num_vfs);
+	start = ktime_get_ns();
 
-	/* If VFs have been disabled, there is no need to reset */
-	if (test_and_set_bit(__I40E_VF_DISABLE, pf->state))
-		return false;
+	/* Take the VFs out of service, noting those whose driver is still
+	 * completing a reset of its own
+	 */
+	bitmap_zero(pending, I40E_MAX_VF_COUNT);
+	for_each_set_bit(v, vfs, num_vfs)
+		if (i40e_prep_vf_reset(&pf->vf[v], flr))
+			set_bit(v, pending);
 
-	/* Begin reset on all VFs at once */
-	for (v = 0; v < pf->num_alloc_vfs; v++) {
-		vf = &pf->vf[v];
-		/* If VF is being reset no need to trigger reset again */
-		if (!test_bit(I40E_VF_STATE_RESETTING, &vf->vf_states))
-			i40e_trigger_vf_reset(&pf->vf[v], flr);
+	/* waiting for finish reset by virtual drivers, all at once */
+	for (i = 0; i < I40E_VFR_WAIT_COUNT; i++) {
+		for_each_set_bit(v, pending, num_vfs) {
+			reg = rd32(hw, I40E_VFINT_ICR0_ENA(v)) &
+			      I40E_VFINT_ICR0_ADMINQ_MASK;
+			if (reg)
+				clear_bit(v, pending);
+		}
+		if (bitmap_empty(pending, num_vfs))
+			break;
+		usleep_range(100, 200);
 	}
+	for_each_set_bit(v, pending, num_vfs)
+		dev_info(&pf->pdev->dev, "Reset VF %d never finished\n", v);
+
+	now = ktime_get_ns();
+	timing->prep_us = div_u64(now - start, NSEC_PER_USEC);
+	start = now;
+
+	/* Begin reset on all VFs at once */
+	for_each_set_bit(v, vfs, num_vfs)
+		i40e_start_vf_reset(&pf->vf[v], flr);
 
 	/* HW requires some time to make sure it can flush the FIFO for a VF
-	 * when it resets it. Poll the VPGEN_VFRSTAT register for each VF in
-	 * sequence to make sure that it has completed. We'll keep track of
-	 * the VFs using a simple iterator that increments once that VF has
-	 * finished resetting.
+	 * when it resets it. Poll the VPGEN_VFRSTAT register of every VF in
+	 * each pass, dropping those that have completed.
 	 */
-	for (i = 0, v = 0; i < 10 && v < pf->num_alloc_vfs; i++) {
+	bitmap_copy(pending, vfs, num_vfs);
+	for (i = 0; i < 10 && !bitmap_empty(pending, num_vfs); i++) {
 		usleep_range(10000, 20000);
 
-		/* Check each VF in sequence, beginning with the VF to fail
-		 * the previous check.
-		 */
-		while (v < pf->num_alloc_vfs) {
-			vf = &pf->vf[v];
-			if (!test_bit(I40E_VF_STATE_RESETTING, &vf->vf_states)) {
-				reg = rd32(hw, I40E_VPGEN_VFRSTAT(vf->vf_id));
-				if (!(reg & I40E_VPGEN_VFRSTAT_VFRD_MASK))
-					break;
-			}
-
-			/* If the current VF has finished resetting, move on
-			 * to the next VF in sequence.
-			 */
-			v++;
+		for_each_set_bit(v, pending, num_vfs) {
+			reg = rd32(hw, I40E_VPGEN_VFRSTAT(v));
+			if (reg & I40E_VPGEN_VFRSTAT_VFRD_MASK)
+				clear_bit(v, pending);
 		}
 	}
 
 	if (flr)
 		usleep_range(10000, 20000);
 
-	/* Display a warning if at least one VF didn't manage to reset in
-	 * time, but continue on with the operation.
+	/* Display a warning for the VFs that didn't manage to reset in time,
+	 * but continue on with the operation.
 	 */
-	if (v < pf->num_alloc_vfs)
+	for_each_set_bit(v, pending, num_vfs)
 		dev_err(&pf->pdev->dev, "VF reset check timeout on VF %d\n",
-			pf->vf[v].vf_id);
+			v);
 	usleep_range(10000, 20000);
 
+	now = ktime_get_ns();
+	timing->reset_us = div_u64(now - start, NSEC_PER_USEC);
+	start = now;
+
 	/* Begin disabling all the rings associated with VFs, but do not wait
 	 * between each VF.
 	 */
-	for (v = 0; v < pf->num_alloc_vfs; v++) {
+	for_each_set_bit(v, vfs, num_vfs) {
 		/* On initial reset, we don't have any queues to disable */
 		if (pf->vf[v].lan_vsi_idx == 0)
 			continue;
 
-		/* If VF is reset in another thread just continue */
-		if (test_bit(I40E_VF_STATE_RESETTING, &vf->vf_states))
-			continue;
-
 		i40e_vsi_stop_rings_no_wait(pf->vsi[pf->vf[v].lan_vsi_idx]);
 	}
 
 	/* Now that we've notified HW to disable all of the VF rings, wait
 	 * until they finish.
 	 */
-	for (v = 0; v < pf->num_alloc_vfs; v++) {
-		/* On initial reset, we don't have any queues to disable */
+	for_each_set_bit(v, vfs, num_vfs) {
 		if (pf->vf[v].lan_vsi_idx == 0)
 			continue;
 
-		/* If VF is reset in another thread just continue */
-		if (test_bit(I40E_VF_STATE_RESETTING, &vf->vf_states))
-			continue;
-
 		i40e_vsi_wait_queues_disabled(pf->vsi[pf->vf[v].lan_vsi_idx]);
 	}
 
 	/* Hw may need up to 50ms to finish disabling the RX queues. We
 	 * minimize the wait by delaying only once for all VFs.
 	 */
-	mdelay(50);
+	msleep(50);
 
-	/* Finish the reset on each VF */
-	for (v = 0; v < pf->num_alloc_vfs; v++) {
-		/* If VF is reset in another thread just continue */
-		if (test_bit(I40E_VF_STATE_RESETTING, &vf->vf_states))
-			continue;
+	now = ktime_get_ns();
+	timing->rings_us = div_u64(now - start, NSEC_PER_USEC);
+	start = now;
+
+	/* Set up the VSIs of all VFs, then program their default filters in
+	 * one pass sharing a single AQ buffer. This must be done before the
+	 * VFs are reported active below.
+	 */
+	bitmap_zero(rebuilt, I40E_MAX_VF_COUNT);
+	for_each_set_bit(v, vfs, num_vfs)
+		if (i40e_rebuild_reset_vf(&pf->vf[v], true))
+			set_bit(v, rebuilt);
 
-		i40e_cleanup_reset_vf(&pf->vf[v]);
+	aq_buf = kzalloc(hw->aq.asq_buf_size, GFP_KERNEL);
+	for_each_set_bit(v, rebuilt, num_vfs) {
+		vf = &pf->vf[v];
+		if (i40e_sync_vsi_filters_buf(pf->vsi[vf->lan_vsi_idx], aq_buf))
+			dev_err(&pf->pdev->dev,
+				"Unable to program ucast filters for VF %d\n",
+				vf->vf_id);
 	}
+	kfree(aq_buf);
+
+	now = ktime_get_ns();
+	timing->vsi_us = div_u64(now - start, NSEC_PER_USEC);
+	start = now;
+
+	/* Map the queues and finish the reset on each VF */
+	for_each_set_bit(v, vfs, num_vfs)
+		i40e_finish_reset_vf(&pf->vf[v], test_bit(v, rebuilt));
 
 	i40e_flush(hw);
 	usleep_range(20000, 40000);
+
+	timing->map_us = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+
+	for_each_set_bit(v, vfs, num_vfs) {
+		vf = &pf->vf[v];
+		vf->reset_timestamp = ktime_get_ns();
+	}
+}
+
+/**
+ * i40e_claim_vf_reset
+ * @pf: pointer to the PF structure
+ * @vf_id: VF to reset
+ * @vfs: bitmap of the claimed VFs
+ *
+ * Mark the VF as resetting and add it to @vfs, unless another thread is
+ * already resetting it.
+ **/
+static void i40e_claim_vf_reset(struct i40e_pf *pf, int vf_id,
+				unsigned long *vfs)
+{
+	if (test_and_set_bit(I40E_VF_STATE_RESETTING,
+			     &pf->vf[vf_id].vf_states))
+		return;
+
+	i40e_vc_quiesce_vf_msgs(&pf->vf[vf_id]);
+	set_bit(vf_id, vfs);
+}
+
+/**
+ * i40e_release_vf_reset
+ * @pf: pointer to the PF structure
+ * @vfs: bitmap of the VFs claimed by i40e_claim_vf_reset()
+ **/
+static void i40e_release_vf_reset(struct i40e_pf *pf, unsigned long *vfs)
+{
+	int v;
+
+	for_each_set_bit(v, vfs, pf->num_alloc_vfs)
+		clear_bit(I40E_VF_STATE_RESETTING, &pf->vf[v].vf_states);
+}
+
+/**
+ * i40e_reset_all_vfs
+ * @pf: pointer to the PF structure
+ * @flr: VFLR was issued or not
+ *
+ * Reset all allocated VFs in one go. First, tell the hardware to reset each
+ * VF, then do all the waiting in one chunk, and finally finish restoring each
+ * VF after the wait. This is useful during PF routines which need to reset
+ * all VFs, as otherwise it must perform these resets in a serialized fashion.
+ *
+ * Returns true if any VFs were reset, and false otherwise.
+ **/
+bool i40e_reset_all_vfs(struct i40e_pf *pf, bool flr)
+{
+	DECLARE_BITMAP(vfs, I40E_MAX_VF_COUNT);
+	int v;
+
+	/* If we don't have any VFs, then there is nothing to reset */
+	if (!pf->num_alloc_vfs)
+		return false;
+
+	/* If VFs have been disabled, there is no need to reset */
+	if (test_and_set_bit(__I40E_VF_DISABLE, pf->state))
+		return false;
+
+	/* If VF is being reset in another thread leave it to that thread */
+	bitmap_zero(vfs, I40E_MAX_VF_COUNT);
+	for (v = 0; v < pf->num_alloc_vfs; v++)
+		i40e_claim_vf_reset(pf, v, vfs);
+
+	i40e_reset_vf_set(pf, vfs, flr);
+
+	i40e_release_vf_reset(pf, vfs);
 	clear_bit(__I40E_VF_DISABLE, pf->state);
 
 	return true;
@@ -2504,6 +2705,9 @@ void i40e_free_vfs(struct i40e_pf *pf)
 	while (test_and_set_bit(__I40E_VF_DISABLE, pf->state))
 		usleep_range(1000, 2000);
 
+	/* no new requests are queued once VFS_RELEASING is set */
+	i40e_vc_flush_vf_msgs(pf);
+
 	i40e_notify_client_of_vf_enable(pf, 0);
 
 #ifdef HAVE_NDO_SET_VF_LINK_STATE
@@ -2604,6 +2808,8 @@ void i40e_free_vfs(struct i40e_pf *pf)
 }
 
 #ifdef CONFIG_PCI_IOV
+static void i40e_vc_msg_task(struct work_struct *work);
+
 /**
  * i40e_alloc_vfs
  * @pf: pointer to the PF structure
@@ -2613,9 +2819,19 @@ void i40e_free_vfs(struct i40e_pf *pf)
  **/
 int i40e_alloc_vfs(struct i40e_pf *pf, u16 num_alloc_vfs)
 {
+	struct i40e_vf_reset_timing *timing = &pf->vf_reset_timing;
+	u64 start = ktime_get_ns();
+	u64 sriov_us, total_us;
 	struct i40e_vf *vfs;
 	int i, ret = 0;
 
+	if (!pf->vc_wq) {
+		pf->vc_wq = alloc_workqueue("%s_vc", WQ_UNBOUND | WQ_MEM_RECLAIM,
+					    0, dev_name(&pf->pdev->dev));
+		if (!pf->vc_wq)
+			return -ENOMEM;
+	}
+
 	/* Disable interrupt 0 so we don't try to handle the VFLR. */
 	i40e_irq_dynamic_disable_icr0(pf);
 	/* Check to see if we're just allocating resources for extant VFs */
@@ -2666,12 +2882,25 @@ int i40e_alloc_vfs(struct i40e_pf *pf, u16 num_alloc_vfs)
 		set_bit(I40E_VF_STATE_PRE_ENABLE, &vfs[i].vf_states);
 		INIT_LIST_HEAD(&vfs[i].vm_vlan_list);
 		INIT_LIST_HEAD(&vfs[i].vm_mac_list);
+		INIT_WORK(&vfs[i].msg_task, i40e_vc_msg_task);
+		INIT_LIST_HEAD(&vfs[i].msg_list);
+		spin_lock_init(&vfs[i].msg_lock);
+		mutex_init(&vfs[i].msg_mutex);
+		spin_lock_init(&vfs[i].stats_lock);
 		/* assign source pruning default value */
 		vfs[i].source_pruning = true;
 	}
 	pf->num_alloc_vfs = num_alloc_vfs;
+	sriov_us = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
 	/* VF resources get allocated during reset */
 	i40e_reset_all_vfs(pf, false);
+	total_us = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+
+	dev_info(&pf->pdev->dev,
+		 "Enabled %d VFs in %llu us: sriov %llu, prep %llu, reset %llu, rings %llu, vsi %llu, map %llu\n",
+		 num_alloc_vfs, total_us, sriov_us, timing->prep_us,
+		 timing->reset_us, timing->rings_us, timing->vsi_us,
+		 timing->map_us);
 
 	i40e_notify_client_of_vf_enable(pf, num_alloc_vfs);
 err_alloc:
@@ -3048,19 +3277,12 @@ err:
  * i40e_getnum_vf_vsi_vlan_filters
  * @vsi: pointer to the vsi
  *
- * called to get the number of VLANs offloaded on this VF
+ * called to get the number of VLANs offloaded on this VF. The count is kept
+ * up to date as filters are linked, so the mac_filter_hash_lock is not needed.
  **/
 static inline int i40e_getnum_vf_vsi_vlan_filters(struct i40e_vsi *vsi)
 {
-	struct i40e_mac_filter *f;
-	int num_vlans = 0, bkt;
-
-	hash_for_each(vsi->mac_filter_hash, bkt, f, hlist) {
-		if (f->vlan >= 0 && f->vlan <= I40E_MAX_VLANID)
-			num_vlans++;
-	}
-
-	return num_vlans;
+	return READ_ONCE(vsi->num_vlan_filters);
 }
 
 /**
@@ -3097,6 +3319,88 @@ err:
 	spin_unlock_bh(&vsi->mac_filter_hash_lock);
 }
 
+/* Completion tracking of a batch of asynchronous per-VLAN promiscuous
+ * commands. Each queued command holds a reference, as does the submitter,
+ * so a command completing after the submitter stopped waiting is safe.
+ */
+struct i40e_vf_promisc_batch {
+	atomic_t refs;
+	atomic_t failed;
+	u16 aq_err;	/* firmware status of the last failed command */
+};
+
+/**
+ * i40e_vf_promisc_batch_put - drop a reference to a promiscuous batch
+ * @batch: batch to release
+ **/
+static void i40e_vf_promisc_batch_put(struct i40e_vf_promisc_batch *batch)
+{
+	if (atomic_dec_and_test(&batch->refs))
+		kfree(batch);
+}
+
+/**
+ * i40e_vf_promisc_batch_done - AdminQ completion of one promiscuous command
+ * @hw: pointer to the hw struct
+ * @desc: written back descriptor
+ * @data: the i40e_vf_promisc_batch the command belongs to
+ **/
+static void i40e_vf_promisc_batch_done(struct i40e_hw *hw,
+				       struct i40e_aq_desc *desc, void *data)
+{
+	struct i40e_vf_promisc_batch *batch = data;
+	u16 retval = le16_to_cpu(desc->retval);
+
+	if (retval) {
+		batch->aq_err = retval & 0xff;
+		atomic_inc(&batch->failed);
+	}
+	i40e_vf_promisc_batch_put(batch);
+}
+
+/**
+ * i40e_set_vsi_promisc_on_vlan - queue one per-VLAN promiscuous command
+ * @hw: pointer to the hw struct
+ * @details: asynchronous command details of the batch
+ * @seid: vsi number
+ * @unicast: true for unicast, false for multicast promiscuous mode
+ * @enable: set or clear the promiscuous mode
+ * @vid: VLAN the mode applies to
+ *
+ * When the send queue is full, waits for the commands queued so far and
+ * retries once.
+ **/
+static i40e_status
+i40e_set_vsi_promisc_on_vlan(struct i40e_hw *hw,
+			     struct i40e_asq_cmd_details *details, u16 seid,
+			     bool unicast, bool enable, u16 vid)
+{
+	struct i40e_vf_promisc_batch *batch = details->cb_data;
+	i40e_status aq_ret;
+	int tries = 2;
+
+	do {
+		atomic_inc(&batch->refs);
+		if (unicast)
+			aq_ret = i40e_aq_set_vsi_uc_promisc_on_vlan(hw, seid,
+								    enable, vid,
+								    details);
+		else
+			aq_ret = i40e_aq_set_vsi_mc_promisc_on_vlan(hw, seid,
+								    enable, vid,
+								    details);
+		if (!aq_ret)
+			break;
+
+		i40e_vf_promisc_batch_put(batch);
+		if (aq_ret != I40E_ERR_ADMIN_QUEUE_FULL)
+			break;
+		i40e_asq_wait_async(hw, hw->aq.asq_cmd_timeout);
+	} while (--tries);
+
+	return aq_ret;
+}
+
 /**
  * i40e_set_vsi_promisc
  * @vf: pointer to the vf struct
@@ -3112,6 +3416,8 @@ static inline i40e_status
 i40e_set_vsi_promisc(struct i40e_vf *vf, u16 seid, bool multi_enable,
 		     bool unicast_enable, s16 *vl, int num_vlans)
 {
+	struct i40e_vf_promisc_batch *batch;
+	struct i40e_asq_cmd_details details;
 	i40e_status aq_ret = I40E_SUCCESS;
 	struct i40e_pf *pf = vf->pf;
 	struct i40e_hw *hw = &pf->hw;
@@ -3151,33 +3457,47 @@ i40e_set_vsi_promisc(struct i40e_vf *vf, u16 seid, bool multi_enable,
 		return aq_ret;
 	}
 
-	for (i = 0; i < num_vlans; i++) {
-		aq_ret = i40e_aq_set_vsi_mc_promisc_on_vlan(hw, seid,
-							    multi_enable,
-							    vl[i], NULL);
-		if (aq_ret) {
-			int aq_err = pf->hw.aq.asq_last_status;
+	batch = kzalloc(sizeof(*batch), GFP_KERNEL);
+	if (!batch)
+		return I40E_ERR_NO_MEMORY;
+	atomic_set(&batch->refs, 1);
+	i40e_fill_async_cmd_details(&details, i40e_vf_promisc_batch_done,
+				    batch);
 
+	/* queue the commands of every VLAN back to back and wait once for
+	 * the whole batch instead of once per command
+	 */
+	for (i = 0; i < num_vlans; i++) {
+		aq_ret = i40e_set_vsi_promisc_on_vlan(hw, &details, seid, false,
+						      multi_enable, vl[i]);
+		if (aq_ret)
 			dev_err(&pf->pdev->dev,
-				"VF %d failed to set multicast promiscuous mode err %s aq_err %s\n",
-				vf->vf_id,
-				i40e_stat_str(&pf->hw, aq_ret),
-				i40e_aq_str(&pf->hw, aq_err));
-		}
-
-		aq_ret = i40e_aq_set_vsi_uc_promisc_on_vlan(hw, seid,
-							    unicast_enable,
-							    vl[i], NULL);
-		if (aq_ret) {
-			int aq_err = pf->hw.aq.asq_last_status;
+				"VF %d failed to set multicast promiscuous mode err %s\n",
+				vf->vf_id, i40e_stat_str(&pf->hw, aq_ret));
 
+		aq_ret = i40e_set_vsi_promisc_on_vlan(hw, &details, seid, true,
+						      unicast_enable, vl[i]);
+		if (aq_ret)
 			dev_err(&pf->pdev->dev,
-				"VF %d failed to set unicast promiscuous mode err %s aq_err %s\n",
-				vf->vf_id,
-				i40e_stat_str(&pf->hw, aq_ret),
-				i40e_aq_str(&pf->hw, aq_err));
-		}
+				"VF %d failed to set unicast promiscuous mode err %s\n",
+				vf->vf_id, i40e_stat_str(&pf->hw, aq_ret));
 	}
+
+	if (i40e_asq_wait_async(hw, hw->aq.asq_cmd_timeout)) {
+		dev_err(&pf->pdev->dev,
+			"VF %d timed out setting VLAN promiscuous mode\n",
+			vf->vf_id);
+		aq_ret = I40E_ERR_ADMIN_QUEUE_TIMEOUT;
+	} else if (atomic_read(&batch->failed)) {
+		dev_err(&pf->pdev->dev,
+			"VF %d failed to set promiscuous mode on %d VLAN commands aq_err %s\n",
+			vf->vf_id, atomic_read(&batch->failed),
+			i40e_aq_str(&pf->hw,
+				    (enum i40e_admin_queue_err)batch->aq_err));
+		aq_ret = I40E_ERR_ADMIN_QUEUE_ERROR;
+	}
+	i40e_vf_promisc_batch_put(batch);
+
 	return aq_ret;
 }
 
@@ -3782,6 +4102,81 @@ static int i40e_vc_request_queues_msg(struct i40e_vf *vf, u8 *msg)
 
 }
 
+/**
+ * i40e_vf_get_eth_stats
+ * @vf: pointer to the VF info
+ * @stats: where to copy the VF VSI eth stats, may be NULL
+ *
+ * Serve the VF stats from its snapshot, reading the hardware counters only
+ * when the snapshot is older than pf->vf_stats_max_age. Every reader goes
+ * through here so guests or monitoring polling the stats do not turn into
+ * register reads on each request. With @stats NULL the caller only wants
+ * the VSI eth_stats to be within the same staleness bound.
+ *
+ * Returns 0 on success, negative on failure
+ **/
+int i40e_vf_get_eth_stats(struct i40e_vf *vf, struct i40e_eth_stats *stats)
+{
+	struct i40e_pf *pf = vf->pf;
+	struct i40e_vsi *vsi;
+
+	vsi = pf->vsi[vf->lan_vsi_idx];
+	if (!vf->lan_vsi_idx || !vsi)
+		return -EINVAL;
+
+	spin_lock_bh(&vf->stats_lock);
+	if (!vf->stats_valid ||
+	    time_after(jiffies, vf->stats_updated + pf->vf_stats_max_age)) {
+		i40e_update_eth_stats(vsi);
+		vf->stats = vsi->eth_stats;
+		vf->stats_updated = jiffies;
+		vf->stats_valid = true;
+	}
+	vf->stats_wanted = true;
+	if (stats)
+		*stats = vf->stats;
+	spin_unlock_bh(&vf->stats_lock);
+
+	return 0;
+}
+
+/**
+ * i40e_vc_collect_vf_stats
+ * @pf: pointer to the PF structure
+ *
+ * Called from the watchdog to refresh, in one pass, the snapshots of the
+ * VFs whose stats were read since the previous pass. Snapshots nobody
+ * reads are left alone so idle VFs cost no register reads.
+ **/
+void i40e_vc_collect_vf_stats(struct i40e_pf *pf)
+{
+	struct i40e_vsi *vsi;
+	struct i40e_vf *vf;
+	int i;
+
+	if (test_bit(__I40E_VF_DISABLE, pf->state))
+		return;
+
+	for (i = 0; i < pf->num_alloc_vfs; i++) {
+		vf = &pf->vf[i];
+		if (!READ_ONCE(vf->stats_wanted) ||
+		    !test_bit(I40E_VF_STATE_INIT, &vf->vf_states))
+			continue;
+
+		vsi = pf->vsi[vf->lan_vsi_idx];
+		if (!vf->lan_vsi_idx || !vsi)
+			continue;
+
+		spin_lock_bh(&vf->stats_lock);
+		i40e_update_eth_stats(vsi);
+		vf->stats = vsi->eth_stats;
+		vf->stats_updated = jiffies;
+		vf->stats_valid = true;
+		vf->stats_wanted = false;
+		spin_unlock_bh(&vf->stats_lock);
+	}
+}
+
 /**
  * i40e_vc_get_stats_msg
  * @vf: pointer to the VF info
@@ -3794,9 +4189,7 @@ static int i40e_vc_get_stats_msg(struct i40e_vf *vf, u8 *msg)
 	struct virtchnl_queue_select *vqs =
 	    (struct virtchnl_queue_select *)msg;
 	i40e_status aq_ret = I40E_SUCCESS;
-	struct i40e_pf *pf = vf->pf;
 	struct i40e_eth_stats stats;
-	struct i40e_vsi *vsi;
 
 	memset(&stats, 0, sizeof(struct i40e_eth_stats));
 
@@ -3810,13 +4203,8 @@ static int i40e_vc_get_stats_msg(struct i40e_vf *vf, u8 *msg)
 		goto error_param;
 	}
 
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	if (!vsi) {
+	if (i40e_vf_get_eth_stats(vf, &stats))
 		aq_ret = I40E_ERR_PARAM;
-		goto error_param;
-	}
-	i40e_update_eth_stats(vsi);
-	stats = vsi->eth_stats;
 
 error_param:
 	/* send the response back to the VF */
@@ -5717,30 +6105,21 @@ error_param:
 }
 
 /**
- * i40e_vc_process_vf_msg
- * @pf: pointer to the PF structure
- * @vf_id: source VF id
+ * i40e_vc_handle_vf_msg
+ * @vf: pointer to the VF info
  * @v_opcode: operation code
- * @v_retval: unused return value code
  * @msg: pointer to the msg buffer
  * @msglen: msg length
  *
- * called from the common aeq/arq handler to
- * process request from VF
+ * called from the VF's work item to process one request from the VF
  **/
-int i40e_vc_process_vf_msg(struct i40e_pf *pf, s16 vf_id, u32 v_opcode,
-			   u32 __always_unused v_retval, u8 *msg, u16 msglen)
+static int i40e_vc_handle_vf_msg(struct i40e_vf *vf, u32 v_opcode,
+				 u8 *msg, u16 msglen)
 {
-	struct i40e_hw *hw = &pf->hw;
-	int local_vf_id = vf_id - (s16)hw->func_caps.vf_base_id;
-	struct i40e_vf *vf;
+	struct i40e_pf *pf = vf->pf;
+	int local_vf_id = vf->vf_id;
 	int ret;
 
-	pf->vf_aq_requests++;
-	if (local_vf_id < 0 || local_vf_id >= pf->num_alloc_vfs)
-		return -EINVAL;
-	vf = &(pf->vf[local_vf_id]);
-
 	/* Check if VF is disabled. */
 	if (test_bit(I40E_VF_STATE_DISABLED, &vf->vf_states))
 		return I40E_ERR_PARAM;
@@ -5876,6 +6255,174 @@ int i40e_vc_process_vf_msg(struct i40e_pf *pf, s16 vf_id, u32 v_opcode,
 	return ret;
 }
 
+/**
+ * i40e_vc_msg_is_shared
+ * @v_opcode: operation code
+ *
+ * Returns true for requests that may touch resources shared by all VFs
+ * (queue and VSI pools, VF resets, channels, cloud filters). Those are
+ * serialized on pf->vc_mutex; everything else only works on the VF's own
+ * VSI and queues and runs concurrently with other VFs.
+ **/
+static bool i40e_vc_msg_is_shared(u32 v_opcode)
+{
+	switch (v_opcode) {
+	case VIRTCHNL_OP_VERSION:
+	case VIRTCHNL_OP_CONFIG_VSI_QUEUES:
+	case VIRTCHNL_OP_CONFIG_IRQ_MAP:
+	case VIRTCHNL_OP_ENABLE_QUEUES:
+	case VIRTCHNL_OP_DISABLE_QUEUES:
+	case VIRTCHNL_OP_ADD_ETH_ADDR:
+	case VIRTCHNL_OP_DEL_ETH_ADDR:
+	case VIRTCHNL_OP_ADD_VLAN:
+	case VIRTCHNL_OP_DEL_VLAN:
+	case VIRTCHNL_OP_GET_STATS:
+	case VIRTCHNL_OP_CONFIG_RSS_KEY:
+	case VIRTCHNL_OP_CONFIG_RSS_LUT:
+	case VIRTCHNL_OP_GET_RSS_HENA_CAPS:
+	case VIRTCHNL_OP_SET_RSS_HENA:
+	case VIRTCHNL_OP_ENABLE_VLAN_STRIPPING:
+	case VIRTCHNL_OP_DISABLE_VLAN_STRIPPING:
+	case VIRTCHNL_OP_GET_OFFLOAD_VLAN_V2_CAPS:
+	case VIRTCHNL_OP_ADD_VLAN_V2:
+	case VIRTCHNL_OP_DEL_VLAN_V2:
+	case VIRTCHNL_OP_ENABLE_VLAN_STRIPPING_V2:
+	case VIRTCHNL_OP_DISABLE_VLAN_STRIPPING_V2:
+	case VIRTCHNL_OP_ENABLE_VLAN_INSERTION_V2:
+	case VIRTCHNL_OP_DISABLE_VLAN_INSERTION_V2:
+		return false;
+	default:
+		return true;
+	}
+}
+
+/**
+ * i40e_vc_msg_task
+ * @work: pointer to the work_struct of the VF
+ *
+ * Drains the messages queued for one VF, in the order they were received.
+ * Work items of different VFs run in parallel on pf->vc_wq.
+ **/
+static void i40e_vc_msg_task(struct work_struct *work)
+{
+	struct i40e_vf *vf = container_of(work, struct i40e_vf, msg_task);
+	struct i40e_pf *pf = vf->pf;
+	struct i40e_vf_msg *vfmsg;
+	bool shared;
+
+	for (;;) {
+		spin_lock(&vf->msg_lock);
+		vfmsg = list_first_entry_or_null(&vf->msg_list,
+						 struct i40e_vf_msg, list);
+		if (vfmsg)
+			list_del(&vfmsg->list);
+		spin_unlock(&vf->msg_lock);
+		if (!vfmsg)
+			break;
+
+		/* the VFs are reset with the PF, drop what they asked before */
+		if (!test_bit(__I40E_RESET_RECOVERY_PENDING, pf->state)) {
+			shared = i40e_vc_msg_is_shared(vfmsg->v_opcode);
+			if (shared)
+				mutex_lock(&pf->vc_mutex);
+			mutex_lock(&vf->msg_mutex);
+			/* a reset of this VF has started, see
+			 * i40e_vc_quiesce_vf_msgs()
+			 */
+			if (!test_bit(I40E_VF_STATE_RESETTING,
+				      &vf->vf_states)) {
+				WRITE_ONCE(vf->msg_owner, current);
+				i40e_vc_handle_vf_msg(vf, vfmsg->v_opcode,
+						      vfmsg->msg,
+						      vfmsg->msglen);
+				WRITE_ONCE(vf->msg_owner, NULL);
+			}
+			mutex_unlock(&vf->msg_mutex);
+			if (shared)
+				mutex_unlock(&pf->vc_mutex);
+		}
+		kfree(vfmsg);
+	}
+}
+
+/**
+ * i40e_vc_flush_vf_msgs
+ * @pf: pointer to the PF structure
+ *
+ * Drop every virtchnl message still queued and wait for the VF work items
+ * to go idle.
+ **/
+void i40e_vc_flush_vf_msgs(struct i40e_pf *pf)
+{
+	struct i40e_vf_msg *vfmsg, *tmp;
+	struct i40e_vf *vf;
+	LIST_HEAD(stale);
+	int i;
+
+	if (!pf->vc_wq || !pf->vf)
+		return;
+
+	for (i = 0; i < pf->num_alloc_vfs; i++) {
+		vf = &pf->vf[i];
+		spin_lock(&vf->msg_lock);
+		list_splice_init(&vf->msg_list, &stale);
+		spin_unlock(&vf->msg_lock);
+	}
+	list_for_each_entry_safe(vfmsg, tmp, &stale, list) {
+		list_del(&vfmsg->list);
+		kfree(vfmsg);
+	}
+
+	flush_workqueue(pf->vc_wq);
+}
+
+/**
+ * i40e_vc_process_vf_msg
+ * @pf: pointer to the PF structure
+ * @vf_id: source VF id
+ * @v_opcode: operation code
+ * @v_retval: unused return value code
+ * @msg: pointer to the msg buffer
+ * @msglen: msg length
+ *
+ * called from the common aeq/arq handler to queue a request from the VF
+ * for the VF's work item
+ **/
+int i40e_vc_process_vf_msg(struct i40e_pf *pf, s16 vf_id, u32 v_opcode,
+			   u32 __always_unused v_retval, u8 *msg, u16 msglen)
+{
+	struct i40e_hw *hw = &pf->hw;
+	int local_vf_id = vf_id - (s16)hw->func_caps.vf_base_id;
+	struct i40e_vf_msg *vfmsg;
+	struct i40e_vf *vf;
+
+	pf->vf_aq_requests++;
+	if (local_vf_id < 0 || local_vf_id >= pf->num_alloc_vfs)
+		return -EINVAL;
+	vf = &(pf->vf[local_vf_id]);
+
+	/* Check if VF is disabled. */
+	if (test_bit(I40E_VF_STATE_DISABLED, &vf->vf_states) ||
+	    test_bit(__I40E_VFS_RELEASING, pf->state))
+		return I40E_ERR_PARAM;
+
+	vfmsg = kmalloc(sizeof(*vfmsg) + msglen, GFP_KERNEL);
+	if (!vfmsg)
+		return -ENOMEM;
+	vfmsg->v_opcode = v_opcode;
+	vfmsg->msglen = msglen;
+	if (msglen)
+		memcpy(vfmsg->msg, msg, msglen);
+
+	spin_lock(&vf->msg_lock);
+	list_add_tail(&vfmsg->list, &vf->msg_list);
+	spin_unlock(&vf->msg_lock);
+
+	queue_work(pf->vc_wq, &vf->msg_task);
+
+	return 0;
+}
+
 /**
  * i40e_vc_process_vflr_event
  * @pf: pointer to the PF structure
@@ -5885,9 +6432,9 @@ int i40e_vc_process_vf_msg(struct i40e_pf *pf, s16 vf_id, u32 v_opcode,
  **/
 int i40e_vc_process_vflr_event(struct i40e_pf *pf)
 {
+	DECLARE_BITMAP(vfs, I40E_MAX_VF_COUNT);
 	struct i40e_hw *hw = &pf->hw;
 	u32 reg, reg_idx, bit_idx;
-	struct i40e_vf *vf;
 	int vf_id;
 
 	if (!test_bit(__I40E_VFLR_EVENT_PENDING, pf->state))
@@ -5904,17 +6451,31 @@ int i40e_vc_process_vflr_event(struct i40e_pf *pf)
 	i40e_flush(hw);
 
 	clear_bit(__I40E_VFLR_EVENT_PENDING, pf->state);
+
+	if (test_bit(__I40E_VF_RESETS_DISABLED, pf->state) ||
+	    test_bit(__I40E_VF_DISABLE, pf->state))
+		return 0;
+
+	/* Collect every VF with a pending VFLR and reset them together, so a
+	 * burst of VFLRs costs one round of waits instead of one per VF.
+	 */
+	bitmap_zero(vfs, I40E_MAX_VF_COUNT);
 	for (vf_id = 0; vf_id < pf->num_alloc_vfs; vf_id++) {
 		reg_idx = (hw->func_caps.vf_base_id + vf_id) / 32;
 		bit_idx = (hw->func_caps.vf_base_id + vf_id) % 32;
 		/* read GLGEN_VFLRSTAT register to find out the flr VFs */
-		vf = &pf->vf[vf_id];
 		reg = rd32(hw, I40E_GLGEN_VFLRSTAT(reg_idx));
 		if (reg & BIT(bit_idx))
-			/* i40e_reset_vf will clear the bit in GLGEN_VFLRSTAT */
-			i40e_reset_vf(vf, true);
+			i40e_claim_vf_reset(pf, vf_id, vfs);
 	}
 
+	if (bitmap_empty(vfs, pf->num_alloc_vfs))
+		return 0;
+
+	/* i40e_start_vf_reset will clear the bits in GLGEN_VFLRSTAT */
+	i40e_reset_vf_set(pf, vfs, true);
+	i40e_release_vf_reset(pf, vfs);
+
 	return 0;
 }
 
@@ -6620,7 +7181,7 @@ int i40e_get_vf_stats(struct net_device *netdev, int vf_id,
 	struct i40e_netdev_priv *np = netdev_priv(netdev);
 	struct i40e_pf *pf = np->vsi->back;
 	struct i40e_eth_stats *stats;
-	struct i40e_vsi *vsi;
+	struct i40e_eth_stats es;
 	struct i40e_vf *vf;
 
 	/* validate the request */
@@ -6634,12 +7195,9 @@ int i40e_get_vf_stats(struct net_device *netdev, int vf_id,
 		return -EBUSY;
 	}
 
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	if (!vsi)
+	if (i40e_vf_get_eth_stats(vf, &es))
 		return -EINVAL;
-
-	i40e_update_eth_stats(vsi);
-	stats = &vsi->eth_stats;
+	stats = &es;
 
 	memset(vf_stats, 0, sizeof(*vf_stats));
 
@@ -7679,18 +8237,17 @@ static int i40e_get_rx_bytes(struct pci_dev *pdev, int vf_id,
 			     u64 *rx_bytes)
 {
 	struct i40e_pf *pf = pci_get_drvdata(pdev);
-	struct i40e_vsi *vsi;
-	struct i40e_vf *vf;
+	struct i40e_eth_stats stats;
 	int ret;
 
 	/* validate the request */
 	ret = i40e_validate_vf(pf, vf_id);
 	if (ret)
 		goto err_out;
-	vf = &pf->vf[vf_id];
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	i40e_update_eth_stats(vsi);
-	*rx_bytes = vsi->eth_stats.rx_bytes;
+	ret = i40e_vf_get_eth_stats(&pf->vf[vf_id], &stats);
+	if (ret)
+		goto err_out;
+	*rx_bytes = stats.rx_bytes;
 err_out:
 	return ret;
 }
@@ -7709,18 +8266,17 @@ static int i40e_get_rx_dropped(struct pci_dev *pdev, int vf_id,
 			       u64 *rx_dropped)
 {
 	struct i40e_pf *pf = pci_get_drvdata(pdev);
-	struct i40e_vsi *vsi;
-	struct i40e_vf *vf;
+	struct i40e_eth_stats stats;
 	int ret;
 
 	/* validate the request */
 	ret = i40e_validate_vf(pf, vf_id);
 	if (ret)
 		goto err_out;
-	vf = &pf->vf[vf_id];
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	i40e_update_eth_stats(vsi);
-	*rx_dropped = vsi->eth_stats.rx_discards;
+	ret = i40e_vf_get_eth_stats(&pf->vf[vf_id], &stats);
+	if (ret)
+		goto err_out;
+	*rx_dropped = stats.rx_discards;
 err_out:
 	return ret;
 }
@@ -7739,19 +8295,18 @@ static int i40e_get_rx_packets(struct pci_dev *pdev, int vf_id,
 			       u64 *rx_packets)
 {
 	struct i40e_pf *pf = pci_get_drvdata(pdev);
-	struct i40e_vsi *vsi;
-	struct i40e_vf *vf;
+	struct i40e_eth_stats stats;
 	int ret;
 
 	/* validate the request */
 	ret = i40e_validate_vf(pf, vf_id);
 	if (ret)
 		goto err_out;
-	vf = &pf->vf[vf_id];
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	i40e_update_eth_stats(vsi);
-	*rx_packets = vsi->eth_stats.rx_unicast + vsi->eth_stats.rx_multicast +
-		      vsi->eth_stats.rx_broadcast;
+	ret = i40e_vf_get_eth_stats(&pf->vf[vf_id], &stats);
+	if (ret)
+		goto err_out;
+	*rx_packets = stats.rx_unicast + stats.rx_multicast +
+		      stats.rx_broadcast;
 err_out:
 	return ret;
 }
@@ -7770,18 +8325,17 @@ static int i40e_get_tx_bytes(struct pci_dev *pdev, int vf_id,
 			     u64 *tx_bytes)
 {
 	struct i40e_pf *pf = pci_get_drvdata(pdev);
-	struct i40e_vsi *vsi;
-	struct i40e_vf *vf;
+	struct i40e_eth_stats stats;
 	int ret;
 
 	/* validate the request */
 	ret = i40e_validate_vf(pf, vf_id);
 	if (ret)
 		goto err_out;
-	vf = &pf->vf[vf_id];
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	i40e_update_eth_stats(vsi);
-	*tx_bytes = vsi->eth_stats.tx_bytes;
+	ret = i40e_vf_get_eth_stats(&pf->vf[vf_id], &stats);
+	if (ret)
+		goto err_out;
+	*tx_bytes = stats.tx_bytes;
 err_out:
 	return ret;
 }
@@ -7800,18 +8354,17 @@ static int i40e_get_tx_dropped(struct pci_dev *pdev, int vf_id,
 			       u64 *tx_dropped)
 {
 	struct i40e_pf *pf = pci_get_drvdata(pdev);
-	struct i40e_vsi *vsi;
-	struct i40e_vf *vf;
+	struct i40e_eth_stats stats;
 	int ret;
 
 	/* validate the request */
 	ret = i40e_validate_vf(pf, vf_id);
 	if (ret)
 		goto err_out;
-	vf = &pf->vf[vf_id];
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	i40e_update_eth_stats(vsi);
-	*tx_dropped = vsi->eth_stats.tx_discards;
+	ret = i40e_vf_get_eth_stats(&pf->vf[vf_id], &stats);
+	if (ret)
+		goto err_out;
+	*tx_dropped = stats.tx_discards;
 err_out:
 	return ret;
 }
@@ -7830,19 +8383,18 @@ static int i40e_get_tx_packets(struct pci_dev *pdev, int vf_id,
 			       u64 *tx_packets)
 {
 	struct i40e_pf *pf = pci_get_drvdata(pdev);
-	struct i40e_vsi *vsi;
-	struct i40e_vf *vf;
+	struct i40e_eth_stats stats;
 	int ret;
 
 	/* validate the request */
 	ret = i40e_validate_vf(pf, vf_id);
 	if (ret)
 		goto err_out;
-	vf = &pf->vf[vf_id];
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	i40e_update_eth_stats(vsi);
-	*tx_packets = vsi->eth_stats.tx_unicast + vsi->eth_stats.tx_multicast +
-		      vsi->eth_stats.tx_broadcast;
+	ret = i40e_vf_get_eth_stats(&pf->vf[vf_id], &stats);
+	if (ret)
+		goto err_out;
+	*tx_packets = stats.tx_unicast + stats.tx_multicast +
+		      stats.tx_broadcast;
 err_out:
 	return ret;
 }
@@ -7861,18 +8413,17 @@ static int i40e_get_tx_errors(struct pci_dev *pdev, int vf_id,
 			      u64 *tx_errors)
 {
 	struct i40e_pf *pf = pci_get_drvdata(pdev);
-	struct i40e_vsi *vsi;
-	struct i40e_vf *vf;
+	struct i40e_eth_stats stats;
 	int ret;
 
 	/* validate the request */
 	ret = i40e_validate_vf(pf, vf_id);
 	if (ret)
 		goto err_out;
-	vf = &pf->vf[vf_id];
-	vsi = pf->vsi[vf->lan_vsi_idx];
-	i40e_update_eth_stats(vsi);
-	*tx_errors = vsi->eth_stats.tx_errors;
+	ret = i40e_vf_get_eth_stats(&pf->vf[vf_id], &stats);
+	if (ret)
+		goto err_out;
+	*tx_errors = stats.tx_errors;
 err_out:
 	return ret;
 }
@@ -19,6 +19,8 @@
 #define I40E_MAX_VF_PROMISC_FLAGS	3
 
 #define I40E_VF_STATE_WAIT_COUNT	20
+#define I40E_MAX_VF_COUNT		128	/* VFs per device */
+#define I40E_VF_STATS_MAX_AGE_MS	1000
 #define I40E_VFR_WAIT_COUNT		100
 #define I40E_VF_RESET_TIME_MIN		30000000	// time in nsec
 
@@ -96,6 +98,24 @@ struct i40e_mdd_vf_events {
 	u64 last_printed;
 };
 
+/* virtchnl message queued for the VF's work item */
+struct i40e_vf_msg {
+	struct list_head list;
+	u32 v_opcode;
+	u16 msglen;
+	u8 msg[];
+};
+
+/* time spent in each phase of the last bulk VF reset, in usecs */
+struct i40e_vf_reset_timing {
+	u32 num_vfs;
+	u64 prep_us;	/* VFs taken out of service, VF drivers synced */
+	u64 reset_us;	/* resets triggered and completed */
+	u64 rings_us;	/* VF rings stopped */
+	u64 vsi_us;	/* VSIs set up again and default filters programmed */
+	u64 map_us;	/* queue mappings programmed, VFs activated */
+};
+
 /* VF information structure */
 struct i40e_vf {
 	struct i40e_pf *pf;
@@ -174,6 +194,24 @@ struct i40e_vf {
 	u16 num_cloud_filters;
 	struct i40e_vf_tc_info tc_info;
 	struct virtchnl_vlan_caps vlan_v2_caps;
+
+	/* virtchnl messages are handled in order from the VF's own work
+	 * item, so a slow request only holds up the VF that sent it
+	 */
+	struct work_struct msg_task;
+	struct list_head msg_list;
+	spinlock_t msg_lock;	/* protects msg_list */
+	struct mutex msg_mutex;	/* held while a request is being handled */
+	struct task_struct *msg_owner;	/* task handling a request, if any */
+
+	/* Snapshot of the VF VSI eth stats that every stats reader is served
+	 * from, refreshed by the watchdog while somebody keeps reading it
+	 */
+	spinlock_t stats_lock;	/* protects the snapshot */
+	struct i40e_eth_stats stats;
+	unsigned long stats_updated;	/* jiffies of the last refresh */
+	bool stats_valid;
+	bool stats_wanted;	/* read since the last refresh */
 };
 
 void i40e_free_vfs(struct i40e_pf *pf);
@@ -184,6 +222,9 @@ int i40e_alloc_vfs(struct i40e_pf *pf, u16 num_alloc_vfs);
 int i40e_vc_process_vf_msg(struct i40e_pf *pf, s16 vf_id, u32 v_opcode,
 			   u32 v_retval, u8 *msg, u16 msglen);
 int i40e_vc_process_vflr_event(struct i40e_pf *pf);
+void i40e_vc_flush_vf_msgs(struct i40e_pf *pf);
+int i40e_vf_get_eth_stats(struct i40e_vf *vf, struct i40e_eth_stats *stats);
+void i40e_vc_collect_vf_stats(struct i40e_pf *pf);
 bool i40e_reset_vf(struct i40e_vf *vf, bool flr);
 bool i40e_reset_all_vfs(struct i40e_pf *pf, bool flr);
 void i40e_vc_notify_vf_reset(struct i40e_vf *vf);
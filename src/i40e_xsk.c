@@ -16,6 +16,7 @@
 #include "i40e.h"
 #include "i40e_txrx_common.h"
 #include "i40e_xsk.h"
+#include "i40e_trace.h"
 
 
 #ifdef HAVE_MEM_TYPE_XSK_BUFF_POOL
@@ -528,6 +529,7 @@ static bool i40e_alloc_buffer_zc(struct i40e_ring *rx_ring,
 
 	if (!xsk_umem_peek_addr(umem, &handle)) {
 		rx_ring->rx_stats.alloc_page_failed++;
+		i40e_trace(rx_alloc_page_failed, rx_ring);
 		return false;
 	}
 
@@ -567,6 +569,7 @@ static bool i40e_alloc_buffer_slow_zc(struct i40e_ring *rx_ring,
 
 	if (!xsk_umem_peek_addr_rq(umem, &handle)) {
 		rx_ring->rx_stats.alloc_page_failed++;
+		i40e_trace(rx_alloc_page_failed, rx_ring);
 		return false;
 	}
 
@@ -859,6 +862,7 @@ static void i40e_handle_xdp_result_zc(struct i40e_ring *rx_ring,
 		skb = i40e_construct_skb_zc(rx_ring, xdp_buff);
 		if (!skb) {
 			rx_ring->rx_stats.alloc_buff_failed++;
+			i40e_trace(rx_alloc_buff_failed, rx_ring);
 			*rx_packets = 0;
 			*rx_bytes = 0;
 			return;
@@ -1223,17 +1227,19 @@ static bool i40e_xmit_zc(struct i40e_ring *xdp_ring, unsigned int budget)
 /**
  * i40e_clean_xdp_tx_buffer - Frees and unmaps an XDP Tx entry
  * @tx_ring: XDP Tx ring
- * @tx_bi: Tx buffer info to clean
+ * @idx: index of the Tx buffer info to clean
  **/
 static void i40e_clean_xdp_tx_buffer(struct i40e_ring *tx_ring,
-				     struct i40e_tx_buffer *tx_bi)
+				     unsigned int idx)
 {
-	xdp_return_frame(tx_bi->xdpf);
+	struct i40e_tx_dma *tx_dma = &tx_ring->tx_dma[idx];
+
+	xdp_return_frame(tx_ring->tx_bi[idx].xdpf);
 	tx_ring->xdp_tx_active--;
 	dma_unmap_single(tx_ring->dev,
-			 dma_unmap_addr(tx_bi, dma),
-			 dma_unmap_len(tx_bi, len), DMA_TO_DEVICE);
-	dma_unmap_len_set(tx_bi, len, 0);
+			 dma_unmap_addr(tx_dma, dma),
+			 dma_unmap_len(tx_dma, len), DMA_TO_DEVICE);
+	dma_unmap_len_set(tx_dma, len, 0);
 }
 
 /**
@@ -1274,7 +1280,7 @@ bool i40e_clean_xdp_tx_irq(struct i40e_vsi *vsi,
 		tx_bi = &tx_ring->tx_bi[ntc];
 
 		if (tx_bi->xdpf) {
-			i40e_clean_xdp_tx_buffer(tx_ring, tx_bi);
+			i40e_clean_xdp_tx_buffer(tx_ring, ntc);
 			tx_bi->xdpf = NULL;
 		} else {
 			xsk_frames++;
@@ -1416,7 +1422,7 @@ void i40e_xsk_clean_tx_ring(struct i40e_ring *tx_ring)
 		tx_bi = &tx_ring->tx_bi[ntc];
 
 		if (tx_bi->xdpf)
-			i40e_clean_xdp_tx_buffer(tx_ring, tx_bi);
+			i40e_clean_xdp_tx_buffer(tx_ring, ntc);
 		else
 			xsk_frames++;
 
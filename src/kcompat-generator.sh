@@ -93,6 +93,9 @@ function gen-ethtool() {
 	eth='include/linux/ethtool.h'
 	ueth='include/uapi/linux/ethtool.h'
 	gen HAVE_ETHTOOL_EXTENDED_RINGPARAMS if method get_ringparam of ethtool_ops matches 'struct kernel_ethtool_ringparam \\*' in "$eth"
+	gen HAVE_ETHTOOL_ETH_MAC_STATS if method get_eth_mac_stats of ethtool_ops in "$eth"
+	gen HAVE_ETHTOOL_PAUSE_STATS if method get_pause_stats of ethtool_ops in "$eth"
+	gen HAVE_ETHTOOL_RMON_STATS if method get_rmon_stats of ethtool_ops in "$eth"
 	gen NEED_ETHTOOL_SPRINTF if fun ethtool_sprintf absent in "$eth"
 	gen HAVE_ETHTOOL_FLOW_RSS if macro FLOW_RSS in "$ueth"
 }
@@ -183,6 +186,7 @@ function gen-other() {
 	gen HAVE_TRACE_ENABLED_SUPPORT if implementation of macro __DECLARE_TRACE matches 'trace_##name##_enabled' in include/linux/tracepoint.h
 	gen HAVE_U64_STATS_FETCH_BEGIN_IRQ if fun u64_stats_fetch_begin_irq in include/linux/u64_stats_sync.h
 	gen HAVE_U64_STATS_FETCH_RETRY_IRQ if fun u64_stats_fetch_retry_irq in include/linux/u64_stats_sync.h
+	gen HAVE_NETDEV_STAT_OPS if struct netdev_stat_ops in include/net/netdev_queues.h
 	gen HAVE_LMV1_SUPPORT if macro VFIO_REGION_TYPE_MIGRATION in include/uapi/linux/vfio.h
 }
 